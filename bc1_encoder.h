@@ -0,0 +1,140 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mip_generator.h"
+#include "thread_pool.h"
+
+// BC1 (DXT1) encoder for opaque textures. Endpoints are picked along the
+// principal axis of the block's colors, which is close to what the reference
+// compressors produce for the "range fit" quality level at a fraction of the
+// cost. Blocks are always encoded in 4-color mode.
+constexpr size_t BC1_BLOCK_BYTES = 8;
+
+inline uint16_t packRgb565(const float c[3]){
+  int r = std::clamp(static_cast<int>(c[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+  int g = std::clamp(static_cast<int>(c[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+  int b = std::clamp(static_cast<int>(c[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+  return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void unpackRgb565(uint16_t v, int c[3]){
+  int r = (v >> 11) & 31;
+  int g = (v >> 5) & 63;
+  int b = v & 31;
+  c[0] = (r << 3) | (r >> 2);
+  c[1] = (g << 2) | (g >> 4);
+  c[2] = (b << 3) | (b >> 2);
+}
+
+// block holds 16 RGBA8 texels in row order
+inline void encodeBC1Block(const uint8_t block[64], uint8_t out[BC1_BLOCK_BYTES]){
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; i++){
+    for(int c = 0; c < 3; c++){
+      mean[c] += block[i * 4 + c];
+    }
+  }
+  for(int c = 0; c < 3; c++){
+    mean[c] /= 16.0f;
+  }
+
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; i++){
+    float r = block[i * 4 + 0] - mean[0];
+    float g = block[i * 4 + 1] - mean[1];
+    float b = block[i * 4 + 2] - mean[2];
+    cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+    cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+  }
+
+  // a few power iterations are enough to find the dominant axis
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for(int iter = 0; iter < 4; iter++){
+    float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    float len = std::max({std::abs(x), std::abs(y), std::abs(z)});
+    if(len < 1e-6f){
+      break;
+    }
+    axis[0] = x / len; axis[1] = y / len; axis[2] = z / len;
+  }
+
+  float minProj = 1e30f, maxProj = -1e30f;
+  for(int i = 0; i < 16; i++){
+    float proj = (block[i * 4 + 0] - mean[0]) * axis[0] + (block[i * 4 + 1] - mean[1]) * axis[1]
+               + (block[i * 4 + 2] - mean[2]) * axis[2];
+    minProj = std::min(minProj, proj);
+    maxProj = std::max(maxProj, proj);
+  }
+  float axisLen2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float lo[3], hi[3];
+  for(int c = 0; c < 3; c++){
+    lo[c] = mean[c] + axis[c] * minProj / axisLen2;
+    hi[c] = mean[c] + axis[c] * maxProj / axisLen2;
+  }
+
+  uint16_t color0 = packRgb565(hi);
+  uint16_t color1 = packRgb565(lo);
+  // color0 > color1 selects 4-color mode, equal endpoints need no indices
+  if(color0 < color1){
+    std::swap(color0, color1);
+  }
+
+  uint32_t indices = 0;
+  if(color0 != color1){
+    int palette[4][3];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for(int c = 0; c < 3; c++){
+      palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+    }
+
+    for(int i = 0; i < 16; i++){
+      int best = 0;
+      int bestDist = 1 << 30;
+      for(int p = 0; p < 4; p++){
+        int dr = block[i * 4 + 0] - palette[p][0];
+        int dg = block[i * 4 + 1] - palette[p][1];
+        int db = block[i * 4 + 2] - palette[p][2];
+        int dist = dr * dr + dg * dg + db * db;
+        if(dist < bestDist){
+          bestDist = dist;
+          best = p;
+        }
+      }
+      indices |= static_cast<uint32_t>(best) << (i * 2);
+    }
+  }
+
+  memcpy(out, &color0, 2);
+  memcpy(out + 2, &color1, 2);
+  memcpy(out + 4, &indices, 4);
+}
+
+// compresses a whole level, partial edge blocks repeat the last row/column
+inline std::vector<uint8_t> compressBC1(const ImageRGBA8& image, ThreadPool& pool){
+  uint32_t blocksX = (image.width + 3) / 4;
+  uint32_t blocksY = (image.height + 3) / 4;
+  std::vector<uint8_t> out(static_cast<size_t>(blocksX) * blocksY * BC1_BLOCK_BYTES);
+
+  pool.parallelFor(blocksY, 16, [&](size_t begin, size_t end){
+    uint8_t block[64];
+    for(size_t by = begin; by < end; by++){
+      for(uint32_t bx = 0; bx < blocksX; bx++){
+        for(uint32_t i = 0; i < 16; i++){
+          uint32_t x = std::min(bx * 4 + i % 4, image.width - 1);
+          uint32_t y = std::min(static_cast<uint32_t>(by) * 4 + i / 4, image.height - 1);
+          memcpy(block + i * 4, &image.pixels[(static_cast<size_t>(y) * image.width + x) * 4], 4);
+        }
+        encodeBC1Block(block, &out[(by * blocksX + bx) * BC1_BLOCK_BYTES]);
+      }
+    }
+  });
+  return out;
+}
@@ -0,0 +1,96 @@
+// CPU frustum culling: scalar vs. AVX2 vs. AVX2 on the thread pool, plus the
+// cost of the software occlusion pass.
+//   cpu_culling_bench [object count]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "cpu_culling.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// best of a few runs, the first one also warms the output vectors
+template<typename Fn>
+static double bestMs(Fn fn){
+  double best = 0.0;
+  for(int run = 0; run < 5; run++){
+    auto start = Clock::now();
+    fn();
+    double ms = elapsedMs(start);
+    best = run == 0 ? ms : std::min(best, ms);
+  }
+  return best;
+}
+
+int main(int argc, char** argv){
+  size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+
+  // the camera updateUniformBuffer() builds, looking into a field of objects
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f, -60.0f, 5.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+  glm::mat4 proj = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 200.0f);
+  proj[1][1] *= -1;
+  glm::mat4 viewProj = proj * view;
+
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> position(-100.0f, 100.0f);
+  std::uniform_real_distribution<float> size(0.1f, 2.0f);
+  BoundingSpheresSoA spheres;
+  BoundingBoxesSoA boxes;
+  spheres.resize(count);
+  boxes.resize(count);
+  for(size_t i = 0; i < count; i++){
+    glm::vec3 center(position(rng), position(rng), position(rng) * 0.1f);
+    float radius = size(rng);
+    spheres.set(i, BoundingSphere{center, radius});
+    boxes.set(i, center - glm::vec3(radius), center + glm::vec3(radius));
+  }
+
+  ThreadPool pool;
+  CpuCuller scalar;
+  scalar.setUseAvx2(false);
+  CpuCuller simd;
+  CpuCuller threaded(&pool);
+  for(CpuCuller* culler : {&scalar, &simd, &threaded}){
+    culler->setCamera(viewProj);
+  }
+
+  std::vector<uint32_t> scalarVisible, simdVisible, threadedVisible;
+  bool ok = true;
+  for(bool useBoxes : {false, true}){
+    auto cull = [&](CpuCuller& culler, std::vector<uint32_t>& visible){
+      return bestMs([&]{ useBoxes ? culler.cull(boxes, visible) : culler.cull(spheres, visible); });
+    };
+    double scalarMs = cull(scalar, scalarVisible);
+    double simdMs = cull(simd, simdVisible);
+    double threadedMs = cull(threaded, threadedVisible);
+    bool identical = scalarVisible == simdVisible && simdVisible == threadedVisible;
+    ok = ok && identical;
+
+    std::cout << (useBoxes ? "boxes" : "spheres") << ": " << count << " objects, " << scalarVisible.size() << " visible"
+              << std::endl;
+    std::cout << "  scalar:   " << scalarMs << " ms" << std::endl;
+    std::cout << "  " << (simd.usesAvx2() ? "AVX2:     " : "scalar:   ") << simdMs << " ms (" << scalarMs / simdMs << "x)"
+              << std::endl;
+    std::cout << "  threaded: " << threadedMs << " ms (" << scalarMs / threadedMs << "x, " << pool.size() << " workers)"
+              << (identical ? "" : "  OUTPUT MISMATCH") << std::endl;
+  }
+
+  // a row of walls in front of the camera hiding part of the field
+  std::vector<OccluderBox> occluders;
+  for(int i = -4; i <= 4; i++){
+    occluders.push_back(OccluderBox{glm::vec3(i * 10.0f - 3.0f, -30.0f, -10.0f), glm::vec3(i * 10.0f + 3.0f, -29.0f, 10.0f)});
+  }
+  double rasterMs = bestMs([&]{ threaded.setOccluders(occluders); });
+  double occlusionMs = bestMs([&]{ threaded.cull(boxes, threadedVisible); });
+  std::cout << "occlusion: " << occluders.size() << " occluders rasterized in " << rasterMs << " ms, " << threadedVisible.size()
+            << " of " << simdVisible.size() << " frustum visible boxes left after " << occlusionMs << " ms" << std::endl;
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,290 @@
+// DeviceMemoryAllocator against a fake memory-properties table and a mock
+// backend, no device needed: checks placement, dedicated allocations, buddy
+// coalescing and the statistics, then times allocate/free churn.
+//   device_allocator_bench [allocation count]
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "device_allocator.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// a discrete GPU: device local VRAM, host memory, and a small host visible BAR
+static VkPhysicalDeviceMemoryProperties fakeMemoryProperties(){
+  VkPhysicalDeviceMemoryProperties properties{};
+  properties.memoryHeapCount = 3;
+  properties.memoryHeaps[0] = {8ull << 30, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+  properties.memoryHeaps[1] = {16ull << 30, 0};
+  properties.memoryHeaps[2] = {256ull << 20, VK_MEMORY_HEAP_DEVICE_LOCAL_BIT};
+  properties.memoryTypeCount = 3;
+  properties.memoryTypes[0] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0};
+  properties.memoryTypes[1] = {VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 1};
+  properties.memoryTypes[2] = {VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
+                               | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 2};
+  return properties;
+}
+
+// Hands out numbered handles instead of memory. map returns a made up address
+// per handle that is never dereferenced, so 64MB blocks cost nothing.
+struct MockMemory{
+  struct Record{
+    VkDeviceSize size;
+    uint32_t memoryType;
+    uint8_t* mapped;
+  };
+  std::map<VkDeviceMemory, Record> live;
+  uint64_t nextId = 1;
+  uint64_t allocateCalls = 0;
+
+  DeviceMemoryBackend backend(){
+    DeviceMemoryBackend backend;
+    backend.allocate = [this](const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory){
+      memory = (VkDeviceMemory)(uintptr_t)nextId++;
+      live[memory] = Record{allocInfo.allocationSize, allocInfo.memoryTypeIndex, nullptr};
+      allocateCalls++;
+      return VK_SUCCESS;
+    };
+    backend.free = [this](VkDeviceMemory memory){
+      live.erase(memory);
+    };
+    backend.map = [this](VkDeviceMemory memory, void** data){
+      Record& record = live.at(memory);
+      record.mapped = (uint8_t*)(uintptr_t)(((uintptr_t)memory) << 28);
+      *data = record.mapped;
+      return VK_SUCCESS;
+    };
+    return backend;
+  }
+};
+
+struct Checker{
+  bool ok = true;
+
+  void expect(bool condition, const std::string& what){
+    if(!condition){
+      std::cout << "  FAILED: " << what << std::endl;
+      ok = false;
+    }
+  }
+};
+
+struct Live{
+  DeviceAllocation allocation;
+  VkMemoryRequirements requirements;
+  ResourceKind kind;
+};
+
+static VkMemoryRequirements requirements(VkDeviceSize size, VkDeviceSize alignment, uint32_t memoryTypeBits){
+  VkMemoryRequirements req{};
+  req.size = size;
+  req.alignment = alignment;
+  req.memoryTypeBits = memoryTypeBits;
+  return req;
+}
+
+// placement of every live allocation against the mock and against each other
+static void checkPlacement(Checker& check, const MockMemory& mock, const std::vector<Live>& allocations,
+                           VkDeviceSize granularity){
+  std::map<VkDeviceMemory, std::vector<const Live*>> byMemory;
+  for(const Live& live : allocations){
+    const DeviceAllocation& a = live.allocation;
+    auto record = mock.live.find(a.memory);
+    if(record == mock.live.end()){
+      check.expect(false, "allocation in freed or unknown memory");
+      continue;
+    }
+    check.expect(a.offset % live.requirements.alignment == 0, "offset honours alignment");
+    check.expect(a.offset + a.size <= record->second.size, "allocation inside its memory");
+    check.expect(a.size == live.requirements.size, "size is the requested size");
+    check.expect(record->second.memoryType == a.memoryType, "memory type of the backing memory");
+    check.expect(a.mapped == (record->second.mapped ? record->second.mapped + a.offset : nullptr),
+                 "mapped pointer is the memory's mapping plus offset");
+    byMemory[a.memory].push_back(&live);
+  }
+
+  for(auto& [memory, list] : byMemory){
+    std::sort(list.begin(), list.end(), [](const Live* a, const Live* b){ return a->allocation.offset < b->allocation.offset; });
+    for(size_t i = 1; i < list.size(); i++){
+      const DeviceAllocation& prev = list[i - 1]->allocation;
+      const DeviceAllocation& next = list[i]->allocation;
+      check.expect(prev.offset + prev.size <= next.offset, "allocations don't overlap");
+      // linear and optimal resources must not share a bufferImageGranularity page
+      if(list[i - 1]->kind != list[i]->kind){
+        check.expect((prev.offset + prev.size - 1) / granularity < next.offset / granularity,
+                     "linear and optimal resources on separate granularity pages");
+      }
+    }
+  }
+}
+
+// the counters agree with the live allocations and the mock's memory objects
+static void checkStats(Checker& check, const DeviceMemoryAllocator& allocator, const MockMemory& mock,
+                       const std::vector<Live>& allocations){
+  DeviceMemoryStats stats = allocator.statistics();
+  uint32_t subAllocations = 0, dedicated = 0;
+  VkDeviceSize requested = 0, dedicatedBytes = 0;
+  for(const Live& live : allocations){
+    if(live.allocation.block != nullptr){
+      subAllocations++;
+      requested += live.allocation.size;
+    } else {
+      dedicated++;
+      dedicatedBytes += live.allocation.size;
+    }
+  }
+  VkDeviceSize heapTotal = 0;
+  for(uint32_t i = 0; i < VK_MAX_MEMORY_HEAPS; i++){
+    heapTotal += stats.heapUsage[i];
+  }
+
+  check.expect(stats.allocationCount == subAllocations, "allocationCount counts sub-allocations");
+  check.expect(stats.dedicatedCount == dedicated, "dedicatedCount counts dedicated allocations");
+  check.expect(stats.requestedBytes == requested, "requestedBytes sums the requests");
+  check.expect(stats.dedicatedBytes == dedicatedBytes, "dedicatedBytes sums dedicated allocations");
+  check.expect(stats.usedBytes >= stats.requestedBytes, "usedBytes includes rounding");
+  check.expect(stats.usedBytes <= stats.blockBytes, "usedBytes fits the blocks");
+  check.expect(heapTotal == stats.usedBytes + stats.dedicatedBytes, "heap usage sums used and dedicated bytes");
+  check.expect(stats.deviceMemoryCount == stats.blockCount + stats.dedicatedCount, "deviceMemoryCount is blocks plus dedicated");
+  check.expect(stats.deviceMemoryCount == mock.live.size(), "deviceMemoryCount matches live memory objects");
+}
+
+// sub-allocations of 1/8 block exactly fill one block, which only works if
+// every earlier free coalesced back into whole-block nodes
+static void checkFillsOneBlock(Checker& check, DeviceMemoryAllocator& allocator, const MockMemory& mock){
+  uint64_t callsBefore = mock.allocateCalls;
+  std::vector<DeviceAllocation> eighths;
+  for(int i = 0; i < 8; i++){
+    eighths.push_back(allocator.allocate(requirements(DeviceMemoryAllocator::DEFAULT_BLOCK_SIZE / 8, 256, 1u << 0),
+                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, ResourceKind::Linear));
+  }
+  check.expect(mock.allocateCalls == callsBefore, "freed nodes coalesce into a whole reusable block");
+  for(const DeviceAllocation& a : eighths){
+    check.expect(a.memory == eighths[0].memory, "all eighths share the block");
+  }
+  for(DeviceAllocation& a : eighths){
+    allocator.free(a);
+  }
+}
+
+static bool runChecks(VkDeviceSize granularity){
+  std::cout << "checks with bufferImageGranularity " << granularity << std::endl;
+  Checker check;
+  MockMemory mock;
+  VkPhysicalDeviceMemoryProperties properties = fakeMemoryProperties();
+
+  {
+    DeviceMemoryAllocator allocator(properties, granularity, mock.backend());
+
+    // the 256MB BAR heap gets 32MB blocks, so 8MB is already a quarter block there
+    DeviceAllocation vram = allocator.allocate(requirements(8ull << 20, 256, 1u << 0), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                               ResourceKind::Linear);
+    DeviceAllocation bar = allocator.allocate(requirements(8ull << 20, 256, 1u << 2),
+                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                                              ResourceKind::Linear);
+    DeviceAllocation large = allocator.allocate(requirements(16ull << 20, 256, 1u << 0), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                ResourceKind::Optimal);
+    DeviceAllocation forced = allocator.allocate(requirements(4096, 256, 1u << 0), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                                 ResourceKind::Optimal, true);
+    check.expect(vram.block != nullptr, "1/8 of a 64MB block is sub-allocated");
+    check.expect(bar.block == nullptr && bar.mapped != nullptr, "1/4 of a BAR block is dedicated and mapped");
+    check.expect(large.block == nullptr && large.offset == 0, "a quarter block is dedicated");
+    check.expect(forced.block == nullptr && forced.size == 4096, "dedicated requests get their own memory");
+    check.expect(mock.live.at(forced.memory).size == 4096, "dedicated memory is exactly the requested size");
+    check.expect(vram.mapped == nullptr, "device local memory isn't mapped");
+    for(DeviceAllocation* a : {&vram, &bar, &large, &forced}){
+      allocator.free(*a);
+    }
+    checkStats(check, allocator, mock, {});
+
+    // random mix of sizes, alignments, kinds and memory types, half freed in between
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<uint32_t> sizeLog(4, 22);
+    std::uniform_int_distribution<uint32_t> alignmentLog(2, 16);
+    std::uniform_int_distribution<uint32_t> type(0, 2);
+    std::uniform_int_distribution<uint32_t> coin(0, 1);
+    std::vector<Live> allocations;
+    for(int round = 0; round < 4; round++){
+      for(int i = 0; i < 2000; i++){
+        VkDeviceSize size = (VkDeviceSize(1) << sizeLog(rng)) + rng() % 1000;
+        uint32_t memoryType = type(rng);
+        ResourceKind kind = coin(rng) ? ResourceKind::Linear : ResourceKind::Optimal;
+        VkMemoryRequirements req = requirements(size, VkDeviceSize(1) << alignmentLog(rng), 1u << memoryType);
+        Live live{allocator.allocate(req, properties.memoryTypes[memoryType].propertyFlags, kind), req, kind};
+        allocations.push_back(live);
+      }
+      checkPlacement(check, mock, allocations, granularity);
+      checkStats(check, allocator, mock, allocations);
+
+      std::shuffle(allocations.begin(), allocations.end(), rng);
+      for(size_t i = allocations.size() / 2; i < allocations.size(); i++){
+        allocator.free(allocations[i].allocation);
+      }
+      allocations.resize(allocations.size() / 2);
+      checkPlacement(check, mock, allocations, granularity);
+      checkStats(check, allocator, mock, allocations);
+    }
+
+    for(Live& live : allocations){
+      allocator.free(live.allocation);
+    }
+    allocations.clear();
+    checkStats(check, allocator, mock, allocations);
+    DeviceMemoryStats stats = allocator.statistics();
+    check.expect(stats.usedBytes == 0 && stats.requestedBytes == 0, "nothing in use after freeing everything");
+    // at most one empty block is kept per memory type and kind
+    check.expect(stats.blockCount <= properties.memoryTypeCount * 2, "empty blocks are released");
+    checkFillsOneBlock(check, allocator, mock);
+  }
+  check.expect(mock.live.empty(), "the destructor frees every block");
+
+  std::cout << (check.ok ? "  ok" : "  FAILED") << std::endl;
+  return check.ok;
+}
+
+int main(int argc, char** argv){
+  size_t count = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 100'000;
+
+  bool ok = true;
+  // a granularity below the smallest node lets both kinds share blocks
+  for(VkDeviceSize granularity : {VkDeviceSize(1), VkDeviceSize(1024), VkDeviceSize(65536)}){
+    ok = runChecks(granularity) && ok;
+  }
+
+  // allocate/free churn of texture and buffer sized requests
+  MockMemory mock;
+  DeviceMemoryAllocator allocator(fakeMemoryProperties(), 1024, mock.backend());
+  std::mt19937 rng(3);
+  std::uniform_int_distribution<uint32_t> sizeLog(8, 20);
+  std::vector<DeviceAllocation> allocations(count);
+  auto start = Clock::now();
+  for(DeviceAllocation& a : allocations){
+    a = allocator.allocate(requirements(VkDeviceSize(1) << sizeLog(rng), 256, 1u << 0), VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                           rng() % 2 ? ResourceKind::Linear : ResourceKind::Optimal);
+  }
+  double allocateMs = elapsedMs(start);
+  DeviceMemoryStats stats = allocator.statistics();
+  std::shuffle(allocations.begin(), allocations.end(), rng);
+  start = Clock::now();
+  for(DeviceAllocation& a : allocations){
+    allocator.free(a);
+  }
+  double freeMs = elapsedMs(start);
+
+  std::cout << count << " allocations in " << stats.blockCount << " blocks (" << stats.dedicatedCount << " dedicated), "
+            << 100.0 * stats.requestedBytes / std::max<VkDeviceSize>(stats.usedBytes, 1) << "% of used bytes requested"
+            << std::endl;
+  std::cout << "  allocate: " << allocateMs * 1e6 / count << " ns each" << std::endl;
+  std::cout << "  free:     " << freeMs * 1e6 / count << " ns each" << std::endl;
+
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,136 @@
+// Instance frustum culling without a GPU: a line by line CPU copy of
+// shaders/cull.comp checked against cullInstancesCpu(), the --verify-culling
+// reference, and against CpuCuller on the same grid of copies, over a camera
+// path that leaves part of the grid outside the frustum.
+//   gpu_culling_bench [object count] [frames]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "gpu_culling.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// the grid createInstances() builds: copies scaled to the footprint of one model
+static std::vector<InstanceData> makeInstances(uint32_t count){
+  uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+  float spacing = 2.0f / side;
+  std::vector<InstanceData> instances;
+  instances.reserve(count);
+  for(uint32_t i = 0; i < count; i++){
+    glm::vec3 offset((i % side + 0.5f) * spacing - 1.0f, (i / side + 0.5f) * spacing - 1.0f, 0.0f);
+    instances.push_back(InstanceData{glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(1.0f / side))});
+  }
+  return instances;
+}
+
+// main() of cull.comp for every invocation, appending in index order instead of atomic slot order
+static std::vector<uint32_t> cullShader(const Frustum& frustum, const BoundingSphere& sphere,
+                                        const std::vector<InstanceData>& instances){
+  std::vector<uint32_t> visible;
+  for(uint32_t index = 0; index < instances.size(); index++){
+    const glm::mat4& model = instances[index].model;
+    glm::vec3 center = glm::vec3(model * glm::vec4(sphere.center, 1.0f));
+    float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])),
+                                                                      glm::length(glm::vec3(model[2]))));
+    float radius = sphere.radius * scale;
+    bool outside = false;
+    for(int i = 0; i < 6 && !outside; i++){
+      outside = glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius;
+    }
+    if(!outside){
+      visible.push_back(index);
+    }
+  }
+  return visible;
+}
+
+int main(int argc, char** argv){
+  uint32_t count = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 10'000;
+  int frames = argc > 2 ? std::atoi(argv[2]) : 240;
+
+  std::vector<InstanceData> instances = makeInstances(count);
+  // roughly the viking room's bounds, off center like a real model
+  const BoundingSphere modelBounds{glm::vec3(0.05f, -0.1f, 0.25f), 0.9f};
+
+  ThreadPool pool;
+  CpuCuller scalar;
+  scalar.setUseAvx2(false);
+  CpuCuller threaded(&pool);
+  BoundingSpheresSoA spheres;
+  spheres.resize(instances.size());
+
+  std::vector<uint32_t> reference, scalarVisible, threadedVisible;
+  uint64_t tested = 0, drawn = 0;
+  int mismatches = 0;
+  double shaderMs = 0.0, referenceMs = 0.0, threadedMs = 0.0;
+  for(int frame = 0; frame < frames; frame++){
+    // the --deterministic camera and model spin, pulled in close so the grid's edges leave the frustum
+    float time = frame * (1.0f / 60.0f);
+    float angle = time * glm::radians(20.0f);
+    glm::vec3 eye(1.2f * std::cos(angle), 1.2f * std::sin(angle), 0.4f + 0.6f * std::sin(time * 0.3f));
+    glm::mat4 model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    glm::mat4 proj = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 10.0f);
+    proj[1][1] *= -1;
+
+    // what recordCommandBuffer() hands the GPU culler
+    Frustum frustum = extractFrustum(proj * view);
+    BoundingSphere sphere = transformSphere(model, modelBounds);
+
+    auto start = Clock::now();
+    std::vector<uint32_t> shaderVisible = cullShader(frustum, sphere, instances);
+    shaderMs += elapsedMs(start);
+
+    reference.clear();
+    start = Clock::now();
+    uint32_t referenceCount = cullInstancesCpu(frustum, sphere, instances, &reference);
+    referenceMs += elapsedMs(start);
+
+    start = Clock::now();
+    for(size_t i = 0; i < instances.size(); i++){
+      spheres.set(i, transformSphere(instances[i].model, sphere));
+    }
+    threaded.setCamera(proj * view);
+    threaded.cull(spheres, threadedVisible);
+    threadedMs += elapsedMs(start);
+    scalar.setCamera(proj * view);
+    scalar.cull(spheres, scalarVisible);
+
+    bool identical = referenceCount == shaderVisible.size() && reference == shaderVisible
+                     && scalarVisible == shaderVisible && threadedVisible == shaderVisible;
+    if(!identical){
+      if(mismatches == 0){
+        std::cout << "frame " << frame << ": shader " << shaderVisible.size() << ", reference " << referenceCount
+                  << ", scalar " << scalarVisible.size() << ", " << (threaded.usesAvx2() ? "AVX2 " : "scalar ")
+                  << threadedVisible.size() << " visible" << std::endl;
+      }
+      mismatches++;
+    }
+    tested += instances.size();
+    drawn += shaderVisible.size();
+  }
+
+  std::cout << count << " instances over " << frames << " frames, " << drawn / frames << " of " << count
+            << " visible per frame on average" << std::endl;
+  std::cout << "  shader copy:      " << shaderMs / frames << " ms per frame" << std::endl;
+  std::cout << "  cullInstancesCpu: " << referenceMs / frames << " ms per frame" << std::endl;
+  std::cout << "  CpuCuller:        " << threadedMs / frames << " ms per frame (" << (threaded.usesAvx2() ? "AVX2" : "scalar")
+            << ", " << pool.size() << " workers, including the sphere transforms)" << std::endl;
+  if(drawn == 0 || drawn == tested){
+    std::cout << "  the camera path culls " << (drawn == 0 ? "everything" : "nothing") << ", the comparison is trivial"
+              << std::endl;
+  }
+  if(mismatches > 0){
+    std::cerr << "culling results differ on " << mismatches << " of " << frames << " frames" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,67 @@
+// Startup cost of loadModel(): cold OBJ import vs. warm binary mesh cache.
+//   mesh_cache_bench [model.obj] [iterations]
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "obj_loader.h"
+#include "mesh_cache.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+  std::string modelPath = argc > 1 ? argv[1] : "../models/viking_room.obj";
+  int iterations = argc > 2 ? std::atoi(argv[2]) : 10;
+  const std::string cachePath = "mesh_cache_bench.meshcache";
+
+  // stands in for the mapped staging buffer the app copies into
+  std::vector<uint8_t> staging;
+
+  double coldTotal = 0.0;
+  for(int i = 0; i < iterations; i++){
+    auto start = Clock::now();
+    uint64_t sourceHash = hashFile(modelPath);
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+    loadObjModel(modelPath, vertices, indices);
+    std::vector<uint8_t> blob = MeshCache::build(sourceHash, static_cast<uint32_t>(VertexFormat::Float32), vertices, indices);
+    staging.resize(blob.size());
+    memcpy(staging.data(), vertices.data(), vertices.size() * sizeof(Vertex));
+    memcpy(staging.data(), indices.data(), indices.size() * sizeof(uint32_t));
+    coldTotal += elapsedMs(start);
+
+    if(i == 0 && !MeshCache::write(cachePath, blob)){
+      std::cerr << "failed to write " << cachePath << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  double warmTotal = 0.0;
+  for(int i = 0; i < iterations; i++){
+    auto start = Clock::now();
+    MeshCache cache;
+    if(!cache.open(cachePath, hashFile(modelPath), static_cast<uint32_t>(VertexFormat::Float32), sizeof(Vertex))){
+      std::cerr << "failed to map " << cachePath << std::endl;
+      return EXIT_FAILURE;
+    }
+    memcpy(staging.data(), cache.vertexData(), cache.vertexDataSize());
+    memcpy(staging.data(), cache.indexData(), cache.indexDataSize());
+    warmTotal += elapsedMs(start);
+  }
+
+  std::remove(cachePath.c_str());
+
+  double cold = coldTotal / iterations;
+  double warm = warmTotal / iterations;
+  std::cout << "cold OBJ import: " << cold << " ms" << std::endl;
+  std::cout << "warm mesh cache: " << warm << " ms" << std::endl;
+  std::cout << "speedup:         " << cold / warm << "x" << std::endl;
+  return EXIT_SUCCESS;
+}
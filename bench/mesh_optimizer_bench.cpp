@@ -0,0 +1,49 @@
+// Vertex cache efficiency of the post-load optimization stage, measured with the
+// FIFO cache simulator, plus the time the stage takes.
+//   mesh_optimizer_bench [model.obj] [cache size]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "obj_loader.h"
+#include "mesh_optimizer.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+int main(int argc, char** argv){
+  std::string modelPath = argc > 1 ? argv[1] : "../models/viking_room.obj";
+  uint32_t cacheSize = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : VERTEX_CACHE_SIZE;
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  loadObjModel(modelPath, vertices, indices);
+
+  VertexCacheStats raw = analyzeVertexCache(indices, vertices.size(), cacheSize);
+
+  auto start = Clock::now();
+  std::vector<uint32_t> clusterStarts;
+  std::vector<uint32_t> tipsified = optimizeVertexCache(indices, vertices.size(), &clusterStarts, cacheSize);
+  double tipsifyMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  VertexCacheStats cacheOptimized = analyzeVertexCache(tipsified, vertices.size(), cacheSize);
+
+  start = Clock::now();
+  std::vector<uint32_t> overdrawOrdered = optimizeOverdraw(tipsified, clusterStarts, &vertices[0].pos.x, sizeof(Vertex),
+                                                           vertices.size(), 1.05f, cacheSize);
+  double overdrawMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  VertexCacheStats overdrawOptimized = analyzeVertexCache(overdrawOrdered, vertices.size(), cacheSize);
+
+  auto print = [](const char* stage, const VertexCacheStats& stats){
+    std::cout << stage << "ACMR " << stats.acmr << "  ATVR " << stats.atvr << std::endl;
+  };
+
+  std::cout << modelPath << ": " << indices.size() / 3 << " triangles, " << vertices.size()
+            << " vertices, " << cacheSize << " entry FIFO" << std::endl;
+  print("  raw OBJ order:  ", raw);
+  print("  tipsify:        ", cacheOptimized);
+  print("  + overdraw:     ", overdrawOptimized);
+  std::cout << "  tipsify " << tipsifyMs << " ms, overdraw clustering " << overdrawMs << " ms ("
+            << clusterStarts.size() << " hard clusters)" << std::endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+// LOD chain of a UV sphere whose texture seam column and poles are split into
+// separate vertices, the way an OBJ with texture coordinates loads. Checks the
+// levels buildLodChain() appends and the levels selectLod() picks, and times
+// the build.
+//   mesh_simplifier_bench [rings] [segments]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include "mesh_simplifier.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// unit sphere around the origin, counter clockwise seen from outside. Column 0
+// and column segments share positions but not u, every vertex of the first
+// and last ring sits on a pole.
+static void makeSphere(uint32_t rings, uint32_t segments, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices){
+  for(uint32_t ring = 0; ring <= rings; ring++){
+    for(uint32_t segment = 0; segment <= segments; segment++){
+      float theta = static_cast<float>(M_PI) * ring / rings;
+      float phi = 2.0f * static_cast<float>(M_PI) * (segment % segments) / segments;
+      Vertex vertex{};
+      vertex.pos = glm::vec3(std::sin(theta) * std::cos(phi), std::sin(theta) * std::sin(phi), std::cos(theta));
+      vertex.color = glm::vec3(1.0f);
+      vertex.texCoord = glm::vec2(static_cast<float>(segment) / segments, static_cast<float>(ring) / rings);
+      vertices.push_back(vertex);
+    }
+  }
+  auto index = [&](uint32_t ring, uint32_t segment){ return ring * (segments + 1) + segment; };
+  for(uint32_t ring = 0; ring < rings; ring++){
+    for(uint32_t segment = 0; segment < segments; segment++){
+      uint32_t a = index(ring, segment), b = index(ring + 1, segment);
+      uint32_t c = index(ring + 1, segment + 1), d = index(ring, segment + 1);
+      if(ring != rings - 1){
+        indices.insert(indices.end(), {a, b, c});
+      }
+      if(ring != 0){
+        indices.insert(indices.end(), {a, c, d});
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv){
+  uint32_t rings = argc > 1 ? static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 10)) : 60;
+  uint32_t segments = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 80;
+
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+  makeSphere(std::max(rings, 3u), std::max(segments, 3u), vertices, indices);
+  auto position = [&](uint32_t index){ return vertices[index].pos; };
+
+  int failures = 0;
+  auto check = [&](bool ok, const char* what, uint32_t level){
+    if(!ok){
+      std::cerr << "level " << level << ": " << what << std::endl;
+      failures++;
+    }
+    return ok;
+  };
+
+  auto start = Clock::now();
+  std::vector<MeshLod> lods = buildLodChain(indices, vertices.size(), position);
+  double buildMs = elapsedMs(start);
+
+  std::cout << vertices.size() << " vertices, " << lods[0].indexCount / 3 << " triangles, " << lods.size()
+            << " levels built in " << buildMs << " ms" << std::endl;
+  check(lods.size() > 1, "the sphere has no simplified levels", 0);
+
+  for(uint32_t level = 0; level < lods.size(); level++){
+    const MeshLod& lod = lods[level];
+    std::cout << "  level " << level << ": " << lod.indexCount / 3 << " triangles, error " << lod.error << std::endl;
+    if(!check(lod.indexCount % 3 == 0 && lod.firstIndex + lod.indexCount <= indices.size(),
+              "range outside the index buffer", level)){
+      continue;
+    }
+    if(level > 0){
+      check(lod.indexCount <= lods[level - 1].indexCount * LOD_MIN_REDUCTION, "not reduced enough from its parent",
+            level);
+      check(lod.error >= lods[level - 1].error, "error decreases from its parent", level);
+    }
+
+    uint32_t outOfRange = 0, degenerate = 0, flipped = 0;
+    for(uint32_t i = lod.firstIndex; i < lod.firstIndex + lod.indexCount; i += 3){
+      if(indices[i] >= vertices.size() || indices[i + 1] >= vertices.size() || indices[i + 2] >= vertices.size()){
+        outOfRange++;
+        continue;
+      }
+      glm::vec3 p0 = position(indices[i]), p1 = position(indices[i + 1]), p2 = position(indices[i + 2]);
+      glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+      if(p0 == p1 || p1 == p2 || p2 == p0 || glm::length(normal) <= 1e-12f){
+        degenerate++;
+        continue;
+      }
+      // the source surface's normal under the triangle points away from the center
+      if(glm::dot(normal, p0 + p1 + p2) <= 0.0f){
+        flipped++;
+      }
+    }
+    check(outOfRange == 0, "indices at or past the vertex count", level);
+    check(degenerate == 0, "degenerate triangles", level);
+    check(flipped == 0, "triangles facing into the sphere", level);
+  }
+
+  // selectLod() just short of and just past the distance at which each level's
+  // error projects to maxPixels, for levels whose error stands apart from their
+  // neighbours'
+  const float scale = 2.0f, pixelsPerUnit = 724.0f, maxPixels = 1.0f;
+  uint32_t lodCount = static_cast<uint32_t>(lods.size());
+  auto expect = [&](float distance, uint32_t expected){
+    uint32_t selected = selectLod(lods.data(), lodCount, scale, distance, pixelsPerUnit, maxPixels);
+    if(selected != expected){
+      std::cerr << "selectLod at distance " << distance << " picked level " << selected << ", expected " << expected
+                << std::endl;
+      failures++;
+    }
+  };
+  expect(0.0f, 0);
+  for(uint32_t level = 1; level < lodCount; level++){
+    if(lods[level].error * 0.999f <= lods[level - 1].error){
+      continue;
+    }
+    float threshold = lods[level].error * scale * pixelsPerUnit / maxPixels;
+    expect(threshold * 0.999f, level - 1);
+    if(level + 1 == lodCount || lods[level + 1].error > lods[level].error * 1.001f){
+      expect(threshold * 1.001f, level);
+    }
+  }
+  expect(1e30f, lodCount - 1);
+
+  if(failures > 0){
+    std::cerr << failures << " checks failed" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Throughput of the CPU mip chain generator in source MPixels/s: the scalar
+// reference against the SIMD kernels, single threaded and on the pool.
+// Every run is also checked against the reference and against golden values,
+// the process fails if any level drifts.
+//   mip_generator_bench [width] [height] [iterations]
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "mip_generator.h"
+#include "thread_pool.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+static ImageRGBA8 makeTestImage(uint32_t width, uint32_t height){
+  ImageRGBA8 image;
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(static_cast<size_t>(width) * height * 4);
+  for(uint32_t y = 0; y < height; y++){
+    for(uint32_t x = 0; x < width; x++){
+      uint8_t* p = &image.pixels[(static_cast<size_t>(y) * width + x) * 4];
+      p[0] = static_cast<uint8_t>(x * 255 / std::max(width - 1, 1u));
+      p[1] = static_cast<uint8_t>(y * 255 / std::max(height - 1, 1u));
+      p[2] = ((x / 8 + y / 8) & 1) ? 230 : 20;
+      p[3] = static_cast<uint8_t>((x * 7 + y * 13) & 0xff);
+    }
+  }
+  return image;
+}
+
+static int maxDifference(const std::vector<ImageRGBA8>& a, const std::vector<ImageRGBA8>& b){
+  if(a.size() != b.size()){
+    return 256;
+  }
+  int worst = 0;
+  for(size_t level = 0; level < a.size(); level++){
+    if(a[level].width != b[level].width || a[level].height != b[level].height){
+      return 256;
+    }
+    for(size_t i = 0; i < a[level].pixels.size(); i++){
+      worst = std::max(worst, std::abs(a[level].pixels[i] - b[level].pixels[i]));
+    }
+  }
+  return worst;
+}
+
+// Golden values with a known answer: a flat image stays flat, and a black and
+// white checkerboard averages to 0.5 linear, which is 188 in sRGB (a naive
+// sRGB-space average would give 128).
+static bool checkGolden(){
+  bool ok = true;
+  ImageRGBA8 flat;
+  flat.width = 37;
+  flat.height = 11;
+  flat.pixels.assign(37 * 11 * 4, 0);
+  for(size_t i = 0; i < flat.pixels.size(); i += 4){
+    flat.pixels[i] = 200; flat.pixels[i + 1] = 100; flat.pixels[i + 2] = 50; flat.pixels[i + 3] = 255;
+  }
+
+  ImageRGBA8 checker;
+  checker.width = 64;
+  checker.height = 64;
+  checker.pixels.resize(64 * 64 * 4);
+  for(uint32_t i = 0; i < 64 * 64; i++){
+    uint8_t v = ((i % 64 + i / 64) & 1) ? 255 : 0;
+    checker.pixels[i * 4] = checker.pixels[i * 4 + 1] = checker.pixels[i * 4 + 2] = v;
+    checker.pixels[i * 4 + 3] = 255;
+  }
+
+  for(MipFilter filter : {MipFilter::Box, MipFilter::Kaiser}){
+    for(const ImageRGBA8& mip : generateMips(flat.pixels.data(), flat.width, flat.height, filter)){
+      for(size_t i = 0; i < mip.pixels.size(); i += 4){
+        ok &= std::abs(mip.pixels[i] - 200) <= 1 && std::abs(mip.pixels[i + 1] - 100) <= 1
+           && std::abs(mip.pixels[i + 2] - 50) <= 1 && mip.pixels[i + 3] == 255;
+      }
+    }
+  }
+
+  std::vector<ImageRGBA8> mips = generateMips(checker.pixels.data(), checker.width, checker.height, MipFilter::Box);
+  ok &= mips.size() == 6 && mips.back().width == 1 && mips.back().height == 1;
+  for(size_t i = 0; i < mips[0].pixels.size(); i += 4){
+    ok &= mips[0].pixels[i] == 188 && mips[0].pixels[i + 3] == 255;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv){
+  // odd, non-square default so the 3-tap box path and clamped edges are covered
+  uint32_t width = argc > 1 ? static_cast<uint32_t>(std::atoi(argv[1])) : 2047;
+  uint32_t height = argc > 2 ? static_cast<uint32_t>(std::atoi(argv[2])) : 1365;
+  int iterations = argc > 3 ? std::atoi(argv[3]) : 5;
+
+  ImageRGBA8 image = makeTestImage(width, height);
+  ThreadPool pool;
+  double megapixels = width * static_cast<double>(height) / 1e6;
+  bool ok = checkGolden();
+
+  std::cout << width << "x" << height << ", " << pool.size() << " threads, "
+            << (mipGeneratorUsesAvx2() ? "AVX2" : "SSE/NEON") << " vertical pass" << std::endl;
+  for(MipFilter filter : {MipFilter::Box, MipFilter::Kaiser}){
+    const char* name = filter == MipFilter::Box ? "box   " : "kaiser";
+
+    std::vector<ImageRGBA8> reference;
+    auto start = Clock::now();
+    for(int i = 0; i < iterations; i++){
+      reference = generateMipsReference(image.pixels.data(), width, height, filter);
+    }
+    double referenceMs = elapsedMs(start) / iterations;
+
+    std::vector<ImageRGBA8> simd;
+    start = Clock::now();
+    for(int i = 0; i < iterations; i++){
+      simd = generateMips(image.pixels.data(), width, height, filter);
+    }
+    double simdMs = elapsedMs(start) / iterations;
+
+    std::vector<ImageRGBA8> threaded;
+    start = Clock::now();
+    for(int i = 0; i < iterations; i++){
+      threaded = generateMips(image.pixels.data(), width, height, filter, &pool);
+    }
+    double threadedMs = elapsedMs(start) / iterations;
+
+    int simdDiff = maxDifference(reference, simd);
+    int threadedDiff = maxDifference(simd, threaded);
+    ok &= simdDiff <= 1 && threadedDiff == 0;
+
+    std::cout << name << " reference " << megapixels / referenceMs * 1000.0 << " MPixels/s, simd "
+              << megapixels / simdMs * 1000.0 << " MPixels/s, simd+threads " << megapixels / threadedMs * 1000.0
+              << " MPixels/s (max diff vs reference " << simdDiff << ")" << std::endl;
+  }
+
+  if(!ok){
+    std::cerr << "mip chain does not match the reference or golden values" << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,81 @@
+// Serial vs. parallel OBJ ingestion (vertex build + dedup) at 1/2/4/8/16 threads.
+//   obj_ingest_bench [model.obj] [synthetic triangle count]
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "obj_loader.h"
+#include "thread_pool.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// a tessellated grid written the way an OBJ exporter would, split into a few shapes
+static ObjData syntheticObj(size_t triangleCount){
+  size_t side = static_cast<size_t>(std::sqrt(static_cast<double>(triangleCount) / 2.0)) + 2;
+  ObjData obj;
+  for(size_t y = 0; y < side; y++){
+    for(size_t x = 0; x < side; x++){
+      obj.attrib.vertices.insert(obj.attrib.vertices.end(), {float(x), float(y), std::sin(float(x + y))});
+      obj.attrib.texcoords.insert(obj.attrib.texcoords.end(), {float(x) / side, float(y) / side});
+    }
+  }
+
+  const size_t shapeCount = 8;
+  obj.shapes.resize(shapeCount);
+  size_t triangles = 0;
+  for(size_t y = 0; y + 1 < side && triangles < triangleCount; y++){
+    auto& mesh = obj.shapes[y * shapeCount / side].mesh;
+    for(size_t x = 0; x + 1 < side && triangles < triangleCount; x++, triangles += 2){
+      int a = int(y * side + x), b = a + 1, c = a + int(side), d = c + 1;
+      for(int corner : {a, b, c, b, d, c}){
+        mesh.indices.push_back(tinyobj::index_t{corner, -1, corner});
+      }
+    }
+  }
+  return obj;
+}
+
+static bool run(const std::string& name, const ObjData& obj){
+  std::vector<Vertex> serialVertices;
+  std::vector<uint32_t> serialIndices;
+
+  auto start = Clock::now();
+  weldObj(obj, serialVertices, serialIndices);
+  double serialMs = elapsedMs(start);
+
+  std::cout << name << ": " << serialIndices.size() << " indices, " << serialVertices.size() << " unique vertices" << std::endl;
+  std::cout << "  serial:       " << serialMs << " ms" << std::endl;
+
+  bool ok = true;
+  for(size_t threads : {1, 2, 4, 8, 16}){
+    ThreadPool pool(threads);
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+
+    start = Clock::now();
+    weldObjParallel(obj, vertices, indices, pool);
+    double ms = elapsedMs(start);
+
+    bool identical = vertices == serialVertices && indices == serialIndices;
+    ok = ok && identical;
+    std::cout << "  " << threads << (threads == 1 ? " thread:    " : (threads < 10 ? " threads:   " : " threads:  ")) << ms << " ms ("
+              << serialMs / ms << "x)" << (identical ? "" : "  OUTPUT MISMATCH") << std::endl;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv){
+  std::string modelPath = argc > 1 ? argv[1] : "../models/viking_room.obj";
+  size_t syntheticTriangles = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 4'000'000;
+
+  bool ok = run(modelPath, parseObj(modelPath));
+  ok = run("synthetic grid", syntheticObj(syntheticTriangles)) && ok;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
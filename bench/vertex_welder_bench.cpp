@@ -0,0 +1,117 @@
+// Vertex deduplication: std::unordered_map<Vertex, uint32_t> vs. VertexWelder.
+//   vertex_welder_bench [model.obj] [synthetic index count]
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "obj_loader.h"
+#include "vertex_welder.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+// the loop loadModel() used before the welder
+static void dedupUnorderedMap(const std::vector<Vertex>& stream, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices){
+  std::unordered_map<Vertex, uint32_t> uniqueVertices{};
+  for(const Vertex& vertex : stream){
+    if( uniqueVertices.count(vertex) == 0) {
+      uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(vertex);
+    }
+    indices.push_back(uniqueVertices[vertex]);
+  }
+}
+
+static void dedupWelder(const std::vector<Vertex>& stream, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices){
+  VertexWelder welder(stream.size() / 3);
+  indices.reserve(stream.size());
+  for(const Vertex& vertex : stream){
+    indices.push_back(welder.weld(vertex));
+  }
+  vertices = welder.takeVertices();
+}
+
+static bool run(const std::string& name, const std::vector<Vertex>& stream){
+  std::vector<Vertex> mapVertices, welderVertices;
+  std::vector<uint32_t> mapIndices, welderIndices;
+
+  auto start = Clock::now();
+  dedupUnorderedMap(stream, mapVertices, mapIndices);
+  double mapMs = elapsedMs(start);
+
+  start = Clock::now();
+  dedupWelder(stream, welderVertices, welderIndices);
+  double welderMs = elapsedMs(start);
+
+  bool identical = mapVertices == welderVertices && mapIndices == welderIndices;
+
+  std::cout << name << ": " << stream.size() << " indices, " << welderVertices.size() << " unique vertices" << std::endl;
+  std::cout << "  unordered_map: " << mapMs << " ms" << std::endl;
+  std::cout << "  VertexWelder:  " << welderMs << " ms (" << mapMs / welderMs << "x)"
+            << (identical ? "" : "  OUTPUT MISMATCH") << std::endl;
+  return identical;
+}
+
+// a grid mesh referenced the way a scanned triangle soup would be: every grid
+// vertex is shared by ~6 triangles, visited in row order
+static std::vector<Vertex> syntheticStream(size_t indexCount){
+  size_t side = static_cast<size_t>(std::sqrt(static_cast<double>(indexCount) / 6.0)) + 2;
+  std::vector<Vertex> stream;
+  stream.reserve(indexCount);
+
+  auto gridVertex = [side](size_t x, size_t y){
+    Vertex vertex{};
+    vertex.pos = {static_cast<float>(x) / side, static_cast<float>(y) / side, 0.0f};
+    vertex.texCoord = {static_cast<float>(x) / side, static_cast<float>(y) / side};
+    vertex.color = {1.0f, 1.0f, 1.0f};
+    return vertex;
+  };
+
+  for(size_t y = 0; y + 1 < side && stream.size() < indexCount; y++){
+    for(size_t x = 0; x + 1 < side && stream.size() < indexCount; x++){
+      stream.push_back(gridVertex(x, y));
+      stream.push_back(gridVertex(x + 1, y));
+      stream.push_back(gridVertex(x, y + 1));
+      stream.push_back(gridVertex(x + 1, y));
+      stream.push_back(gridVertex(x + 1, y + 1));
+      stream.push_back(gridVertex(x, y + 1));
+    }
+  }
+  stream.resize(std::min(stream.size(), indexCount));
+  return stream;
+}
+
+int main(int argc, char** argv){
+  std::string modelPath = argc > 1 ? argv[1] : "../models/viking_room.obj";
+  size_t syntheticIndices = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10'000'000;
+
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  std::string warn;
+  if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, modelPath.c_str())){
+    std::cerr << err << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Vertex> modelStream;
+  for(const auto& shape : shapes){
+    for(const auto& index : shape.mesh.indices){
+      modelStream.push_back(makeObjVertex(attrib, index));
+    }
+  }
+
+  bool ok = run(modelPath, modelStream);
+  ok = run("synthetic grid", syntheticStream(syntheticIndices)) && ok;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
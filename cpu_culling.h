@@ -0,0 +1,470 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+#include "vertex.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CPU_CULLING_AVX2 1
+#include <immintrin.h>
+#endif
+
+struct BoundingSphere{
+  glm::vec3 center{0.0f, 0.0f, 0.0f};
+  float radius = 0.0f;
+};
+
+// planes as (normal, distance), a point p is inside when dot(normal, p) + distance >= 0 for all of them
+struct Frustum{
+  std::array<glm::vec4, 6> planes;
+};
+
+// centered on the bounding box, loose but cheap and stable across runs
+template<typename PositionFn>
+BoundingSphere computeBoundingSphere(size_t count, PositionFn position){
+  BoundingSphere sphere;
+  if(count == 0){
+    return sphere;
+  }
+  glm::vec3 minPos = position(0);
+  glm::vec3 maxPos = minPos;
+  for(size_t i = 1; i < count; i++){
+    glm::vec3 p = position(i);
+    minPos = glm::min(minPos, p);
+    maxPos = glm::max(maxPos, p);
+  }
+  sphere.center = (minPos + maxPos) * 0.5f;
+  float radiusSquared = 0.0f;
+  for(size_t i = 0; i < count; i++){
+    glm::vec3 offset = position(i) - sphere.center;
+    radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+  }
+  sphere.radius = std::sqrt(radiusSquared);
+  return sphere;
+}
+
+inline float maxAxisScale(const glm::mat4& transform){
+  return std::max(glm::length(glm::vec3(transform[0])),
+                  std::max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+}
+
+inline BoundingSphere transformSphere(const glm::mat4& transform, const BoundingSphere& sphere){
+  return BoundingSphere{glm::vec3(transform * glm::vec4(sphere.center, 1.0f)), sphere.radius * maxAxisScale(transform)};
+}
+
+// Gribb/Hartmann plane extraction for a 0..1 depth range projection
+inline Frustum extractFrustum(const glm::mat4& viewProj){
+  auto row = [&](int i){ return glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]); };
+  Frustum frustum;
+  frustum.planes[0] = row(3) + row(0);
+  frustum.planes[1] = row(3) - row(0);
+  frustum.planes[2] = row(3) + row(1);
+  frustum.planes[3] = row(3) - row(1);
+  frustum.planes[4] = row(2);
+  frustum.planes[5] = row(3) - row(2);
+  for(glm::vec4& plane : frustum.planes){
+    plane /= glm::length(glm::vec3(plane));
+  }
+  return frustum;
+}
+
+// same test as shaders/cull.comp
+inline bool sphereInFrustum(const Frustum& frustum, const BoundingSphere& sphere){
+  for(const glm::vec4& plane : frustum.planes){
+    if(glm::dot(glm::vec3(plane), sphere.center) + plane.w < -sphere.radius){
+      return false;
+    }
+  }
+  return true;
+}
+
+// tested and drawn are counted in whatever the culler works on, instances or indices
+struct CullingStats{
+  uint64_t frames = 0;
+  uint64_t tested = 0;
+  uint64_t drawn = 0;
+  // frames where the GPU count differed from the CPU reference
+  uint64_t referenceMismatches = 0;
+  uint64_t referenceFrames = 0;
+};
+
+// Bounds as structure of arrays, so eight objects load with one 256 bit load
+// per component. Boxes are stored as center and half extent.
+struct BoundingBoxesSoA{
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<float> extentX, extentY, extentZ;
+
+  size_t size() const { return centerX.size(); }
+
+  void resize(size_t count){
+    for(std::vector<float>* component : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ}){
+      component->resize(count);
+    }
+  }
+
+  void set(size_t i, const glm::vec3& min, const glm::vec3& max){
+    glm::vec3 center = (min + max) * 0.5f;
+    glm::vec3 extent = (max - min) * 0.5f;
+    centerX[i] = center.x;
+    centerY[i] = center.y;
+    centerZ[i] = center.z;
+    extentX[i] = extent.x;
+    extentY[i] = extent.y;
+    extentZ[i] = extent.z;
+  }
+};
+
+struct BoundingSpheresSoA{
+  std::vector<float> centerX, centerY, centerZ;
+  std::vector<float> radius;
+
+  size_t size() const { return centerX.size(); }
+
+  void resize(size_t count){
+    for(std::vector<float>* component : {&centerX, &centerY, &centerZ, &radius}){
+      component->resize(count);
+    }
+  }
+
+  void set(size_t i, const BoundingSphere& sphere){
+    centerX[i] = sphere.center.x;
+    centerY[i] = sphere.center.y;
+    centerZ[i] = sphere.center.z;
+    radius[i] = sphere.radius;
+  }
+};
+
+struct OccluderBox{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// Low resolution software depth buffer of large occluders, storing the
+// nearest 0..1 depth per pixel. Occluder triangles are rasterized at pixel
+// centers, so an object peeking through a sliver of an edge pixel can be
+// reported occluded; occluders should be solid interior geometry (walls,
+// terrain) rather than tight bounds of detailed meshes. Anything crossing
+// the near plane is skipped as an occluder and never reported occluded.
+// The farthest depth of every TILE_SIZE square is kept as well, so most of a
+// large occluded object is rejected a tile at a time.
+class OcclusionBuffer{
+public:
+  static constexpr uint32_t TILE_SIZE = 8;
+
+  OcclusionBuffer(uint32_t width = 256, uint32_t height = 128)
+    : width(width), height(height), tilesX((width + TILE_SIZE - 1) / TILE_SIZE), tilesY((height + TILE_SIZE - 1) / TILE_SIZE),
+      depth(width * height, 1.0f), tileMaxDepth(tilesX * tilesY, 1.0f) {}
+
+  void clear(){
+    std::fill(depth.begin(), depth.end(), 1.0f);
+    std::fill(tileMaxDepth.begin(), tileMaxDepth.end(), 1.0f);
+  }
+
+  // call once all occluders are rasterized, occluded() reads the tile depths
+  void finish(){
+    for(uint32_t tileY = 0; tileY < tilesY; tileY++){
+      for(uint32_t tileX = 0; tileX < tilesX; tileX++){
+        float farthest = 0.0f;
+        for(uint32_t y = tileY * TILE_SIZE; y < std::min(height, (tileY + 1) * TILE_SIZE); y++){
+          for(uint32_t x = tileX * TILE_SIZE; x < std::min(width, (tileX + 1) * TILE_SIZE); x++){
+            farthest = std::max(farthest, depth[static_cast<size_t>(y) * width + x]);
+          }
+        }
+        tileMaxDepth[tileY * tilesX + tileX] = farthest;
+      }
+    }
+  }
+
+  void rasterize(const OccluderBox& box, const glm::mat4& viewProj){
+    std::array<glm::vec3, 8> screen;
+    if(!project(box.min, box.max, viewProj, screen)){
+      return;
+    }
+    static const uint8_t triangles[12][3] = {
+      {0, 1, 3}, {0, 3, 2}, {4, 6, 7}, {4, 7, 5}, {0, 4, 5}, {0, 5, 1},
+      {2, 3, 7}, {2, 7, 6}, {0, 2, 6}, {0, 6, 4}, {1, 5, 7}, {1, 7, 3},
+    };
+    for(const auto& triangle : triangles){
+      rasterizeTriangle(screen[triangle[0]], screen[triangle[1]], screen[triangle[2]]);
+    }
+  }
+
+  // true when every pixel the box covers already holds a nearer occluder
+  bool occluded(const glm::vec3& min, const glm::vec3& max, const glm::mat4& viewProj) const {
+    std::array<glm::vec3, 8> screen;
+    if(!project(min, max, viewProj, screen)){
+      return false;
+    }
+    glm::vec3 lo = screen[0];
+    glm::vec3 hi = screen[0];
+    for(const glm::vec3& corner : screen){
+      lo = glm::min(lo, corner);
+      hi = glm::max(hi, corner);
+    }
+    int x0 = std::max(0, static_cast<int>(std::floor(lo.x)));
+    int y0 = std::max(0, static_cast<int>(std::floor(lo.y)));
+    int x1 = std::min(static_cast<int>(width), static_cast<int>(std::ceil(hi.x)));
+    int y1 = std::min(static_cast<int>(height), static_cast<int>(std::ceil(hi.y)));
+    if(x0 >= x1 || y0 >= y1){
+      // off screen, that is the frustum test's call
+      return false;
+    }
+    for(int tileY = y0 / TILE_SIZE; tileY <= (y1 - 1) / static_cast<int>(TILE_SIZE); tileY++){
+      for(int tileX = x0 / TILE_SIZE; tileX <= (x1 - 1) / static_cast<int>(TILE_SIZE); tileX++){
+        if(tileMaxDepth[tileY * tilesX + tileX] < lo.z){
+          continue;
+        }
+        int rowEnd = std::min(y1, (tileY + 1) * static_cast<int>(TILE_SIZE));
+        int columnEnd = std::min(x1, (tileX + 1) * static_cast<int>(TILE_SIZE));
+        for(int y = std::max(y0, tileY * static_cast<int>(TILE_SIZE)); y < rowEnd; y++){
+          const float* row = depth.data() + static_cast<size_t>(y) * width;
+          for(int x = std::max(x0, tileX * static_cast<int>(TILE_SIZE)); x < columnEnd; x++){
+            if(row[x] >= lo.z){
+              return false;
+            }
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+private:
+  uint32_t width;
+  uint32_t height;
+  uint32_t tilesX;
+  uint32_t tilesY;
+  std::vector<float> depth;
+  std::vector<float> tileMaxDepth;
+
+  // corners in pixels with 0..1 depth, false when any of them is in front of the near plane
+  bool project(const glm::vec3& min, const glm::vec3& max, const glm::mat4& viewProj, std::array<glm::vec3, 8>& screen) const {
+    for(int i = 0; i < 8; i++){
+      glm::vec4 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.0f);
+      glm::vec4 clip = viewProj * corner;
+      if(clip.w <= 1e-6f || clip.z < 0.0f){
+        return false;
+      }
+      screen[i] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * width, (clip.y / clip.w * 0.5f + 0.5f) * height, clip.z / clip.w);
+    }
+    return true;
+  }
+
+  // depth is affine in screen space after the perspective divide, so barycentric interpolation is exact
+  void rasterizeTriangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c){
+    float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+    if(std::fabs(area) < 1e-8f){
+      return;
+    }
+    int x0 = std::max(0, static_cast<int>(std::floor(std::min({a.x, b.x, c.x}))));
+    int y0 = std::max(0, static_cast<int>(std::floor(std::min({a.y, b.y, c.y}))));
+    int x1 = std::min(static_cast<int>(width) - 1, static_cast<int>(std::ceil(std::max({a.x, b.x, c.x}))));
+    int y1 = std::min(static_cast<int>(height) - 1, static_cast<int>(std::ceil(std::max({a.y, b.y, c.y}))));
+    float inverseArea = 1.0f / area;
+    for(int y = y0; y <= y1; y++){
+      float py = y + 0.5f;
+      for(int x = x0; x <= x1; x++){
+        float px = x + 0.5f;
+        float w0 = ((b.x - px) * (c.y - py) - (b.y - py) * (c.x - px)) * inverseArea;
+        float w1 = ((c.x - px) * (a.y - py) - (c.y - py) * (a.x - px)) * inverseArea;
+        float w2 = 1.0f - w0 - w1;
+        if(w0 < 0.0f || w1 < 0.0f || w2 < 0.0f){
+          continue;
+        }
+        float z = w0 * a.z + w1 * b.z + w2 * c.z;
+        float& stored = depth[static_cast<size_t>(y) * width + x];
+        stored = std::min(stored, z);
+      }
+    }
+  }
+};
+
+// Frustum (and optionally occlusion) culling of SoA bounds on the CPU, no GPU
+// involved. Eight objects are tested per step with AVX2 when the CPU has it,
+// with a scalar loop that evaluates the same expressions in the same order
+// otherwise, so both paths agree bit for bit. Large inputs are split into
+// CHUNK_SIZE ranges on the thread pool; visible indices come out ascending
+// whatever the split.
+class CpuCuller{
+public:
+  static constexpr size_t CHUNK_SIZE = 4096;
+
+  explicit CpuCuller(ThreadPool* pool = nullptr, uint32_t occlusionWidth = 256, uint32_t occlusionHeight = 128)
+    : pool(pool), occlusion(occlusionWidth, occlusionHeight) {
+    useAvx2 = avx2Supported();
+  }
+
+  static bool avx2Supported(){
+#ifdef CPU_CULLING_AVX2
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+  }
+
+  bool usesAvx2() const { return useAvx2; }
+
+  // forces the scalar path, to compare against the SIMD one
+  void setUseAvx2(bool enabled){
+    useAvx2 = enabled && avx2Supported();
+  }
+
+  // planes and the occlusion projection of the following cull calls
+  void setCamera(const glm::mat4& cameraViewProj){
+    viewProj = cameraViewProj;
+    frustum = extractFrustum(viewProj);
+  }
+
+  // Rasterizes the occluders for the current camera, an empty list turns
+  // occlusion off. Call after setCamera() whenever the camera moved.
+  void setOccluders(const std::vector<OccluderBox>& occluders){
+    occlusion.clear();
+    for(const OccluderBox& occluder : occluders){
+      occlusion.rasterize(occluder, viewProj);
+    }
+    occlusion.finish();
+    occlusionEnabled = !occluders.empty();
+  }
+
+  void cull(const BoundingSpheresSoA& spheres, std::vector<uint32_t>& visible){
+    runChunks(spheres.size(), visible, [&](size_t begin, size_t end, std::vector<uint32_t>& out){
+      frustumKernel<true>(spheres.centerX.data(), spheres.centerY.data(), spheres.centerZ.data(), spheres.radius.data(),
+                          nullptr, nullptr, begin, end, out);
+      if(occlusionEnabled){
+        removeOccluded(out, [&](uint32_t i){
+          glm::vec3 center(spheres.centerX[i], spheres.centerY[i], spheres.centerZ[i]);
+          glm::vec3 extent(spheres.radius[i]);
+          return occlusion.occluded(center - extent, center + extent, viewProj);
+        });
+      }
+    });
+  }
+
+  void cull(const BoundingBoxesSoA& boxes, std::vector<uint32_t>& visible){
+    runChunks(boxes.size(), visible, [&](size_t begin, size_t end, std::vector<uint32_t>& out){
+      frustumKernel<false>(boxes.centerX.data(), boxes.centerY.data(), boxes.centerZ.data(), boxes.extentX.data(),
+                           boxes.extentY.data(), boxes.extentZ.data(), begin, end, out);
+      if(occlusionEnabled){
+        removeOccluded(out, [&](uint32_t i){
+          glm::vec3 center(boxes.centerX[i], boxes.centerY[i], boxes.centerZ[i]);
+          glm::vec3 extent(boxes.extentX[i], boxes.extentY[i], boxes.extentZ[i]);
+          return occlusion.occluded(center - extent, center + extent, viewProj);
+        });
+      }
+    });
+  }
+
+private:
+  ThreadPool* pool;
+  bool useAvx2 = false;
+  glm::mat4 viewProj{1.0f};
+  Frustum frustum = extractFrustum(glm::mat4(1.0f));
+  OcclusionBuffer occlusion;
+  bool occlusionEnabled = false;
+  // per chunk output, kept between frames: once these have grown to the visible
+  // counts, culling does not allocate (parallelFor itself never does)
+  std::vector<std::vector<uint32_t>> chunkVisible;
+
+  template<typename Kernel>
+  void runChunks(size_t count, std::vector<uint32_t>& visible, const Kernel& kernel){
+    visible.clear();
+    size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    if(pool == nullptr || chunkCount <= 1){
+      kernel(0, count, visible);
+      return;
+    }
+    if(chunkVisible.size() < chunkCount){
+      chunkVisible.resize(chunkCount);
+    }
+    pool->parallelFor(count, CHUNK_SIZE, [&](size_t begin, size_t end){
+      std::vector<uint32_t>& out = chunkVisible[begin / CHUNK_SIZE];
+      out.clear();
+      kernel(begin, end, out);
+    });
+    for(size_t chunk = 0; chunk < chunkCount; chunk++){
+      visible.insert(visible.end(), chunkVisible[chunk].begin(), chunkVisible[chunk].end());
+    }
+  }
+
+  template<typename OccludedFn>
+  static void removeOccluded(std::vector<uint32_t>& indices, OccludedFn occluded){
+    indices.erase(std::remove_if(indices.begin(), indices.end(), occluded), indices.end());
+  }
+
+  // Spheres: extentX holds the radius. Boxes: the projected half extent
+  // |n.x| * e.x + |n.y| * e.y + |n.z| * e.z. An object is outside when
+  // distance + extent < 0 for any plane.
+  template<bool Spheres>
+  void frustumKernel(const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez,
+                     size_t begin, size_t end, std::vector<uint32_t>& out) const {
+#ifdef CPU_CULLING_AVX2
+    if(useAvx2){
+      begin = frustumKernelAvx2<Spheres>(cx, cy, cz, ex, ey, ez, begin, end, out);
+    }
+#endif
+    for(size_t i = begin; i < end; i++){
+      bool outside = false;
+      for(const glm::vec4& plane : frustum.planes){
+        float distance = plane.x * cx[i] + plane.y * cy[i] + plane.z * cz[i] + plane.w;
+        float extent = Spheres ? ex[i] : std::fabs(plane.x) * ex[i] + std::fabs(plane.y) * ey[i] + std::fabs(plane.z) * ez[i];
+        outside |= distance + extent < 0.0f;
+      }
+      if(!outside){
+        out.push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+
+#ifdef CPU_CULLING_AVX2
+  // handles whole groups of eight and returns where the scalar tail starts
+  template<bool Spheres>
+  __attribute__((target("avx2")))
+  size_t frustumKernelAvx2(const float* cx, const float* cy, const float* cz, const float* ex, const float* ey, const float* ez,
+                           size_t begin, size_t end, std::vector<uint32_t>& out) const {
+    __m256 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+    const __m256 signMask = _mm256_set1_ps(-0.0f);
+    for(int p = 0; p < 6; p++){
+      planeX[p] = _mm256_set1_ps(frustum.planes[p].x);
+      planeY[p] = _mm256_set1_ps(frustum.planes[p].y);
+      planeZ[p] = _mm256_set1_ps(frustum.planes[p].z);
+      planeW[p] = _mm256_set1_ps(frustum.planes[p].w);
+      absX[p] = _mm256_andnot_ps(signMask, planeX[p]);
+      absY[p] = _mm256_andnot_ps(signMask, planeY[p]);
+      absZ[p] = _mm256_andnot_ps(signMask, planeZ[p]);
+    }
+    const __m256 zero = _mm256_setzero_ps();
+
+    size_t i = begin;
+    for(; i + 8 <= end; i += 8){
+      __m256 x = _mm256_loadu_ps(cx + i);
+      __m256 y = _mm256_loadu_ps(cy + i);
+      __m256 z = _mm256_loadu_ps(cz + i);
+      __m256 extentX = _mm256_loadu_ps(ex + i);
+      __m256 extentY = Spheres ? zero : _mm256_loadu_ps(ey + i);
+      __m256 extentZ = Spheres ? zero : _mm256_loadu_ps(ez + i);
+      __m256 outside = zero;
+      for(int p = 0; p < 6; p++){
+        // no FMA, so rounding matches the scalar loop
+        __m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(planeX[p], x), _mm256_mul_ps(planeY[p], y)),
+                                                      _mm256_mul_ps(planeZ[p], z)), planeW[p]);
+        __m256 extent = Spheres ? extentX
+                                : _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(absX[p], extentX), _mm256_mul_ps(absY[p], extentY)),
+                                                _mm256_mul_ps(absZ[p], extentZ));
+        outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, extent), zero, _CMP_LT_OQ));
+      }
+      uint32_t visibleBits = ~static_cast<uint32_t>(_mm256_movemask_ps(outside)) & 0xffu;
+      while(visibleBits != 0){
+        out.push_back(static_cast<uint32_t>(i + __builtin_ctz(visibleBits)));
+        visibleBits &= visibleBits - 1;
+      }
+    }
+    return i;
+  }
+#endif
+};
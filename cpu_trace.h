@@ -0,0 +1,214 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct CpuTraceEvent{
+  const char* name;
+  uint64_t startNs;
+  uint64_t durationNs;
+};
+
+// Single producer ring owned by one thread. Pushing is a handful of relaxed
+// stores; a reader on another thread can take a snapshot at any time and drops
+// the entries the owner may have overwritten while it was copying.
+class CpuTraceRing{
+public:
+  CpuTraceRing(uint32_t threadId, std::string threadName, size_t capacity)
+    : threadId(threadId), threadName(std::move(threadName)), capacity(roundUpPow2(capacity)),
+      slots(new Slot[this->capacity]) {}
+
+  const uint32_t threadId;
+  const std::string threadName;
+
+  // name must outlive the tracer, string literals are the intended use
+  void push(const char* name, uint64_t startNs, uint64_t durationNs){
+    uint64_t index = head.load(std::memory_order_relaxed);
+    // pairs with the reader's acquire fence, a reader that sees these stores also sees head == index
+    std::atomic_thread_fence(std::memory_order_release);
+    Slot& slot = slots[index & (capacity - 1)];
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.startNs.store(startNs, std::memory_order_relaxed);
+    slot.durationNs.store(durationNs, std::memory_order_relaxed);
+    head.store(index + 1, std::memory_order_release);
+  }
+
+  // oldest first
+  std::vector<CpuTraceEvent> snapshot() const {
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t begin = end > capacity ? end - capacity : 0;
+
+    std::vector<CpuTraceEvent> events;
+    events.reserve(end - begin);
+    for(uint64_t i = begin; i < end; i++){
+      const Slot& slot = slots[i & (capacity - 1)];
+      events.push_back(CpuTraceEvent{slot.name.load(std::memory_order_relaxed), slot.startNs.load(std::memory_order_relaxed),
+                                     slot.durationNs.load(std::memory_order_relaxed)});
+    }
+
+    // the owner may be writing entry `after` right now, which reuses the slot of after - capacity
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t after = head.load(std::memory_order_relaxed);
+    uint64_t firstValid = after + 1 > capacity ? after + 1 - capacity : 0;
+    if(firstValid > begin){
+      events.erase(events.begin(), events.begin() + static_cast<ptrdiff_t>(std::min(firstValid - begin, end - begin)));
+    }
+    return events;
+  }
+
+private:
+  struct Slot{
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> startNs{0};
+    std::atomic<uint64_t> durationNs{0};
+  };
+
+  const uint64_t capacity;
+  std::unique_ptr<Slot[]> slots;
+  std::atomic<uint64_t> head{0};
+
+  static uint64_t roundUpPow2(size_t value){
+    uint64_t pow2 = 1;
+    while(pow2 < value){
+      pow2 <<= 1;
+    }
+    return pow2;
+  }
+};
+
+// Process wide CPU tracer. Disabled it costs one relaxed load per scope.
+// Each thread gets its own ring on first use, registration is the only
+// locked path. The trace is written as Chrome trace_event JSON, on exit or
+// when SIGUSR1 asks for a dump (the handler only sets a flag, the main loop
+// does the writing).
+class CpuTracer{
+public:
+  static constexpr size_t RING_CAPACITY = 1 << 15;
+
+  static CpuTracer& instance(){
+    static CpuTracer tracer;
+    return tracer;
+  }
+
+  void enable(){
+    epoch = std::chrono::steady_clock::now();
+    enabledFlag.store(true, std::memory_order_relaxed);
+  }
+
+  bool enabled() const { return enabledFlag.load(std::memory_order_relaxed); }
+
+  uint64_t nowNs() const {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - epoch).count());
+  }
+
+  // names the calling thread in the trace, call before its first scope
+  void nameThread(const std::string& name){
+    threadRing(name.c_str());
+  }
+
+  void record(const char* name, uint64_t startNs, uint64_t endNs){
+    threadRing().push(name, startNs, endNs - startNs);
+  }
+
+  void installDumpSignal(){
+#ifdef SIGUSR1
+    std::signal(SIGUSR1, [](int){ dumpRequested().store(true, std::memory_order_relaxed); });
+#endif
+  }
+
+  // true once per SIGUSR1
+  bool takeDumpRequest(){
+    return dumpRequested().exchange(false, std::memory_order_relaxed);
+  }
+
+  bool writeJson(const std::string& path){
+    std::vector<CpuTraceRing*> snapshotRings;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      for(const auto& ring : rings){
+        snapshotRings.push_back(ring.get());
+      }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    if(!file.is_open()){
+      return false;
+    }
+    // microsecond timestamps of a long session need more than the default 6 digits
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    for(CpuTraceRing* ring : snapshotRings){
+      file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << ring->threadId
+           << ",\"args\":{\"name\":\"" << ring->threadName << "\"}}";
+      first = false;
+      for(const CpuTraceEvent& event : ring->snapshot()){
+        file << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":0,\"tid\":" << ring->threadId
+             << ",\"ts\":" << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0 << "}";
+      }
+    }
+    file << "\n]}\n";
+    return file.good();
+  }
+
+private:
+  std::atomic<bool> enabledFlag{false};
+  std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+  std::mutex mutex;
+  std::vector<std::unique_ptr<CpuTraceRing>> rings;
+
+  CpuTracer() = default;
+
+  static std::atomic<bool>& dumpRequested(){
+    static_assert(std::atomic<bool>::is_always_lock_free, "the SIGUSR1 handler needs a lock-free flag");
+    static std::atomic<bool> requested{false};
+    return requested;
+  }
+
+  // rings stay owned by the tracer so events of finished threads can still be written
+  CpuTraceRing& threadRing(const char* name = nullptr){
+    thread_local CpuTraceRing* ring = nullptr;
+    if(ring == nullptr){
+      std::lock_guard<std::mutex> lock(mutex);
+      uint32_t threadId = static_cast<uint32_t>(rings.size()) + 1;
+      rings.push_back(std::make_unique<CpuTraceRing>(threadId, name ? std::string(name) : "thread " + std::to_string(threadId),
+                                                     RING_CAPACITY));
+      ring = rings.back().get();
+    }
+    return *ring;
+  }
+};
+
+// times the enclosing block when the tracer is enabled
+class CpuTraceScope{
+public:
+  explicit CpuTraceScope(const char* name) : name(CpuTracer::instance().enabled() ? name : nullptr) {
+    if(this->name != nullptr){
+      startNs = CpuTracer::instance().nowNs();
+    }
+  }
+
+  CpuTraceScope(const CpuTraceScope&) = delete;
+  CpuTraceScope& operator=(const CpuTraceScope&) = delete;
+
+  ~CpuTraceScope(){
+    if(name != nullptr){
+      CpuTracer& tracer = CpuTracer::instance();
+      tracer.record(name, startNs, tracer.nowNs());
+    }
+  }
+
+private:
+  const char* name;
+  uint64_t startNs = 0;
+};
@@ -0,0 +1,346 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+// The Vulkan entry points the allocator needs. Kept behind std::function so the
+// allocator can be driven by a fake memory-properties table without a device.
+struct DeviceMemoryBackend{
+  std::function<VkResult(const VkMemoryAllocateInfo&, VkDeviceMemory&)> allocate;
+  std::function<void(VkDeviceMemory)> free;
+  std::function<VkResult(VkDeviceMemory, void**)> map;
+
+  static DeviceMemoryBackend vulkan(VkDevice device){
+    DeviceMemoryBackend backend;
+    backend.allocate = [device](const VkMemoryAllocateInfo& allocInfo, VkDeviceMemory& memory){
+      return vkAllocateMemory(device, &allocInfo, nullptr, &memory);
+    };
+    backend.free = [device](VkDeviceMemory memory){
+      vkFreeMemory(device, memory, nullptr);
+    };
+    backend.map = [device](VkDeviceMemory memory, void** data){
+      return vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, data);
+    };
+    return backend;
+  }
+};
+
+// Buffers and linear images must not share a bufferImageGranularity page with
+// optimal images, so they are sub-allocated from separate blocks.
+enum class ResourceKind : uint32_t {
+  Linear = 0,
+  Optimal = 1,
+};
+
+struct BuddyBlock;
+
+struct DeviceAllocation{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+  VkDeviceSize size = 0;
+  // persistently mapped pointer to offset, null unless the memory is host visible
+  void* mapped = nullptr;
+  uint32_t memoryType = 0;
+
+  // owned by DeviceMemoryAllocator
+  BuddyBlock* block = nullptr;
+  uint32_t level = 0;
+};
+
+struct DeviceMemoryStats{
+  // vkAllocateMemory calls currently alive, bounded by maxMemoryAllocationCount
+  uint32_t deviceMemoryCount = 0;
+  uint32_t blockCount = 0;
+  uint32_t dedicatedCount = 0;
+  uint32_t allocationCount = 0;
+  VkDeviceSize blockBytes = 0;
+  VkDeviceSize dedicatedBytes = 0;
+  // bytes handed out from blocks, including power of two rounding
+  VkDeviceSize usedBytes = 0;
+  // bytes actually requested by resources
+  VkDeviceSize requestedBytes = 0;
+  VkDeviceSize heapUsage[VK_MAX_MEMORY_HEAPS] = {};
+};
+
+// One vkAllocateMemory block split with a binary buddy allocator. Nodes at level
+// L are blockSize >> L bytes and aligned to their own size, which also satisfies
+// any power of two alignment up to the node size.
+struct BuddyBlock{
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  uint8_t* mapped = nullptr;
+  VkDeviceSize size = 0;
+  uint32_t pool = 0;
+  VkDeviceSize usedBytes = 0;
+  std::vector<std::set<VkDeviceSize>> freeLists;
+
+  bool empty() const { return usedBytes == 0; }
+};
+
+class DeviceMemoryAllocator{
+public:
+  static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+  static constexpr VkDeviceSize MIN_NODE_SIZE = 256;
+
+  DeviceMemoryAllocator(const VkPhysicalDeviceMemoryProperties& memoryProperties, VkDeviceSize bufferImageGranularity,
+                        DeviceMemoryBackend memoryBackend, VkDeviceSize preferredBlockSize = DEFAULT_BLOCK_SIZE)
+    : properties(memoryProperties), granularity(bufferImageGranularity), backend(std::move(memoryBackend)),
+      pools(memoryProperties.memoryTypeCount * 2) {
+    for(uint32_t i = 0; i < properties.memoryTypeCount; i++){
+      // small heaps (e.g. 256MB BAR) get proportionally smaller blocks
+      VkDeviceSize heapSize = properties.memoryHeaps[properties.memoryTypes[i].heapIndex].size;
+      VkDeviceSize blockSize = preferredBlockSize;
+      while(blockSize > MIN_NODE_SIZE && blockSize > heapSize / 8){
+        blockSize /= 2;
+      }
+      pools[i * 2].blockSize = pools[i * 2 + 1].blockSize = blockSize;
+    }
+  }
+
+  DeviceMemoryAllocator(const DeviceMemoryAllocator&) = delete;
+  DeviceMemoryAllocator& operator=(const DeviceMemoryAllocator&) = delete;
+
+  ~DeviceMemoryAllocator(){
+    for(Pool& pool : pools){
+      for(auto& block : pool.blocks){
+        backend.free(block->memory);
+      }
+    }
+  }
+
+  const VkPhysicalDeviceMemoryProperties& memoryProperties() const { return properties; }
+
+  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags flags) const {
+    for(uint32_t i = 0; i < properties.memoryTypeCount; ++i){
+      if ((typeFilter & (1 << i)) && (properties.memoryTypes[i].propertyFlags & flags) == flags) {
+        return i;
+      }
+    }
+
+    throw std::runtime_error("Failed to find suitable memory type!");
+  }
+
+  // Sub-allocates from a block of the first matching memory type. Requests of at
+  // least a quarter block, or with dedicated set, get their own vkAllocateMemory.
+  DeviceAllocation allocate(const VkMemoryRequirements& requirements, VkMemoryPropertyFlags flags,
+                            ResourceKind kind, bool dedicated = false){
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, flags);
+    Pool& pool = pools[memoryType * 2 + static_cast<uint32_t>(kind)];
+
+    if(dedicated || requirements.size >= pool.blockSize / 4){
+      return allocateDedicated(requirements.size, memoryType);
+    }
+
+    VkDeviceSize nodeSize = std::max({roundUpPow2(requirements.size), roundUpPow2(requirements.alignment), MIN_NODE_SIZE});
+    // without a granularity conflict both kinds may share one pool
+    Pool& target = granularity <= MIN_NODE_SIZE ? pools[memoryType * 2] : pool;
+
+    DeviceAllocation allocation{};
+    for(auto& block : target.blocks){
+      if(allocateFromBlock(*block, nodeSize, allocation)){
+        break;
+      }
+    }
+    if(allocation.block == nullptr){
+      BuddyBlock& block = createBlock(target, static_cast<uint32_t>(&target - pools.data()), memoryType);
+      if(!allocateFromBlock(block, nodeSize, allocation)){
+        throw std::runtime_error("failed to sub-allocate device memory!");
+      }
+    }
+
+    allocation.size = requirements.size;
+    allocation.memoryType = memoryType;
+    stats.allocationCount++;
+    stats.usedBytes += nodeSize;
+    stats.requestedBytes += requirements.size;
+    stats.heapUsage[properties.memoryTypes[memoryType].heapIndex] += nodeSize;
+    return allocation;
+  }
+
+  void free(DeviceAllocation& allocation){
+    if(allocation.memory == VK_NULL_HANDLE){
+      return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t heap = properties.memoryTypes[allocation.memoryType].heapIndex;
+
+    if(allocation.block == nullptr){
+      backend.free(allocation.memory);
+      stats.deviceMemoryCount--;
+      stats.dedicatedCount--;
+      stats.dedicatedBytes -= allocation.size;
+      stats.heapUsage[heap] -= allocation.size;
+    } else {
+      BuddyBlock& block = *allocation.block;
+      VkDeviceSize nodeSize = block.size >> allocation.level;
+      freeToBlock(block, allocation.offset, allocation.level);
+      stats.allocationCount--;
+      stats.usedBytes -= nodeSize;
+      stats.requestedBytes -= allocation.size;
+      stats.heapUsage[heap] -= nodeSize;
+      releaseIfUnused(block);
+    }
+
+    allocation = DeviceAllocation{};
+  }
+
+  DeviceMemoryStats statistics() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+  }
+
+private:
+  struct Pool{
+    VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE;
+    std::vector<std::unique_ptr<BuddyBlock>> blocks;
+  };
+
+  VkPhysicalDeviceMemoryProperties properties;
+  VkDeviceSize granularity;
+  DeviceMemoryBackend backend;
+  std::vector<Pool> pools;
+  DeviceMemoryStats stats{};
+  mutable std::mutex mutex;
+
+  static VkDeviceSize roundUpPow2(VkDeviceSize value){
+    VkDeviceSize result = 1;
+    while(result < value){
+      result <<= 1;
+    }
+    return result;
+  }
+
+  bool isHostVisible(uint32_t memoryType) const {
+    return properties.memoryTypes[memoryType].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+  }
+
+  VkDeviceMemory allocateMemory(VkDeviceSize size, uint32_t memoryType, void** mapped){
+    VkMemoryAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryType;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if(backend.allocate(allocInfo, memory) != VK_SUCCESS){
+      throw std::runtime_error("failed to allocate device memory!");
+    }
+
+    *mapped = nullptr;
+    if(isHostVisible(memoryType) && backend.map(memory, mapped) != VK_SUCCESS){
+      backend.free(memory);
+      throw std::runtime_error("failed to map device memory!");
+    }
+
+    stats.deviceMemoryCount++;
+    return memory;
+  }
+
+  DeviceAllocation allocateDedicated(VkDeviceSize size, uint32_t memoryType){
+    DeviceAllocation allocation{};
+    allocation.memory = allocateMemory(size, memoryType, &allocation.mapped);
+    allocation.size = size;
+    allocation.memoryType = memoryType;
+
+    stats.dedicatedCount++;
+    stats.dedicatedBytes += size;
+    stats.heapUsage[properties.memoryTypes[memoryType].heapIndex] += size;
+    return allocation;
+  }
+
+  BuddyBlock& createBlock(Pool& pool, uint32_t poolIndex, uint32_t memoryType){
+    auto block = std::make_unique<BuddyBlock>();
+    void* mapped = nullptr;
+    block->memory = allocateMemory(pool.blockSize, memoryType, &mapped);
+    block->mapped = static_cast<uint8_t*>(mapped);
+    block->size = pool.blockSize;
+    block->pool = poolIndex;
+
+    uint32_t levels = 1;
+    while((pool.blockSize >> (levels - 1)) > MIN_NODE_SIZE){
+      levels++;
+    }
+    block->freeLists.resize(levels);
+    block->freeLists[0].insert(0);
+
+    stats.blockCount++;
+    stats.blockBytes += pool.blockSize;
+    pool.blocks.push_back(std::move(block));
+    return *pool.blocks.back();
+  }
+
+  bool allocateFromBlock(BuddyBlock& block, VkDeviceSize nodeSize, DeviceAllocation& allocation){
+    if(nodeSize > block.size){
+      return false;
+    }
+
+    uint32_t level = 0;
+    while((block.size >> level) > nodeSize){
+      level++;
+    }
+
+    // smallest free node that fits, then split it down to the requested level
+    int64_t source = level;
+    while(source >= 0 && block.freeLists[source].empty()){
+      source--;
+    }
+    if(source < 0){
+      return false;
+    }
+
+    VkDeviceSize offset = *block.freeLists[source].begin();
+    block.freeLists[source].erase(block.freeLists[source].begin());
+    for(uint32_t l = static_cast<uint32_t>(source) + 1; l <= level; l++){
+      block.freeLists[l].insert(offset + (block.size >> l));
+    }
+
+    block.usedBytes += nodeSize;
+    allocation.memory = block.memory;
+    allocation.offset = offset;
+    allocation.mapped = block.mapped != nullptr ? block.mapped + offset : nullptr;
+    allocation.block = &block;
+    allocation.level = level;
+    return true;
+  }
+
+  void freeToBlock(BuddyBlock& block, VkDeviceSize offset, uint32_t level){
+    block.usedBytes -= block.size >> level;
+    while(level > 0){
+      VkDeviceSize buddy = offset ^ (block.size >> level);
+      if(block.freeLists[level].erase(buddy) == 0){
+        break;
+      }
+      offset = std::min(offset, buddy);
+      level--;
+    }
+    block.freeLists[level].insert(offset);
+  }
+
+  // keeps one empty block per pool around to avoid allocation churn
+  void releaseIfUnused(BuddyBlock& block){
+    if(!block.empty()){
+      return;
+    }
+    Pool& pool = pools[block.pool];
+    size_t emptyBlocks = std::count_if(pool.blocks.begin(), pool.blocks.end(), [](const auto& b){ return b->empty(); });
+    if(emptyBlocks < 2){
+      return;
+    }
+
+    auto it = std::find_if(pool.blocks.begin(), pool.blocks.end(), [&block](const auto& b){ return b.get() == &block; });
+    backend.free(block.memory);
+    stats.deviceMemoryCount--;
+    stats.blockCount--;
+    stats.blockBytes -= block.size;
+    pool.blocks.erase(it);
+  }
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// averages over one pacing window
+struct FramePacingStats{
+  double cpuMeanMs = 0.0;
+  double cpuP95Ms = 0.0;
+  double gpuMeanMs = 0.0;
+  uint32_t frames = 0;
+};
+
+// Chooses how many frames the CPU may record ahead of the GPU from measured
+// per-frame CPU time (recording and submit, without the waits) and GPU time
+// (timestamps around the command buffer).
+//  - when one side is nearly free, running them back to back costs less than
+//    the serial threshold and a single frame in flight gives the lowest latency
+//  - when the GPU is the bottleneck two frames keep it busy; a deeper queue only
+//    adds latency unless CPU spikes are longer than the queued GPU work
+//  - when the CPU is the bottleneck the GPU idles either way, so two frames
+// A new count is only returned after two windows in a row agree on it.
+class FramePacer{
+public:
+  FramePacer(uint32_t minFrames, uint32_t maxFrames, uint32_t windowSize = 120, double serialThreshold = 0.1)
+    : minFrames(minFrames), maxFrames(maxFrames), windowSize(windowSize), serialThreshold(serialThreshold) {
+    cpuSamples.reserve(windowSize);
+    gpuSamples.reserve(windowSize);
+  }
+
+  // returns the frame count the following frames should use
+  uint32_t addSample(uint32_t currentFrames, double cpuMs, double gpuMs){
+    cpuSamples.push_back(cpuMs);
+    gpuSamples.push_back(gpuMs);
+    if(cpuSamples.size() < windowSize){
+      return currentFrames;
+    }
+
+    stats = summarize();
+    cpuSamples.clear();
+    gpuSamples.clear();
+
+    uint32_t target = targetFrames(stats);
+    if(target == currentFrames){
+      pendingTarget = 0;
+      return currentFrames;
+    }
+    if(target != pendingTarget){
+      pendingTarget = target;
+      return currentFrames;
+    }
+    pendingTarget = 0;
+    return target;
+  }
+
+  // stats of the last completed window
+  const FramePacingStats& lastWindow() const { return stats; }
+
+  uint32_t targetFrames(const FramePacingStats& window) const {
+    double slower = std::max(window.cpuMeanMs, window.gpuMeanMs);
+    double faster = std::min(window.cpuMeanMs, window.gpuMeanMs);
+    if(slower <= 0.0){
+      return clampFrames(2);
+    }
+    if(faster < slower * serialThreshold){
+      return clampFrames(1);
+    }
+    if(window.cpuMeanMs >= window.gpuMeanMs){
+      return clampFrames(2);
+    }
+
+    // a CPU spike stalls the GPU once it outlasts the frames already queued
+    uint32_t queued = static_cast<uint32_t>(std::ceil(window.cpuP95Ms / window.gpuMeanMs));
+    return clampFrames(std::max(2u, 1 + queued));
+  }
+
+private:
+  uint32_t minFrames;
+  uint32_t maxFrames;
+  uint32_t windowSize;
+  double serialThreshold;
+
+  std::vector<double> cpuSamples;
+  std::vector<double> gpuSamples;
+  FramePacingStats stats;
+  uint32_t pendingTarget = 0;
+
+  uint32_t clampFrames(uint32_t frames) const {
+    return std::clamp(frames, minFrames, maxFrames);
+  }
+
+  FramePacingStats summarize(){
+    FramePacingStats window;
+    window.frames = static_cast<uint32_t>(cpuSamples.size());
+    for(size_t i = 0; i < cpuSamples.size(); i++){
+      window.cpuMeanMs += cpuSamples[i];
+      window.gpuMeanMs += gpuSamples[i];
+    }
+    window.cpuMeanMs /= window.frames;
+    window.gpuMeanMs /= window.frames;
+
+    size_t p95 = std::min(cpuSamples.size() - 1, cpuSamples.size() * 95 / 100);
+    std::nth_element(cpuSamples.begin(), cpuSamples.begin() + p95, cpuSamples.end());
+    window.cpuP95Ms = cpuSamples[p95];
+    return window;
+  }
+};
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// counted by the replaced operator new of the vk_bench build, stays 0 otherwise
+inline std::atomic<uint64_t>& heapAllocationCounter(){
+  static std::atomic<uint64_t> counter{0};
+  return counter;
+}
+
+struct FrameSample{
+  double frameMs;
+  double cpuMs;
+  double gpuMs;
+  uint64_t allocations;
+};
+
+struct FrameStatsSummary{
+  uint32_t frames = 0;
+  double frameP50Ms = 0.0;
+  double frameP95Ms = 0.0;
+  double frameP99Ms = 0.0;
+  double frameMaxMs = 0.0;
+  double cpuMeanMs = 0.0;
+  double gpuMeanMs = 0.0;
+  double allocationsPerFrame = 0.0;
+};
+
+// Per-frame samples of a bounded run. Storage is reserved up front so
+// recording does not show up in the allocation counts it measures.
+class FrameStatsRecorder{
+public:
+  void reserve(size_t frames){
+    samples.reserve(frames);
+  }
+
+  void add(const FrameSample& sample){
+    samples.push_back(sample);
+  }
+
+  size_t size() const { return samples.size(); }
+
+  FrameStatsSummary summarize() const {
+    FrameStatsSummary s;
+    s.frames = static_cast<uint32_t>(samples.size());
+    if(samples.empty()){
+      return s;
+    }
+
+    std::vector<double> frameMs;
+    frameMs.reserve(samples.size());
+    uint64_t allocations = 0;
+    for(const FrameSample& sample : samples){
+      frameMs.push_back(sample.frameMs);
+      s.cpuMeanMs += sample.cpuMs;
+      s.gpuMeanMs += sample.gpuMs;
+      allocations += sample.allocations;
+    }
+    std::sort(frameMs.begin(), frameMs.end());
+    s.frameP50Ms = percentile(frameMs, 50);
+    s.frameP95Ms = percentile(frameMs, 95);
+    s.frameP99Ms = percentile(frameMs, 99);
+    s.frameMaxMs = frameMs.back();
+    s.cpuMeanMs /= samples.size();
+    s.gpuMeanMs /= samples.size();
+    s.allocationsPerFrame = static_cast<double>(allocations) / samples.size();
+    return s;
+  }
+
+private:
+  std::vector<FrameSample> samples;
+
+  static double percentile(const std::vector<double>& sorted, size_t p){
+    return sorted[std::min(sorted.size() - 1, sorted.size() * p / 100)];
+  }
+};
+
+// the metrics a baseline stores, all of them lower is better
+inline std::vector<std::pair<std::string, double>> baselineMetrics(const FrameStatsSummary& s){
+  return {
+    {"frame_p50_ms", s.frameP50Ms},
+    {"frame_p95_ms", s.frameP95Ms},
+    {"frame_p99_ms", s.frameP99Ms},
+    {"cpu_mean_ms", s.cpuMeanMs},
+    {"gpu_mean_ms", s.gpuMeanMs},
+    {"allocations_per_frame", s.allocationsPerFrame},
+  };
+}
+
+// one "name value" pair per line, '#' starts a comment
+inline std::string formatBaseline(const FrameStatsSummary& s, const std::string& comment){
+  std::ostringstream out;
+  out << "# " << comment << "\n";
+  for(const auto& [name, value] : baselineMetrics(s)){
+    out << name << ' ' << value << "\n";
+  }
+  return out.str();
+}
+
+inline std::vector<std::pair<std::string, double>> parseBaseline(const std::string& text){
+  std::vector<std::pair<std::string, double>> baseline;
+  std::istringstream in(text);
+  std::string line;
+  while(std::getline(in, line)){
+    std::istringstream fields(line);
+    std::string name;
+    double value;
+    if(fields >> name && name[0] != '#' && fields >> value){
+      baseline.emplace_back(name, value);
+    }
+  }
+  return baseline;
+}
+
+// A metric regresses when it exceeds its baseline by more than tolerance
+// (relative). Metrics missing from either side are not compared; a baseline
+// of 0 allocations per frame fails on any allocation.
+inline std::vector<std::string> checkBaseline(const FrameStatsSummary& s,
+                                              const std::vector<std::pair<std::string, double>>& baseline,
+                                              double tolerance){
+  std::vector<std::string> regressions;
+  for(const auto& [name, value] : baselineMetrics(s)){
+    for(const auto& [baseName, baseValue] : baseline){
+      if(baseName == name && value > baseValue * (1.0 + tolerance)){
+        std::ostringstream message;
+        message << name << " " << value << " > baseline " << baseValue << " (+" << tolerance * 100.0 << "%)";
+        regressions.push_back(message.str());
+      }
+    }
+  }
+  return regressions;
+}
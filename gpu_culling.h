@@ -0,0 +1,523 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cpu_culling.h"
+#include "device_allocator.h"
+#include "pipeline_compiler.h"
+#include "vertex.h"
+
+// CPU reference of the GPU pass: the number of instances whose sphere survives, visible gets their indices
+inline uint32_t cullInstancesCpu(const Frustum& frustum, const BoundingSphere& sphere, const std::vector<InstanceData>& instances,
+                                 std::vector<uint32_t>* visible = nullptr){
+  uint32_t count = 0;
+  for(size_t i = 0; i < instances.size(); i++){
+    if(sphereInFrustum(frustum, transformSphere(instances[i].model, sphere))){
+      count++;
+      if(visible){
+        visible->push_back(static_cast<uint32_t>(i));
+      }
+    }
+  }
+  return count;
+}
+
+// matches the DrawParameters block of cull.comp and meshlet_cull.comp
+struct DrawParameters{
+  VkDrawIndexedIndirectCommand command;
+  // 1 once anything is visible
+  uint32_t drawCount;
+};
+
+inline void createCullingBuffer(VkDevice device, DeviceMemoryAllocator& allocator, VkDeviceSize size, VkBufferUsageFlags usage,
+                                VkMemoryPropertyFlags properties, VkBuffer& buffer, DeviceAllocation& memory){
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if(vkCreateBuffer(device, &bufferInfo, nullptr, &buffer) != VK_SUCCESS){
+    throw std::runtime_error("failed to create culling buffer!");
+  }
+
+  VkMemoryRequirements memRequirements;
+  vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
+  memory = allocator.allocate(memRequirements, properties, ResourceKind::Linear);
+  vkBindBufferMemory(device, buffer, memory.memory, memory.offset);
+}
+
+// A compute pipeline whose inputs are bindingCount storage buffers in set 0
+// and constantsSize bytes of push constants, with a descriptor pool for
+// setCount sets. Shared by the culling passes.
+class StorageComputePipeline{
+public:
+  StorageComputePipeline(VkDevice device, VkPipelineCache cache, const std::string& shaderPath, uint32_t bindingCount,
+                         uint32_t constantsSize, uint32_t setCount)
+    : device(device), bindingCount(bindingCount), constantsSize(constantsSize) {
+    std::vector<VkDescriptorSetLayoutBinding> bindings(bindingCount);
+    for(uint32_t i = 0; i < bindingCount; i++){
+      bindings[i].binding = i;
+      bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      bindings[i].descriptorCount = 1;
+      bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = bindings.data();
+    if(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &descriptorSetLayout) != VK_SUCCESS){
+      throw std::runtime_error("failed to create culling descriptor set layout!");
+    }
+
+    VkPushConstantRange constantRange{};
+    constantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+    constantRange.offset = 0;
+    constantRange.size = constantsSize;
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &descriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pPushConstantRanges = &constantRange;
+    if(vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) != VK_SUCCESS){
+      throw std::runtime_error("failed to create culling pipeline layout!");
+    }
+
+    VkShaderModule shaderModule = createShaderModule(device, readShaderFile(shaderPath));
+
+    VkComputePipelineCreateInfo pipelineInfo{};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = shaderModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.layout = pipelineLayout;
+    VkResult result = vkCreateComputePipelines(device, cache, 1, &pipelineInfo, nullptr, &pipeline);
+    vkDestroyShaderModule(device, shaderModule, nullptr);
+    if(result != VK_SUCCESS){
+      throw std::runtime_error("failed to create culling pipeline!");
+    }
+
+    VkDescriptorPoolSize poolSize{};
+    poolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSize.descriptorCount = setCount * bindingCount;
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = 1;
+    poolInfo.pPoolSizes = &poolSize;
+    poolInfo.maxSets = setCount;
+    if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS){
+      throw std::runtime_error("failed to create culling descriptor pool!");
+    }
+  }
+
+  StorageComputePipeline(const StorageComputePipeline&) = delete;
+  StorageComputePipeline& operator=(const StorageComputePipeline&) = delete;
+
+  ~StorageComputePipeline(){
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
+  }
+
+  // whole buffers, buffers[i] at binding i
+  VkDescriptorSet allocateSet(const std::vector<VkBuffer>& buffers){
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &descriptorSetLayout;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+    if(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet) != VK_SUCCESS){
+      throw std::runtime_error("failed to allocate culling descriptor set!");
+    }
+
+    std::vector<VkDescriptorBufferInfo> bufferInfos(bindingCount);
+    std::vector<VkWriteDescriptorSet> writes(bindingCount);
+    for(uint32_t i = 0; i < bindingCount; i++){
+      bufferInfos[i] = {buffers[i], 0, VK_WHOLE_SIZE};
+      writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      writes[i].dstSet = descriptorSet;
+      writes[i].dstBinding = i;
+      writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      writes[i].descriptorCount = 1;
+      writes[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(device, bindingCount, writes.data(), 0, nullptr);
+    return descriptorSet;
+  }
+
+  void bind(VkCommandBuffer commandBuffer, VkDescriptorSet descriptorSet, const void* constants) const {
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+    vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, constantsSize, constants);
+  }
+
+private:
+  VkDevice device;
+  uint32_t bindingCount;
+  uint32_t constantsSize;
+  VkDescriptorSetLayout descriptorSetLayout = VK_NULL_HANDLE;
+  VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
+};
+
+// overwrites a slot's command before the culling dispatch, outside of a render pass
+inline void recordDrawParametersReset(VkCommandBuffer commandBuffer, VkBuffer drawBuffer, const DrawParameters& reset){
+  vkCmdUpdateBuffer(commandBuffer, drawBuffer, 0, sizeof(reset), &reset);
+
+  VkMemoryBarrier resetBarrier{};
+  resetBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  resetBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  resetBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+                       1, &resetBarrier, 0, nullptr, 0, nullptr);
+}
+
+// The command of a slot, drawn with vkCmdDrawIndexedIndirectCount when the
+// extension is enabled, so a frame with nothing visible issues no draw at
+// all, and with a plain indirect draw of one command otherwise.
+inline void drawCulledIndirect(VkCommandBuffer commandBuffer, VkBuffer drawBuffer,
+                               PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount){
+  if(drawIndexedIndirectCount){
+    drawIndexedIndirectCount(commandBuffer, drawBuffer, offsetof(DrawParameters, command), drawBuffer,
+                             offsetof(DrawParameters, drawCount), 1, sizeof(VkDrawIndexedIndirectCommand));
+  } else {
+    vkCmdDrawIndexedIndirect(commandBuffer, drawBuffer, offsetof(DrawParameters, command), 1,
+                             sizeof(VkDrawIndexedIndirectCommand));
+  }
+}
+
+// Copies one counter of each slot's command to host memory and turns it into
+// CullingStats when the slot comes around again, after its fence.
+class CullingReadback{
+public:
+  CullingReadback(VkDevice device, DeviceMemoryAllocator& allocator, uint32_t frameCount)
+    : device(device), allocator(allocator), slots(frameCount) {
+    createCullingBuffer(device, allocator, frameCount * sizeof(uint32_t), VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, memory);
+  }
+
+  CullingReadback(const CullingReadback&) = delete;
+  CullingReadback& operator=(const CullingReadback&) = delete;
+
+  ~CullingReadback(){
+    vkDestroyBuffer(device, buffer, nullptr);
+    allocator.free(memory);
+  }
+
+  // After the dispatch that wrote drawBuffer: makes the shader writes
+  // visible to consumerAccess at consumerStages and to the copy of the
+  // counter at counterOffset. reference is the CPU count for the same
+  // inputs, compared when the slot is collected.
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, VkBuffer drawBuffer, VkDeviceSize counterOffset,
+              VkAccessFlags consumerAccess, VkPipelineStageFlags consumerStages, uint64_t tested,
+              std::optional<uint32_t> reference){
+    VkMemoryBarrier cullBarrier{};
+    cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT | consumerAccess;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT | consumerStages,
+                         0, 1, &cullBarrier, 0, nullptr, 0, nullptr);
+
+    VkBufferCopy copy{};
+    copy.srcOffset = counterOffset;
+    copy.dstOffset = frame * sizeof(uint32_t);
+    copy.size = sizeof(uint32_t);
+    vkCmdCopyBuffer(commandBuffer, drawBuffer, buffer, 1, &copy);
+
+    VkMemoryBarrier readbackBarrier{};
+    readbackBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    readbackBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    readbackBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         1, &readbackBarrier, 0, nullptr, 0, nullptr);
+
+    Slot& slot = slots[frame];
+    slot.tested = tested;
+    slot.reference = reference;
+    slot.pending = true;
+  }
+
+  void collect(uint32_t frame){
+    Slot& slot = slots[frame];
+    if(!slot.pending){
+      return;
+    }
+    uint32_t drawn = 0;
+    memcpy(&drawn, static_cast<const uint8_t*>(memory.mapped) + frame * sizeof(uint32_t), sizeof(uint32_t));
+    stats.frames++;
+    stats.tested += slot.tested;
+    stats.drawn += drawn;
+    if(slot.reference){
+      stats.referenceFrames++;
+      if(*slot.reference != drawn){
+        stats.referenceMismatches++;
+      }
+    }
+    slot.pending = false;
+  }
+
+  const CullingStats& statistics() const { return stats; }
+
+private:
+  struct Slot{
+    uint64_t tested = 0;
+    std::optional<uint32_t> reference;
+    bool pending = false;
+  };
+
+  VkDevice device;
+  DeviceMemoryAllocator& allocator;
+  std::vector<Slot> slots;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  DeviceAllocation memory;
+  CullingStats stats;
+};
+
+// Frustum culling on the GPU. Every frame slot owns a compacted instance
+// buffer (bound as vertex binding 1 in place of the full instance buffer) and
+// an indirect command whose instanceCount the compute pass increments for
+// every visible instance. The visible count is read back through
+// CullingReadback.
+class GpuCuller{
+public:
+  static constexpr uint32_t WORKGROUP_SIZE = 64;
+
+  GpuCuller(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache cache, const std::string& shaderPath,
+            VkBuffer instanceBuffer, uint32_t instanceCount, uint32_t indexCount, uint32_t frameCount,
+            PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount)
+    : device(device), allocator(allocator), instanceCount(instanceCount), indexCount(indexCount),
+      drawIndexedIndirectCount(drawIndexedIndirectCount),
+      pipeline(device, cache, shaderPath, 3, sizeof(CullConstants), frameCount),
+      readback(device, allocator, frameCount) {
+    VkDeviceSize instanceBytes = static_cast<VkDeviceSize>(std::max(instanceCount, 1u)) * sizeof(InstanceData);
+    slots.resize(frameCount);
+    for(FrameSlot& slot : slots){
+      createCullingBuffer(device, allocator, instanceBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.visibleBuffer, slot.visibleMemory);
+      createCullingBuffer(device, allocator, sizeof(DrawParameters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.drawBuffer, slot.drawMemory);
+      slot.descriptorSet = pipeline.allocateSet({instanceBuffer, slot.visibleBuffer, slot.drawBuffer});
+    }
+  }
+
+  GpuCuller(const GpuCuller&) = delete;
+  GpuCuller& operator=(const GpuCuller&) = delete;
+
+  ~GpuCuller(){
+    for(FrameSlot& slot : slots){
+      vkDestroyBuffer(device, slot.visibleBuffer, nullptr);
+      allocator.free(slot.visibleMemory);
+      vkDestroyBuffer(device, slot.drawBuffer, nullptr);
+      allocator.free(slot.drawMemory);
+    }
+  }
+
+  bool usesDrawIndirectCount() const { return drawIndexedIndirectCount != nullptr; }
+
+  // reads what this slot counted when it was last recorded, call after its fence wait
+  void collect(uint32_t frame){
+    readback.collect(frame);
+  }
+
+  // Resets the slot's command, culls and compacts, must be recorded outside
+  // of a render pass. reference is the CPU count for the same inputs, it is
+  // compared when the slot is collected.
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum, const BoundingSphere& sphere,
+              std::optional<uint32_t> reference = std::nullopt){
+    FrameSlot& slot = slots[frame];
+
+    DrawParameters reset{};
+    reset.command.indexCount = indexCount;
+    recordDrawParametersReset(commandBuffer, slot.drawBuffer, reset);
+
+    CullConstants constants{};
+    for(size_t i = 0; i < frustum.planes.size(); i++){
+      constants.planes[i] = frustum.planes[i];
+    }
+    constants.sphere = glm::vec4(sphere.center, sphere.radius);
+    constants.instanceCount = instanceCount;
+
+    pipeline.bind(commandBuffer, slot.descriptorSet, &constants);
+    vkCmdDispatch(commandBuffer, (instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+
+    readback.record(commandBuffer, frame, slot.drawBuffer,
+                    offsetof(DrawParameters, command) + offsetof(VkDrawIndexedIndirectCommand, instanceCount),
+                    VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, instanceCount, reference);
+  }
+
+  // the compacted instances, bound as vertex binding 1 for draw()
+  VkBuffer visibleInstances(uint32_t frame) const { return slots[frame].visibleBuffer; }
+
+  // inside the render pass, after record() of the same frame
+  void draw(VkCommandBuffer commandBuffer, uint32_t frame) const {
+    drawCulledIndirect(commandBuffer, slots[frame].drawBuffer, drawIndexedIndirectCount);
+  }
+
+  // counted in instances
+  const CullingStats& statistics() const { return readback.statistics(); }
+
+private:
+  // push constants of cull.comp, within the 128 bytes every device supports
+  struct CullConstants{
+    glm::vec4 planes[6];
+    glm::vec4 sphere;
+    uint32_t instanceCount;
+    uint32_t padding[3];
+  };
+  static_assert(sizeof(CullConstants) <= 128, "cull push constants exceed the guaranteed minimum");
+
+  struct FrameSlot{
+    VkBuffer visibleBuffer = VK_NULL_HANDLE;
+    DeviceAllocation visibleMemory;
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    DeviceAllocation drawMemory;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  };
+
+  VkDevice device;
+  DeviceMemoryAllocator& allocator;
+  uint32_t instanceCount;
+  uint32_t indexCount;
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount;
+  StorageComputePipeline pipeline;
+  CullingReadback readback;
+  std::vector<FrameSlot> slots;
+};
+
+// Cluster culling of a single mesh on the GPU. One workgroup per meshlet
+// tests its sphere against the frustum and its normal cone against the
+// camera, then copies the indices of a surviving meshlet into the slot's
+// compacted index buffer, bound in place of the full index buffer. The
+// slot's indirect command draws however many indices were appended, the
+// count is read back through CullingReadback.
+class MeshletCuller{
+public:
+  static constexpr uint32_t WORKGROUP_SIZE = 64;
+  // the minimum maxComputeWorkGroupCount, the shader loops over the rest
+  static constexpr uint32_t MAX_WORKGROUPS = 65535;
+
+  MeshletCuller(VkDevice device, DeviceMemoryAllocator& allocator, VkPipelineCache cache, const std::string& shaderPath,
+                VkBuffer meshletBuffer, uint32_t meshletCount, VkBuffer indexBuffer, uint32_t indexCount,
+                uint32_t instanceCount, bool coneCulling, uint32_t frameCount,
+                PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount)
+    : device(device), allocator(allocator), meshletCount(meshletCount), indexCount(indexCount),
+      instanceCount(instanceCount), coneCulling(coneCulling), drawIndexedIndirectCount(drawIndexedIndirectCount),
+      pipeline(device, cache, shaderPath, 4, sizeof(MeshletCullConstants), frameCount),
+      readback(device, allocator, frameCount) {
+    VkDeviceSize indexBytes = static_cast<VkDeviceSize>(std::max(indexCount, 1u)) * sizeof(uint32_t);
+    slots.resize(frameCount);
+    for(FrameSlot& slot : slots){
+      createCullingBuffer(device, allocator, indexBytes, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.visibleBuffer, slot.visibleMemory);
+      createCullingBuffer(device, allocator, sizeof(DrawParameters), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+                          | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT
+                          | VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, slot.drawBuffer, slot.drawMemory);
+      slot.descriptorSet = pipeline.allocateSet({meshletBuffer, indexBuffer, slot.visibleBuffer, slot.drawBuffer});
+    }
+  }
+
+  MeshletCuller(const MeshletCuller&) = delete;
+  MeshletCuller& operator=(const MeshletCuller&) = delete;
+
+  ~MeshletCuller(){
+    for(FrameSlot& slot : slots){
+      vkDestroyBuffer(device, slot.visibleBuffer, nullptr);
+      allocator.free(slot.visibleMemory);
+      vkDestroyBuffer(device, slot.drawBuffer, nullptr);
+      allocator.free(slot.drawMemory);
+    }
+  }
+
+  bool usesDrawIndirectCount() const { return drawIndexedIndirectCount != nullptr; }
+  bool usesConeCulling() const { return coneCulling; }
+
+  // reads what this slot kept when it was last recorded, call after its fence wait
+  void collect(uint32_t frame){
+    readback.collect(frame);
+  }
+
+  // Resets the slot's command, culls and compacts, must be recorded outside
+  // of a render pass. The frustum and camera are in the mesh's model space.
+  // reference is the CPU index count for the same inputs.
+  void record(VkCommandBuffer commandBuffer, uint32_t frame, const Frustum& frustum, const glm::vec3& camera,
+              std::optional<uint32_t> reference = std::nullopt){
+    FrameSlot& slot = slots[frame];
+
+    DrawParameters reset{};
+    reset.command.instanceCount = instanceCount;
+    recordDrawParametersReset(commandBuffer, slot.drawBuffer, reset);
+
+    MeshletCullConstants constants{};
+    for(size_t i = 0; i < frustum.planes.size(); i++){
+      constants.planes[i] = frustum.planes[i];
+    }
+    constants.camera = glm::vec4(camera, coneCulling ? 1.0f : 0.0f);
+    constants.meshletCount = meshletCount;
+
+    pipeline.bind(commandBuffer, slot.descriptorSet, &constants);
+    vkCmdDispatch(commandBuffer, std::max(std::min(meshletCount, MAX_WORKGROUPS), 1u), 1, 1);
+
+    readback.record(commandBuffer, frame, slot.drawBuffer,
+                    offsetof(DrawParameters, command) + offsetof(VkDrawIndexedIndirectCommand, indexCount),
+                    VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, indexCount, reference);
+  }
+
+  // the compacted indices, bound as the index buffer for draw()
+  VkBuffer visibleIndices(uint32_t frame) const { return slots[frame].visibleBuffer; }
+
+  // inside the render pass, after record() of the same frame
+  void draw(VkCommandBuffer commandBuffer, uint32_t frame) const {
+    drawCulledIndirect(commandBuffer, slots[frame].drawBuffer, drawIndexedIndirectCount);
+  }
+
+  // counted in indices
+  const CullingStats& statistics() const { return readback.statistics(); }
+
+private:
+  // push constants of meshlet_cull.comp, within the 128 bytes every device supports
+  struct MeshletCullConstants{
+    glm::vec4 planes[6];
+    // w is 1 when the normal cones are tested
+    glm::vec4 camera;
+    uint32_t meshletCount;
+    uint32_t padding[3];
+  };
+  static_assert(sizeof(MeshletCullConstants) <= 128, "meshlet cull push constants exceed the guaranteed minimum");
+
+  struct FrameSlot{
+    VkBuffer visibleBuffer = VK_NULL_HANDLE;
+    DeviceAllocation visibleMemory;
+    VkBuffer drawBuffer = VK_NULL_HANDLE;
+    DeviceAllocation drawMemory;
+    VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
+  };
+
+  VkDevice device;
+  DeviceMemoryAllocator& allocator;
+  uint32_t meshletCount;
+  uint32_t indexCount;
+  uint32_t instanceCount;
+  bool coneCulling;
+  PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount;
+  StorageComputePipeline pipeline;
+  CullingReadback readback;
+  std::vector<FrameSlot> slots;
+};
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// rolling statistics of one named scope, in milliseconds
+struct GpuScopeStats{
+  double minMs = 0.0;
+  double avgMs = 0.0;
+  double p99Ms = 0.0;
+  double lastMs = 0.0;
+  uint32_t samples = 0;
+};
+
+struct GpuTraceEvent{
+  uint64_t frame;
+  uint32_t scope;
+  double startMs;
+  double durationMs;
+};
+
+// Timestamp queries around named GPU scopes. Every frame slot owns its own
+// query pool; a slot's results are read when the slot comes around again,
+// after the caller waited on its fence, so the readback never stalls.
+// Completed scopes feed rolling min/avg/p99 stats and a bounded trace that
+// can be written as CSV or as Chrome trace JSON (chrome://tracing, Perfetto).
+class GpuProfiler{
+public:
+  static constexpr uint32_t MAX_SCOPES = 16;
+  static constexpr size_t HISTORY_FRAMES = 256;
+
+  GpuProfiler(VkDevice device, uint32_t frameCount, float timestampPeriod, uint32_t timestampValidBits,
+              size_t maxTraceEvents = 1 << 16)
+    : device(device), timestampPeriod(timestampPeriod), maxTraceEvents(maxTraceEvents) {
+    timestampMask = timestampValidBits >= 64 ? ~0ull : (1ull << timestampValidBits) - 1;
+    createPools(frameCount);
+  }
+
+  GpuProfiler(const GpuProfiler&) = delete;
+  GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+  ~GpuProfiler(){
+    destroyPools();
+  }
+
+  // keeps the stats and trace, results still pending in the old slots are dropped
+  void setFrameCount(uint32_t frameCount){
+    destroyPools();
+    createPools(frameCount);
+  }
+
+  // reads what this slot recorded frameCount frames ago, call after its fence wait
+  void collect(uint32_t frame){
+    FrameSlot& slot = slots[frame];
+    if(slot.scopes.empty()){
+      return;
+    }
+
+    uint32_t queryCount = static_cast<uint32_t>(slot.scopes.size()) * 2;
+    uint64_t timestamps[MAX_SCOPES * 2];
+    VkResult result = vkGetQueryPoolResults(device, slot.queryPool, 0, queryCount, sizeof(timestamps), timestamps,
+                                            sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+    if(result == VK_SUCCESS){
+      if(!haveBaseTimestamp){
+        baseTimestamp = timestamps[0];
+        haveBaseTimestamp = true;
+      }
+      for(size_t i = 0; i < slot.scopes.size(); i++){
+        uint64_t ticks = (timestamps[i * 2 + 1] - timestamps[i * 2]) & timestampMask;
+        double startMs = toMs((timestamps[i * 2] - baseTimestamp) & timestampMask);
+        record(slot.frame, slot.scopes[i], startMs, toMs(ticks));
+      }
+    }
+    slot.scopes.clear();
+  }
+
+  // resets the slot's queries, must be recorded outside of a render pass
+  void beginFrame(VkCommandBuffer commandBuffer, uint32_t frame){
+    FrameSlot& slot = slots[frame];
+    vkCmdResetQueryPool(commandBuffer, slot.queryPool, 0, MAX_SCOPES * 2);
+    slot.scopes.clear();
+    slot.frame = frameNumber++;
+    recordingSlot = frame;
+  }
+
+  // scopes may nest, each one costs two queries of the frame's pool
+  uint32_t beginScope(VkCommandBuffer commandBuffer, const char* name,
+                      VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT){
+    FrameSlot& slot = slots[recordingSlot];
+    if(slot.scopes.size() == MAX_SCOPES){
+      throw std::runtime_error("too many GPU profiler scopes in one frame!");
+    }
+    uint32_t scope = static_cast<uint32_t>(slot.scopes.size());
+    slot.scopes.push_back(scopeIndex(name));
+    vkCmdWriteTimestamp(commandBuffer, stage, slot.queryPool, scope * 2);
+    return scope;
+  }
+
+  void endScope(VkCommandBuffer commandBuffer, uint32_t scope,
+                VkPipelineStageFlagBits stage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT){
+    vkCmdWriteTimestamp(commandBuffer, stage, slots[recordingSlot].queryPool, scope * 2 + 1);
+  }
+
+  // duration of the most recent completed instance, 0 before the first readback
+  double lastMs(const std::string& name) const {
+    for(const ScopeHistory& history : histories){
+      if(history.name == name){
+        return history.lastMs;
+      }
+    }
+    return 0.0;
+  }
+
+  // over the last HISTORY_FRAMES samples of the scope
+  GpuScopeStats stats(const std::string& name) const {
+    for(const ScopeHistory& history : histories){
+      if(history.name == name){
+        return summarize(history);
+      }
+    }
+    return GpuScopeStats{};
+  }
+
+  // in the order the scopes were first recorded
+  std::vector<std::string> scopeNames() const {
+    std::vector<std::string> names;
+    for(const ScopeHistory& history : histories){
+      names.push_back(history.name);
+    }
+    return names;
+  }
+
+  // one row per completed scope: frame,scope,start_ms,duration_ms
+  bool writeCsv(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if(!file.is_open()){
+      return false;
+    }
+    file << std::fixed << std::setprecision(6);
+    file << "frame,scope,start_ms,duration_ms\n";
+    forEachEvent([&](const GpuTraceEvent& event){
+      file << event.frame << ',' << histories[event.scope].name << ',' << event.startMs << ',' << event.durationMs << '\n';
+    });
+    return file.good();
+  }
+
+  // Chrome trace event format, rolling stats are added under "gpuScopeStats"
+  bool writeJson(const std::string& path) const {
+    std::ofstream file(path, std::ios::trunc);
+    if(!file.is_open()){
+      return false;
+    }
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    bool first = true;
+    forEachEvent([&](const GpuTraceEvent& event){
+      file << (first ? "" : ",") << "\n{\"name\":\"" << histories[event.scope].name
+           << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << event.startMs * 1000.0
+           << ",\"dur\":" << event.durationMs * 1000.0 << ",\"args\":{\"frame\":" << event.frame << "}}";
+      first = false;
+    });
+    file << "\n],\"gpuScopeStats\":{";
+    for(size_t i = 0; i < histories.size(); i++){
+      GpuScopeStats s = summarize(histories[i]);
+      file << (i == 0 ? "" : ",") << "\n\"" << histories[i].name << "\":{\"samples\":" << s.samples
+           << ",\"minMs\":" << s.minMs << ",\"avgMs\":" << s.avgMs << ",\"p99Ms\":" << s.p99Ms << "}";
+    }
+    file << "\n}}\n";
+    return file.good();
+  }
+
+private:
+  struct FrameSlot{
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    // history index of every scope recorded into this slot, in query order
+    std::vector<uint32_t> scopes;
+    uint64_t frame = 0;
+  };
+
+  struct ScopeHistory{
+    std::string name;
+    std::vector<double> samples;
+    size_t next = 0;
+    double lastMs = 0.0;
+  };
+
+  VkDevice device;
+  float timestampPeriod;
+  uint64_t timestampMask;
+  size_t maxTraceEvents;
+
+  std::vector<FrameSlot> slots;
+  uint32_t recordingSlot = 0;
+  uint64_t frameNumber = 0;
+  uint64_t baseTimestamp = 0;
+  bool haveBaseTimestamp = false;
+
+  std::vector<ScopeHistory> histories;
+  // ring buffer, oldest events are overwritten once it is full
+  std::vector<GpuTraceEvent> trace;
+  size_t traceNext = 0;
+
+  void createPools(uint32_t frameCount){
+    slots.resize(frameCount);
+    for(FrameSlot& slot : slots){
+      VkQueryPoolCreateInfo queryPoolInfo{};
+      queryPoolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+      queryPoolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+      queryPoolInfo.queryCount = MAX_SCOPES * 2;
+
+      if(vkCreateQueryPool(device, &queryPoolInfo, nullptr, &slot.queryPool) != VK_SUCCESS){
+        throw std::runtime_error("failed to create timestamp query pool!");
+      }
+    }
+  }
+
+  void destroyPools(){
+    for(FrameSlot& slot : slots){
+      vkDestroyQueryPool(device, slot.queryPool, nullptr);
+    }
+    slots.clear();
+  }
+
+  double toMs(uint64_t ticks) const {
+    return static_cast<double>(ticks) * timestampPeriod / 1e6;
+  }
+
+  uint32_t scopeIndex(const char* name){
+    for(size_t i = 0; i < histories.size(); i++){
+      if(histories[i].name == name){
+        return static_cast<uint32_t>(i);
+      }
+    }
+    histories.push_back(ScopeHistory{name, {}, 0, 0.0});
+    histories.back().samples.reserve(HISTORY_FRAMES);
+    return static_cast<uint32_t>(histories.size() - 1);
+  }
+
+  void record(uint64_t frame, uint32_t scope, double startMs, double durationMs){
+    ScopeHistory& history = histories[scope];
+    if(history.samples.size() < HISTORY_FRAMES){
+      history.samples.push_back(durationMs);
+    } else {
+      history.samples[history.next] = durationMs;
+    }
+    history.next = (history.next + 1) % HISTORY_FRAMES;
+    history.lastMs = durationMs;
+
+    if(maxTraceEvents == 0){
+      return;
+    }
+    GpuTraceEvent event{frame, scope, startMs, durationMs};
+    if(trace.size() < maxTraceEvents){
+      trace.push_back(event);
+    } else {
+      trace[traceNext] = event;
+    }
+    traceNext = (traceNext + 1) % maxTraceEvents;
+  }
+
+  // oldest first
+  template<typename Fn>
+  void forEachEvent(Fn&& fn) const {
+    size_t begin = trace.size() < maxTraceEvents ? 0 : traceNext;
+    for(size_t i = 0; i < trace.size(); i++){
+      fn(trace[(begin + i) % trace.size()]);
+    }
+  }
+
+  static GpuScopeStats summarize(const ScopeHistory& history){
+    GpuScopeStats s;
+    s.samples = static_cast<uint32_t>(history.samples.size());
+    s.lastMs = history.lastMs;
+    if(history.samples.empty()){
+      return s;
+    }
+
+    std::vector<double> sorted = history.samples;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for(double sample : sorted){
+      sum += sample;
+    }
+    s.minMs = sorted.front();
+    s.avgMs = sum / sorted.size();
+    s.p99Ms = sorted[std::min(sorted.size() - 1, sorted.size() * 99 / 100)];
+    return s;
+  }
+};
@@ -6,20 +6,38 @@
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_beta.h>
 
-#define GLM_FORCE_RADIANS
-#define GLM_FORCE_DEPTH_ZERO_TO_ONE
-#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
-#define GLM_ENABLE_EXPERIMENTAL
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtx/hash.hpp>
+#include "vertex.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+
 #define TINYOBJECTLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
 
+#include "thread_pool.h"
+#include "obj_loader.h"
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "device_allocator.h"
+#include "staging_uploader.h"
+#include "texture_loader.h"
+#include "texture_container.h"
+#include "frame_pacer.h"
+#include "gpu_profiler.h"
+#include "cpu_trace.h"
+#include "frame_stats.h"
+#include "pipeline_cache.h"
+#include "pipeline_compiler.h"
+#include "pipeline_registry.h"
+#include "secondary_recorder.h"
+#include "cpu_culling.h"
+#include "gpu_culling.h"
+#include "meshlet_builder.h"
+#include "mesh_simplifier.h"
+
 #include <chrono>
 
 #include <cstdlib>
@@ -32,72 +50,37 @@
 #include <fstream>
 #include <unordered_map>
 
-struct Vertex{
-  glm::vec3 pos;
-  glm::vec3 color;
-  glm::vec2 texCoord;
-
-  static VkVertexInputBindingDescription getBindingDescription() {
-    VkVertexInputBindingDescription bindingDescription{};
-    bindingDescription.binding = 0;
-    bindingDescription.stride = sizeof(Vertex);
-    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    return bindingDescription;
-  }
-
-  static std::array<VkVertexInputAttributeDescription, 3> getAtrributeDescription() {
-    std::array<VkVertexInputAttributeDescription, 3> attributeDescription{};
-
-    attributeDescription[0].binding = 0;
-    attributeDescription[0].location = 0;
-    attributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescription[0].offset = offsetof(Vertex, pos);
-
-    attributeDescription[1].binding = 0;
-    attributeDescription[1].location = 1;
-    attributeDescription[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-    attributeDescription[1].offset = offsetof(Vertex, color);
-
-    attributeDescription[2].binding = 0;
-    attributeDescription[2].location = 2;
-    attributeDescription[2].format = VK_FORMAT_R32G32_SFLOAT;
-    attributeDescription[2].offset = offsetof(Vertex, texCoord);
-
-    return attributeDescription;
-  }
-
-  bool operator==(const Vertex& other) const{
-    return pos == other.pos && color == other.color && texCoord == other.texCoord;
-  }
-};
-
-namespace std {
-  template<> struct hash<Vertex>{
-    size_t operator()(Vertex const& vertex) const {
-      return ((hash<glm::vec3>()(vertex.pos) ^ 
-              (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-              (hash<glm::vec2>()(vertex.texCoord) << 1);
-    }
-  };
-}
-
 struct UniformBufferObject{
   alignas(16) glm::mat4 model;
   alignas(16) glm::mat4 view;
   alignas(16) glm::mat4 proj;
+  alignas(16) glm::vec4 positionScale;
+  alignas(16) glm::vec4 positionOffset;
 };
 
-std::vector<Vertex> vertices;
-std::vector<uint32_t> indices;
+// frames in flight are picked at runtime (--frames-in-flight) within these bounds
+const uint32_t MIN_FRAMES_IN_FLIGHT = 1;
+const uint32_t MAX_FRAMES_IN_FLIGHT = 4;
 
-const int MAX_FRAMES_IN_FLIGHT = 2;
+// frame count of a --headless run without --frames
+const uint32_t HEADLESS_DEFAULT_FRAMES = 300;
+// animation step of --deterministic runs, independent of the actual frame time
+const float DETERMINISTIC_FRAME_SECONDS = 1.0f / 60.0f;
+// copies per worker task when picking levels of detail
+const size_t LOD_SELECT_CHUNK_SIZE = 1024;
 
 const uint32_t WIDTH = 800;
 const uint32_t HEIGHT = 600;
 
 const std::string MODEL_PATH = "../models/viking_room.obj";
+const std::string MESH_CACHE_PATH = "viking_room.meshcache";
+const std::string PACKED_MESH_CACHE_PATH = "viking_room.packed.meshcache";
 const std::string TEXTURE_PATH = "../textures/viking_room.png";
+// written by the texture_baker target, see tools/CMakeLists.txt
+const std::string BAKED_TEXTURE_PATH = "textures/viking_room.vktx";
+const std::string PIPELINE_CACHE_PATH = "pipeline.cache";
+const std::string CULL_SHADER_PATH = "shaders/cull.comp.spv";
+const std::string MESHLET_CULL_SHADER_PATH = "shaders/meshlet_cull.comp.spv";
 
 // function to load vkCreateDebugUtilsMessengerEXT
 VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
@@ -118,25 +101,171 @@ void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMessengerEXT
   }
 }
 
-static std::vector<char> readFile(const std::string& filename){
-  std::ifstream file(filename, std::ios::ate | std::ios::binary);
+// where the texture's mip chain is built when there is no baked texture
+enum class MipGeneration{
+  Cpu,
+  Gpu,
+};
 
-  if(!file.is_open()){
-    throw std::runtime_error("failed to open file!");
-  }
+struct AppConfig{
+  VertexFormat vertexFormat = VertexFormat::Float32;
+  MipGeneration mipGeneration = MipGeneration::Cpu;
+  uint32_t framesInFlight = 2;
+  // let FramePacer adjust framesInFlight from measured CPU and GPU frame times
+  bool framePacing = false;
+  // GPU timestamp trace written on exit, Chrome trace JSON for .json, CSV otherwise
+  std::string gpuProfilePath;
+  // CPU scope trace as Chrome trace JSON, written on exit and on SIGUSR1
+  std::string cpuTracePath;
+  // render into offscreen images without a window, surface or swapchain
+  bool headless = false;
+  // stop after warmupFrames plus this many frames, 0 runs until the window is closed
+  uint32_t frameLimit = 0;
+  // rendered before frame stats are recorded, only used with a frame limit
+  uint32_t warmupFrames = 0;
+  // animation and camera path indexed by frame number instead of wall clock time
+  bool deterministic = false;
+  // PNG of the last headless frame, written on exit
+  std::string screenshotPath;
+  // loaded at startup and saved on exit, empty disables the cache
+  std::string pipelineCachePath = PIPELINE_CACHE_PATH;
+  // draw with VK_POLYGON_MODE_LINE where fillModeNonSolid is supported
+  bool wireframe = false;
+  // copies of the model on a grid, each placed by its own instance transform
+  uint32_t objectCount = 1;
+  // all copies in one instanced draw, --per-object-draws issues one draw per copy instead
+  bool instanced = true;
+  // frustum cull the copies in a compute pass and draw the survivors indirectly
+  bool gpuCulling = false;
+  // also cull on the CPU every frame and count frames where the two disagree
+  bool verifyCulling = false;
+  // frustum cull the copies on the worker pool and draw the visible runs
+  bool cpuCulling = false;
+  // frustum and backface cull the model's meshlets in a compute pass and draw the compacted indices
+  bool meshletCulling = false;
+  // draw each copy with the coarsest level of detail whose error projects to at most lodErrorPixels
+  bool lodSelection = false;
+  float lodErrorPixels = 1.0f;
+  // record the draw list into this many secondary command buffers on the workers, 0 records inline
+  uint32_t recordThreads = 0;
+};
 
-  size_t fileSize = (size_t) file.tellg();
-  std::vector<char> buffer(fileSize);
+static AppConfig parseArgs(int argc, char** argv){
+  AppConfig config{};
+
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(arg == "--vertex-format=float"){
+      config.vertexFormat = VertexFormat::Float32;
+    } else if(arg == "--vertex-format=packed"){
+      config.vertexFormat = VertexFormat::Packed16;
+    } else if(arg == "--mip-generation=cpu"){
+      config.mipGeneration = MipGeneration::Cpu;
+    } else if(arg == "--mip-generation=gpu"){
+      config.mipGeneration = MipGeneration::Gpu;
+    } else if(arg.rfind("--cpu-trace=", 0) == 0){
+      config.cpuTracePath = arg.substr(strlen("--cpu-trace="));
+    } else if(arg.rfind("--gpu-profile=", 0) == 0){
+      config.gpuProfilePath = arg.substr(strlen("--gpu-profile="));
+    } else if(arg == "--headless"){
+      config.headless = true;
+    } else if(arg.rfind("--frames=", 0) == 0){
+      config.frameLimit = static_cast<uint32_t>(std::strtoul(arg.c_str() + strlen("--frames="), nullptr, 10));
+      if(config.frameLimit == 0){
+        throw std::invalid_argument("--frames must be a positive frame count");
+      }
+    } else if(arg.rfind("--warmup=", 0) == 0){
+      config.warmupFrames = static_cast<uint32_t>(std::strtoul(arg.c_str() + strlen("--warmup="), nullptr, 10));
+    } else if(arg == "--pipeline-cache=off"){
+      config.pipelineCachePath.clear();
+    } else if(arg.rfind("--pipeline-cache=", 0) == 0){
+      config.pipelineCachePath = arg.substr(strlen("--pipeline-cache="));
+    } else if(arg.rfind("--objects=", 0) == 0){
+      config.objectCount = static_cast<uint32_t>(std::strtoul(arg.c_str() + strlen("--objects="), nullptr, 10));
+      if(config.objectCount == 0){
+        throw std::invalid_argument("--objects must be at least 1");
+      }
+    } else if(arg == "--per-object-draws"){
+      config.instanced = false;
+    } else if(arg == "--gpu-culling"){
+      config.gpuCulling = true;
+    } else if(arg == "--cpu-culling"){
+      config.cpuCulling = true;
+    } else if(arg == "--meshlet-culling"){
+      config.meshletCulling = true;
+    } else if(arg == "--lod"){
+      config.lodSelection = true;
+    } else if(arg.rfind("--lod-error=", 0) == 0){
+      config.lodErrorPixels = std::strtof(arg.c_str() + strlen("--lod-error="), nullptr);
+      if(!(config.lodErrorPixels > 0.0f)){
+        throw std::invalid_argument("--lod-error must be a positive pixel count");
+      }
+      config.lodSelection = true;
+    } else if(arg == "--verify-culling"){
+      config.verifyCulling = true;
+    } else if(arg.rfind("--record-threads=", 0) == 0){
+      config.recordThreads = static_cast<uint32_t>(std::strtoul(arg.c_str() + strlen("--record-threads="), nullptr, 10));
+    } else if(arg == "--wireframe"){
+      config.wireframe = true;
+    } else if(arg == "--deterministic"){
+      config.deterministic = true;
+    } else if(arg.rfind("--screenshot=", 0) == 0){
+      config.screenshotPath = arg.substr(strlen("--screenshot="));
+    } else if(arg == "--frames-in-flight=auto"){
+      config.framePacing = true;
+    } else if(arg.rfind("--frames-in-flight=", 0) == 0){
+      uint32_t frames = static_cast<uint32_t>(std::strtoul(arg.c_str() + strlen("--frames-in-flight="), nullptr, 10));
+      if(frames < MIN_FRAMES_IN_FLIGHT || frames > MAX_FRAMES_IN_FLIGHT){
+        throw std::invalid_argument("--frames-in-flight must be auto or 1 to " + std::to_string(MAX_FRAMES_IN_FLIGHT));
+      }
+      config.framesInFlight = frames;
+      config.framePacing = false;
+    } else {
+      throw std::invalid_argument("unknown option " + arg);
+    }
+  }
 
-  file.seekg(0);
-  file.read(buffer.data(), fileSize);
+  if(!config.screenshotPath.empty() && !config.headless){
+    throw std::invalid_argument("--screenshot needs --headless");
+  }
+  // verifies whichever GPU culling pass runs, instance culling by default
+  if(config.verifyCulling && !config.meshletCulling){
+    config.gpuCulling = true;
+  }
+  if(config.gpuCulling && !config.instanced){
+    throw std::invalid_argument("--gpu-culling draws instanced, it can't be combined with --per-object-draws");
+  }
+  if(config.gpuCulling && config.cpuCulling){
+    throw std::invalid_argument("--gpu-culling and --cpu-culling are alternatives");
+  }
+  if(config.meshletCulling && (config.gpuCulling || config.cpuCulling)){
+    throw std::invalid_argument("--meshlet-culling can't be combined with --gpu-culling or --cpu-culling");
+  }
+  if(config.meshletCulling && config.objectCount != 1){
+    throw std::invalid_argument("--meshlet-culling culls the clusters of a single copy, it needs --objects=1");
+  }
+  if(config.lodSelection && (config.gpuCulling || config.meshletCulling)){
+    throw std::invalid_argument("--lod picks levels on the CPU, it can't be combined with --gpu-culling or --meshlet-culling");
+  }
+  if(config.headless && config.frameLimit == 0){
+    config.frameLimit = HEADLESS_DEFAULT_FRAMES;
+  }
 
-  file.close();
-  return buffer;
+  return config;
 }
 
 class HelloTriangleApplication {
+public:
+  explicit HelloTriangleApplication(const AppConfig& appConfig)
+    : config(appConfig), framesInFlight(appConfig.framesInFlight) {
+    if(config.headless){
+      deviceExtensions.clear();
+    }
+  }
+
 private:
+  AppConfig config;
+
   const uint32_t WIDTH = 800;
   const uint32_t HEIGHT = 600;
 
@@ -144,9 +273,9 @@ private:
     "VK_LAYER_KHRONOS_validation"
   };
 
+  // VK_KHR_portability_subset is added by createLogicalDevice where the device exposes it
   std::vector<const char*> deviceExtensions = {
-    VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-    VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME
+    VK_KHR_SWAPCHAIN_EXTENSION_NAME
   };
 
   #ifdef NDEBUG
@@ -155,13 +284,16 @@ private:
     const bool enableValidationLayers = true;
   #endif
 
-  GLFWwindow *window;
+  GLFWwindow *window = nullptr;
 
   VkInstance instance;
   VkDebugUtilsMessengerEXT debugMessenger;
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
   VkDevice device;
   VkQueue graphicsQueue;
+  VkQueue transferQueue;
+  std::unique_ptr<DeviceMemoryAllocator> allocator;
+  std::unique_ptr<StagingUploader> uploader;
 
   static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(
     VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
@@ -176,20 +308,24 @@ private:
     return VK_FALSE;
   }
 
-  VkSurfaceKHR surface;
+  VkSurfaceKHR surface = VK_NULL_HANDLE;
   VkQueue presentQueue;
   VkSwapchainKHR swapChain;
   std::vector<VkImage> swapChainImages;
   VkFormat swapChainImageFormat;
   VkExtent2D swapChainExtent;
   std::vector<VkImageView> swapChainImageViews;
+  // backing memory of swapChainImages when they are headless offscreen targets
+  std::vector<DeviceAllocation> offscreenImageMemory;
 
   struct QueueFamilyIndices{
     std::optional<uint32_t> graphicsFamily;
     std::optional<uint32_t> presentFamily;
+    // transfer-only family for async uploads, empty if the device has none
+    std::optional<uint32_t> transferFamily;
 
-    bool isComplete(){
-      return graphicsFamily.has_value() && presentFamily.has_value();
+    bool isComplete(bool needsPresent){
+      return graphicsFamily.has_value() && (presentFamily.has_value() || !needsPresent);
     }
   };
   
@@ -200,34 +336,79 @@ private:
   };
 
   VkRenderPass renderPass;
-  VkPipeline graphicsPipeline;
+  // shared by every pipeline, nullptr with --pipeline-cache=off
+  std::unique_ptr<PipelineCache> pipelineCache;
+  std::unique_ptr<PipelineCompiler> pipelineCompiler;
+  std::unique_ptr<PipelineRegistry> pipelineRegistry;
+  PipelineHandle fallbackPipeline;
+  PipelineHandle graphicsPipeline;
+  bool graphicsPipelineReported = false;
   VkDescriptorSetLayout descriptorSetLayout;
   VkPipelineLayout pipelineLayout;
 
 
   std::vector<VkFramebuffer> swapChainFrambuffers;
 
+  ThreadPool workers;
+  MeshCache meshCache;
+
   VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
+  DeviceAllocation vertexBufferMemory;
   VkBuffer indexBuffer;
 
   std::vector<VkBuffer> uniformBuffers;
-  std::vector<VkDeviceMemory> uniformBuffersMemory;
+  std::vector<DeviceAllocation> uniformBuffersMemory;
   std::vector<void*> uniformBuffersMapped;
 
   uint32_t mipLevels;
+  VkFormat textureFormat = VK_FORMAT_R8G8B8A8_SRGB;
+  bool textureCompressionBC = false;
+  bool fillModeNonSolid = false;
+  bool drawIndirectCount = false;
   VkImage textureImage;
-  VkDeviceMemory textureImageMemory;
+  DeviceAllocation textureImageMemory;
   VkImageView textureImageView;
   VkSampler textureSampler;
 
+  VkImage placeholderImage = VK_NULL_HANDLE;
+  DeviceAllocation placeholderImageMemory;
+  VkImageView placeholderImageView = VK_NULL_HANDLE;
+  std::future<DecodedImage> textureDecode;
+  bool textureReady = false;
+  std::vector<bool> textureBound;
+  std::chrono::high_resolution_clock::time_point initStartTime;
+
   VkImage depthImage;
-  VkDeviceMemory depthImageMemory;
+  DeviceAllocation depthImageMemory;
   VkImageView depthImageView;
 
-  VkDeviceMemory indexBufferMemory;
+  DeviceAllocation indexBufferMemory;
+  VkBuffer instanceBuffer;
+  DeviceAllocation instanceBufferMemory;
   VkCommandPool commandPool;
   std::vector<VkCommandBuffer> commandBuffers;
+  // only created with --record-threads
+  std::unique_ptr<SecondaryRecorder> secondaryRecorder;
+  std::vector<InstanceData> instances;
+  // model space, before ubo.model
+  BoundingSphere modelBounds;
+  // only created with --gpu-culling
+  std::unique_ptr<GpuCuller> gpuCuller;
+  // only created with --cpu-culling, the spheres are rebuilt every frame as ubo.model spins
+  std::unique_ptr<CpuCuller> cpuCuller;
+  BoundingSpheresSoA instanceSpheres;
+  // ascending indices into instances
+  std::vector<uint32_t> visibleInstances;
+  CullingStats cpuCullingStats;
+  // only created with --meshlet-culling, the meshlets come from the mesh cache
+  VkBuffer meshletBuffer = VK_NULL_HANDLE;
+  DeviceAllocation meshletBufferMemory;
+  std::unique_ptr<MeshletCuller> meshletCuller;
+  // only filled with --lod, the level of every copy drawn this frame, indexed like instances
+  std::vector<uint8_t> instanceLods;
+  LodStats lodStats;
+  // what updateUniformBuffer wrote for the frame being recorded
+  UniformBufferObject frameUbo{};
 
   VkDescriptorPool descriptorPool;
   std::vector<VkDescriptorSet> descriptorSet;
@@ -235,23 +416,48 @@ private:
   std::vector<VkSemaphore> imageAvailableSemaphores;
   std::vector<VkSemaphore> renderFinishedSemaphores;
   std::vector<VkFence> inFlightFences;
+  // fence of the frame that last rendered into each swapchain image
+  std::vector<VkFence> imagesInFlight;
+  std::vector<UploadWaits> uploadWaits;
+  uint32_t framesInFlight;
   uint32_t currentFrame = 0;
+  uint64_t renderedFrames = 0;
+  // recording and submit time of the last frame, without the fence and acquire waits
+  double lastCpuMs = 0.0;
+  FrameStatsRecorder frameStats;
+  // reused every frame so submitting does not allocate
+  std::vector<VkSemaphore> submitWaitSemaphores;
+  std::vector<VkPipelineStageFlags> submitWaitStages;
+  // swapchain image the last submitted frame rendered into
+  uint32_t lastImageIndex = 0;
+
+  // only created with --gpu-profile or --frames-in-flight=auto
+  std::unique_ptr<GpuProfiler> gpuProfiler;
+  std::unique_ptr<FramePacer> framePacer;
 
   bool framebufferResized = false;
 
   VkSampleCountFlagBits msaaSamples = VK_SAMPLE_COUNT_1_BIT;
   VkImage colorImage;
-  VkDeviceMemory colorImageMemory;
+  DeviceAllocation colorImageMemory;
   VkImageView colorImageView;
 
 public:
   void run() {
-    initWindow();
+    initCpuTrace();
+    if(!config.headless){
+      initWindow();
+    }
     initVulkan();
     mainLoop();
     cleanup();
   }
 
+  // frames after the warmup of a run with a frame limit
+  FrameStatsSummary frameSummary() const {
+    return frameStats.summarize();
+  }
+
 private:
   void populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInfoEXT& createInfo){
     createInfo.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -288,18 +494,45 @@ private:
       std::cout << '\t' <<ext.extensionName << std::endl;
     }
 
-    const char** glfwExtensions;
-
-
-    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions;
+    if(!config.headless){
+      const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+      extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     if(enableValidationLayers){
       extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
     }
     return extensions;
   }
 
+  bool instanceExtensionSupported(const char* name){
+    uint32_t extensionCount = 0;
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensionsList(extensionCount);
+    vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, extensionsList.data());
+
+    for(const auto& ext : extensionsList){
+      if(strcmp(ext.extensionName, name) == 0){
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool deviceExtensionSupported(VkPhysicalDevice physical_device, const char* name){
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensionsList(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &extensionCount, extensionsList.data());
+
+    for(const auto& ext : extensionsList){
+      if(strcmp(ext.extensionName, name) == 0){
+        return true;
+      }
+    }
+    return false;
+  }
+
   void initWindow() {
     glfwInit();
 
@@ -317,17 +550,22 @@ private:
   }
 
   void initVulkan() {
+    initStartTime = std::chrono::high_resolution_clock::now();
     createInstance();
     setupDebugMessenger();
     createSurface();
     pickPhysicalDevice();
     createLogicalDevice();
+    createAllocator();
     createSwapChain();
     createImageViews();
     createRenderPass();
     createDescriptorSetLayout();
+    createPipelineCache();
+    createPipelineCompiler();
     createGraphicsPipeline();
     createCommandPool();
+    createUploader();
     createColorResources();
     createDepthResources();
     createFramebuffers();
@@ -335,13 +573,26 @@ private:
     createTextureImageView();
     createImageSampler();
     loadModel();
+    createInstances();
     createVertexBuffer();
     createIndexBuffer();
-    createUniformBuffers();
-    createDescriptorPool();
-    createDescriptorSet();
-    createCommandBuffers();
-    createSyncObjects();
+    createInstanceBuffer();
+    createGpuCuller();
+    createCpuCuller();
+    createMeshletCuller();
+    uploader->flush();
+    createGpuProfiler();
+    createFrameResources();
+
+    DeviceMemoryStats memoryStats = allocator->statistics();
+    std::cout << "device memory: " << memoryStats.deviceMemoryCount << " vkAllocateMemory allocations ("
+              << memoryStats.blockCount << " blocks, " << memoryStats.dedicatedCount << " dedicated), "
+              << memoryStats.allocationCount << " sub-allocations, "
+              << (memoryStats.usedBytes + memoryStats.dedicatedBytes) / 1024 << " KiB in use" << std::endl;
+
+    auto initEndTime = std::chrono::high_resolution_clock::now();
+    std::cout << "initVulkan took " << std::chrono::duration<double, std::milli>(initEndTime - initStartTime).count()
+              << " ms, " << (textureReady ? "baked texture uploaded" : "texture still decoding on a worker") << std::endl;
   }
 
   void createDescriptorSetLayout() {
@@ -375,15 +626,15 @@ private:
   void createDescriptorPool() {
     std::array<VkDescriptorPoolSize,2> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    poolSizes[0].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[0].descriptorCount = framesInFlight;
     poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    poolSizes[1].descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolSizes[1].descriptorCount = framesInFlight;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    poolInfo.maxSets = framesInFlight;
 
     if(vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) != VK_SUCCESS) {
       throw std::runtime_error("Failed to create descriptor pool!");
@@ -391,19 +642,19 @@ private:
   }
 
   void createDescriptorSet() {
-    std::vector<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
+    std::vector<VkDescriptorSetLayout> layouts(framesInFlight, descriptorSetLayout);
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
-    allocInfo.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT);
+    allocInfo.descriptorSetCount = framesInFlight;
     allocInfo.pSetLayouts = layouts.data();
 
-    descriptorSet.resize(MAX_FRAMES_IN_FLIGHT);
+    descriptorSet.resize(framesInFlight);
     if(vkAllocateDescriptorSets(device, &allocInfo, descriptorSet.data()) != VK_SUCCESS) {
       throw std::runtime_error("failed to allocate descriptor sets!");
     }
 
-    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for(size_t i = 0; i < framesInFlight; i++) {
       VkDescriptorBufferInfo bufferInfo{};
       bufferInfo.buffer = uniformBuffers[i];
       bufferInfo.offset = 0;
@@ -411,7 +662,7 @@ private:
 
       VkDescriptorImageInfo imageInfo{};
       imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-      imageInfo.imageView = textureImageView;
+      imageInfo.imageView = textureReady ? textureImageView : placeholderImageView;
       imageInfo.sampler = textureSampler;
 
       std::array<VkWriteDescriptorSet,2> descriptorWrite{};
@@ -434,9 +685,31 @@ private:
 
       vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrite.size()), descriptorWrite.data(), 0, nullptr);
     }
+    textureBound.assign(framesInFlight, textureReady);
+  }
+
+  void writeTextureDescriptor(VkDescriptorSet set, VkImageView imageView){
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    imageInfo.imageView = imageView;
+    imageInfo.sampler = textureSampler;
+
+    VkWriteDescriptorSet descriptorWrite{};
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.dstSet = set;
+    descriptorWrite.dstBinding = 1;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.pImageInfo = &imageInfo;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
   }
 
   void createSurface(){
+    if(config.headless){
+      return;
+    }
     if(glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS){
       throw std::runtime_error("Failed to create window surface!");
     }
@@ -465,9 +738,12 @@ private:
     std::vector<const char*> requiredExtensions = getRequiredExtensions();
 
 
-    requiredExtensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
-    requiredExtensions.emplace_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
-    createInfo.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+    // portability drivers (MoltenVK) are only enumerated with this, other loaders don't expose it
+    if(instanceExtensionSupported(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME)){
+      requiredExtensions.emplace_back(VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME);
+      requiredExtensions.emplace_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+      createInfo.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+    }
     
     createInfo.enabledExtensionCount = static_cast<uint32_t>(requiredExtensions.size());
     createInfo.ppEnabledExtensionNames = requiredExtensions.data();
@@ -542,78 +818,191 @@ private:
 
   }
 
+  void initCpuTrace(){
+    if(config.cpuTracePath.empty()){
+      return;
+    }
+    CpuTracer& tracer = CpuTracer::instance();
+    tracer.enable();
+    tracer.nameThread("main");
+    tracer.installDumpSignal();
+    std::cout << "cpu trace enabled, written to " << config.cpuTracePath << " on exit or SIGUSR1 (pid " << getpid() << ")"
+              << std::endl;
+  }
+
+  void writeCpuTrace(){
+    if(!CpuTracer::instance().writeJson(config.cpuTracePath)){
+      std::cerr << "failed to write cpu trace " << config.cpuTracePath << std::endl;
+    }
+  }
+
+  bool shouldStop(){
+    if(config.frameLimit > 0 && renderedFrames >= uint64_t(config.warmupFrames) + config.frameLimit){
+      return true;
+    }
+    return !config.headless && glfwWindowShouldClose(window);
+  }
+
   void mainLoop() {
+    auto loopStartTime = std::chrono::high_resolution_clock::now();
+    if(config.frameLimit > 0){
+      frameStats.reserve(config.frameLimit);
+    }
+
+    while (!shouldStop()) {
+      auto frameStartTime = std::chrono::high_resolution_clock::now();
+      uint64_t framesBefore = renderedFrames;
+      uint64_t allocationsBefore = heapAllocationCounter().load(std::memory_order_relaxed);
+      {
+        CpuTraceScope frameScope("frame");
+        if(!config.headless){
+          CpuTraceScope pollScope("glfwPollEvents");
+          glfwPollEvents();
+        }
+        drawFrame();
+      }
 
-    while (!glfwWindowShouldClose(window)) {
-      glfwPollEvents();
-      drawFrame();
+      if(config.frameLimit > 0 && renderedFrames > framesBefore && renderedFrames > config.warmupFrames){
+        auto frameEndTime = std::chrono::high_resolution_clock::now();
+        double gpuMs = gpuProfiler ? gpuProfiler->lastMs("frame") : 0.0;
+        frameStats.add(FrameSample{std::chrono::duration<double, std::milli>(frameEndTime - frameStartTime).count(), lastCpuMs,
+                                   gpuMs, heapAllocationCounter().load(std::memory_order_relaxed) - allocationsBefore});
+      }
+
+      if(CpuTracer::instance().takeDumpRequest()){
+        writeCpuTrace();
+      }
     }
 
     vkDeviceWaitIdle(device);
+    auto loopEndTime = std::chrono::high_resolution_clock::now();
+    double loopMs = std::chrono::duration<double, std::milli>(loopEndTime - loopStartTime).count();
+    std::cout << "rendered " << renderedFrames << " frames in " << loopMs << " ms ("
+              << (loopMs > 0.0 ? renderedFrames * 1000.0 / loopMs : 0.0) << " fps)" << std::endl;
+    if(frameStats.size() > 0){
+      FrameStatsSummary summary = frameStats.summarize();
+      std::cout << "frame time over " << summary.frames << " frames: p50 " << summary.frameP50Ms << " ms, p95 "
+                << summary.frameP95Ms << " ms, p99 " << summary.frameP99Ms << " ms, max " << summary.frameMaxMs
+                << " ms; cpu " << summary.cpuMeanMs << " ms, gpu " << summary.gpuMeanMs << " ms, "
+                << summary.allocationsPerFrame << " heap allocations per frame" << std::endl;
+    }
+
+    if(!config.screenshotPath.empty()){
+      saveScreenshot(config.screenshotPath);
+    }
+    reportGpuProfile();
+    reportCulling();
+    reportLodSelection();
+    if(CpuTracer::instance().enabled()){
+      writeCpuTrace();
+    }
+  }
+
+  // every frame has completed, so all pending timestamps can be read
+  void reportGpuProfile(){
+    if(!gpuProfiler){
+      return;
+    }
+    for(uint32_t i = 0; i < framesInFlight; i++){
+      gpuProfiler->collect(i);
+    }
+
+    for(const std::string& name : gpuProfiler->scopeNames()){
+      GpuScopeStats stats = gpuProfiler->stats(name);
+      std::cout << "gpu " << name << ": min " << stats.minMs << " ms, avg " << stats.avgMs << " ms, p99 "
+                << stats.p99Ms << " ms over " << stats.samples << " frames" << std::endl;
+    }
+
+    const std::string& path = config.gpuProfilePath;
+    if(path.empty()){
+      return;
+    }
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if(json ? gpuProfiler->writeJson(path) : gpuProfiler->writeCsv(path)){
+      std::cout << "gpu profile written to " << path << std::endl;
+    } else {
+      std::cerr << "failed to write gpu profile " << path << std::endl;
+    }
   }
 
   void cleanup() {
     vkDestroyImageView(device, depthImageView, nullptr);
     vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
+    allocator->free(depthImageMemory);
 
     cleanupSwapChain();
 
     vkDestroySampler(device, textureSampler, nullptr);
     vkDestroyImageView(device, textureImageView, nullptr);
+    vkDestroyImageView(device, placeholderImageView, nullptr);
+    vkDestroyImage(device, placeholderImage, nullptr);
+    allocator->free(placeholderImageMemory);
 
     vkDestroyImage(device, textureImage, nullptr);
-    vkFreeMemory(device, textureImageMemory, nullptr);
+    allocator->free(textureImageMemory);
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-      vkDestroyBuffer(device, uniformBuffers[i], nullptr);
-      vkFreeMemory(device, uniformBuffersMemory[i], nullptr);
-    }
-
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    cleanupFrameResources();
 
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, nullptr);
 
     vkDestroyBuffer(device, vertexBuffer, nullptr);
-    vkFreeMemory(device, vertexBufferMemory, nullptr);
+    allocator->free(vertexBufferMemory);
+
+    meshletCuller.reset();
+    if(meshletBuffer != VK_NULL_HANDLE){
+      vkDestroyBuffer(device, meshletBuffer, nullptr);
+      allocator->free(meshletBufferMemory);
+    }
 
     vkDestroyBuffer(device, indexBuffer, nullptr);
-    vkFreeMemory(device, indexBufferMemory, nullptr);
+    allocator->free(indexBufferMemory);
 
-    vkDestroyPipeline(device, graphicsPipeline, nullptr);
+    gpuCuller.reset();
+    vkDestroyBuffer(device, instanceBuffer, nullptr);
+    allocator->free(instanceBufferMemory);
+
+    pipelineRegistry.reset();
+    pipelineCompiler.reset();
     vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 
     vkDestroyRenderPass(device, renderPass, nullptr);
 
-    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++){
-      vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
-      vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
-      vkDestroyFence(device, inFlightFences[i], nullptr);
-    }
-
     vkDestroyCommandPool(device, commandPool, nullptr);
 
+    if(pipelineCache){
+      if(!pipelineCache->save()){
+        std::cerr << "failed to save pipeline cache " << config.pipelineCachePath << std::endl;
+      }
+      pipelineCache.reset();
+    }
+    gpuProfiler.reset();
+    uploader.reset();
+    allocator.reset();
     vkDestroyDevice(device, nullptr);
 
     if(enableValidationLayers){
       DestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
     }
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if(surface != VK_NULL_HANDLE){
+      vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
     vkDestroyInstance(instance, nullptr);
 
-    glfwDestroyWindow(window);
-
-    glfwTerminate();
+    if(window != nullptr){
+      glfwDestroyWindow(window);
+      glfwTerminate();
+    }
   }
 
   bool isDeviceSuitable(VkPhysicalDevice device){
     QueueFamilyIndices indices = findQueueFamilies(device);
 
     bool extensionsSupported = checkDeviceExtensionSupport(device);
-    bool swapChainAdequate = false;
+    // offscreen targets need no surface support
+    bool swapChainAdequate = config.headless;
 
-    if(extensionsSupported){
+    if(extensionsSupported && !config.headless){
       SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
       swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
     }
@@ -621,7 +1010,7 @@ private:
     VkPhysicalDeviceFeatures supportedFeatures;
     vkGetPhysicalDeviceFeatures(device, &supportedFeatures);
 
-    return indices.isComplete() && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
+    return indices.isComplete(!config.headless) && extensionsSupported && swapChainAdequate && supportedFeatures.samplerAnisotropy;
   }
 
   bool checkDeviceExtensionSupport(VkPhysicalDevice physical_device) {
@@ -651,15 +1040,18 @@ private:
     int i = 0;
     for(const auto& queueFamily : queueFamilies){
       VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-      if(queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      if(surface != VK_NULL_HANDLE){
+        vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+      }
+      if((queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && !indices.graphicsFamily.has_value()) {
         indices.graphicsFamily = i;
       }
-      if(presentSupport) {
+      if(presentSupport && !indices.presentFamily.has_value()) {
         indices.presentFamily = i;
       }
-      if (indices.isComplete()){
-        break;
+      VkQueueFlags transferOnly = queueFamily.queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT | VK_QUEUE_TRANSFER_BIT);
+      if(transferOnly == VK_QUEUE_TRANSFER_BIT && !indices.transferFamily.has_value()) {
+        indices.transferFamily = i;
       }
       i++;
     }
@@ -671,7 +1063,13 @@ private:
     QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
 
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
+    std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value()};
+    if(indices.presentFamily.has_value()){
+      uniqueQueueFamilies.insert(indices.presentFamily.value());
+    }
+    if(indices.transferFamily.has_value()){
+      uniqueQueueFamilies.insert(indices.transferFamily.value());
+    }
 
     float queuePriority = 1.0f;
     for(uint32_t queueFamily : uniqueQueueFamilies){
@@ -688,6 +1086,13 @@ private:
     deviceFeatures.samplerAnisotropy = VK_TRUE;
     deviceFeatures.sampleRateShading = VK_TRUE;
 
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+    textureCompressionBC = supportedFeatures.textureCompressionBC;
+    deviceFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+    deviceFeatures.fillModeNonSolid = supportedFeatures.fillModeNonSolid;
+
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
     createInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size());
@@ -695,8 +1100,17 @@ private:
 
     createInfo.pEnabledFeatures = &deviceFeatures;
 
-    createInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
-    createInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> enabledExtensions = deviceExtensions;
+    // must be enabled whenever the device exposes it
+    if(deviceExtensionSupported(physicalDevice, VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME)){
+      enabledExtensions.push_back(VK_KHR_PORTABILITY_SUBSET_EXTENSION_NAME);
+    }
+    drawIndirectCount = (config.gpuCulling || config.meshletCulling) && deviceExtensionSupported(physicalDevice, VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    if(drawIndirectCount){
+      enabledExtensions.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+    }
+    createInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size());
+    createInfo.ppEnabledExtensionNames = enabledExtensions.data();
 
 
     if(enableValidationLayers){
@@ -723,7 +1137,11 @@ private:
     }
 
     vkGetDeviceQueue(device, indices.graphicsFamily.value(), 0, &graphicsQueue);
-    vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    if(indices.presentFamily.has_value()){
+      vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
+    }
+    // without a transfer-only family uploads share the graphics queue
+    vkGetDeviceQueue(device, indices.transferFamily.value_or(indices.graphicsFamily.value()), 0, &transferQueue);
   }
 
   SwapChainSupportDetails querySwapChainSupport(VkPhysicalDevice physical_device){
@@ -789,15 +1207,23 @@ private:
   }
 
   void createSwapChain(){
+    if(config.headless){
+      createOffscreenTargets();
+      return;
+    }
     SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
 
     VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
     VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
     VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
-    uint32_t imageCount = swapChainSupport.capabilities.minImageCount + 1;
+    // one image more than frames in flight so acquire rarely waits on presentation
+    uint32_t imageCount = std::max(swapChainSupport.capabilities.minImageCount + 1, framesInFlight + 1);
 
-    imageCount = imageCount > swapChainSupport.capabilities.maxImageCount ? swapChainSupport.capabilities.maxImageCount : imageCount;
+    // a maxImageCount of 0 means there is no limit
+    if(swapChainSupport.capabilities.maxImageCount > 0 && imageCount > swapChainSupport.capabilities.maxImageCount){
+      imageCount = swapChainSupport.capabilities.maxImageCount;
+    }
 
     VkSwapchainCreateInfoKHR createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
@@ -836,11 +1262,94 @@ private:
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, nullptr);
     swapChainImages.resize(imageCount);
     vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+    imagesInFlight.assign(imageCount, VK_NULL_HANDLE);
 
     swapChainImageFormat = surfaceFormat.format;
     swapChainExtent = extent;
   }
 
+  // headless stand-ins for the swapchain images, rendered round robin and never presented
+  void createOffscreenTargets(){
+    uint32_t imageCount = framesInFlight + 1;
+    swapChainImageFormat = VK_FORMAT_R8G8B8A8_SRGB;
+    swapChainExtent = {WIDTH, HEIGHT};
+
+    swapChainImages.resize(imageCount);
+    offscreenImageMemory.resize(imageCount);
+    for(uint32_t i = 0; i < imageCount; i++){
+      createImage(WIDTH, HEIGHT, 1, VK_SAMPLE_COUNT_1_BIT, swapChainImageFormat, VK_IMAGE_TILING_OPTIMAL,
+                  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                  swapChainImages[i], offscreenImageMemory[i]);
+    }
+    imagesInFlight.assign(imageCount, VK_NULL_HANDLE);
+  }
+
+  // copies the last rendered offscreen target to a host visible buffer and writes it as PNG
+  void saveScreenshot(const std::string& path){
+    if(renderedFrames == 0){
+      return;
+    }
+    VkImage image = swapChainImages[lastImageIndex];
+    uint32_t width = swapChainExtent.width;
+    uint32_t height = swapChainExtent.height;
+
+    VkBuffer readbackBuffer;
+    DeviceAllocation readbackMemory;
+    createBuffer(static_cast<VkDeviceSize>(width) * height * 4, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, readbackBuffer, readbackMemory);
+
+    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+
+    // the render pass already left the image in TRANSFER_SRC_OPTIMAL, only the write needs to be made visible
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0;
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {width, height, 1};
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readbackBuffer, 1, &region);
+
+    VkMemoryBarrier hostBarrier{};
+    hostBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                         1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+    endSingleTimeCommandBuffer(commandBuffer);
+
+    if(stbi_write_png(path.c_str(), static_cast<int>(width), static_cast<int>(height), 4, readbackMemory.mapped,
+                      static_cast<int>(width) * 4)){
+      std::cout << "screenshot written to " << path << std::endl;
+    } else {
+      std::cerr << "failed to write screenshot " << path << std::endl;
+    }
+
+    vkDestroyBuffer(device, readbackBuffer, nullptr);
+    allocator->free(readbackMemory);
+  }
+
   void createImageViews(){
     swapChainImageViews.resize(swapChainImages.size());
 
@@ -850,115 +1359,6 @@ private:
   }
 
   void createGraphicsPipeline(){
-    auto vertShaderCode = readFile("shaders/shader.vert.spv");
-    auto fragShaderCode = readFile("shaders/shader.frag.spv");
-
-    VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-    VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
-
-    VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
-    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vertShaderStageInfo.module = vertShaderModule;
-    vertShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo fragShaderStageInfo{};
-    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    fragShaderStageInfo.module = fragShaderModule;
-    fragShaderStageInfo.pName = "main";
-
-    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
-
-    std::vector<VkDynamicState> dynamicStates = {
-      VK_DYNAMIC_STATE_VIEWPORT,
-      VK_DYNAMIC_STATE_SCISSOR
-    };
-
-    VkPipelineDynamicStateCreateInfo dynamicState{};
-    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicState.dynamicStateCount = static_cast<uint32_t>(dynamicStates.size());
-    dynamicState.pDynamicStates = dynamicStates.data();
-
-    VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
-    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-
-    auto bindingDescription = Vertex::getBindingDescription();
-    auto attributeDescriptions = Vertex::getAtrributeDescription();
-
-    vertexInputInfo.vertexBindingDescriptionCount = 1;
-    vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributeDescriptions.size());
-    vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions.data();
-
-    VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
-    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssembly.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewPort{};
-    viewPort.x = 0.0f;
-    viewPort.y = 0.0f;
-    viewPort.width = (float) swapChainExtent.width;
-    viewPort.height = (float) swapChainExtent.height;
-    viewPort.minDepth = 0.0f;
-    viewPort.maxDepth = 1.0f;
-
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = swapChainExtent;
-
-    VkPipelineViewportStateCreateInfo viewportState{};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewPort;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissor;
-
-    VkPipelineRasterizationStateCreateInfo rasterizer{};
-    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizer.depthClampEnable = VK_FALSE; 
-    rasterizer.rasterizerDiscardEnable = VK_FALSE;
-    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizer.lineWidth = 1.0f;
-    rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-    rasterizer.depthBiasEnable = VK_FALSE;
-    rasterizer.depthBiasConstantFactor = 0.0f;
-    rasterizer.depthBiasClamp = 0.0f;
-    rasterizer.depthBiasSlopeFactor = 0.0f;
-
-    VkPipelineMultisampleStateCreateInfo multisampling{};
-    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampling.sampleShadingEnable = VK_TRUE;
-    multisampling.rasterizationSamples = msaaSamples;
-    multisampling.minSampleShading = .2f;
-    multisampling.pSampleMask = nullptr;
-    multisampling.alphaToCoverageEnable = VK_FALSE;
-    multisampling.alphaToOneEnable = VK_FALSE;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachment{};
-    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-    colorBlendAttachment.blendEnable = VK_TRUE;
-    // Alpha blending
-    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
-    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
-    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
-
-    VkPipelineColorBlendStateCreateInfo colorBlending{};
-    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlending.logicOpEnable = VK_FALSE;
-    colorBlending.logicOp = VK_LOGIC_OP_COPY;
-    colorBlending.attachmentCount = 1;
-    colorBlending.pAttachments = &colorBlendAttachment;
-    colorBlending.blendConstants[0] = 0.0f;
-    colorBlending.blendConstants[1] = 0.0f;
-    colorBlending.blendConstants[2] = 0.0f;
-    colorBlending.blendConstants[3] = 0.0f;
-
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
     pipelineLayoutInfo.setLayoutCount = 1;
@@ -971,62 +1371,53 @@ private:
       throw std::runtime_error("Failed to create pipeline layout!");
     }
 
-    VkPipelineDepthStencilStateCreateInfo depthStencil{};
-    depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthStencil.depthTestEnable = VK_TRUE;
-    depthStencil.depthWriteEnable = VK_TRUE;
-
-    depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
-    depthStencil.depthBoundsTestEnable = VK_FALSE;
-    depthStencil.minDepthBounds = 0.0f;
-    depthStencil.maxDepthBounds = 1.0f;
-
-    depthStencil.stencilTestEnable = VK_FALSE;
-    depthStencil.front = {};
-    depthStencil.back = {};
-
-    VkGraphicsPipelineCreateInfo pipelineInfo{};
-    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineInfo.stageCount = 2;
-    pipelineInfo.pStages = shaderStages;
-
-    pipelineInfo.pVertexInputState = &vertexInputInfo;
-    pipelineInfo.pInputAssemblyState = &inputAssembly;
-    pipelineInfo.pViewportState = &viewportState;
-    pipelineInfo.pRasterizationState = &rasterizer;
-    pipelineInfo.pMultisampleState = &multisampling;
-    pipelineInfo.pDepthStencilState = &depthStencil;
-    pipelineInfo.pColorBlendState = &colorBlending;
-    pipelineInfo.pDynamicState = &dynamicState;
-
-    pipelineInfo.layout = pipelineLayout;
-
-    pipelineInfo.renderPass = renderPass;
-    pipelineInfo.subpass = 0;
-    
-    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
-    pipelineInfo.basePipelineIndex = -1;
-
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &graphicsPipeline) != VK_SUCCESS){
-      throw std::runtime_error("failed to create graphics pipeline!");
+    bool packedVertices = config.vertexFormat == VertexFormat::Packed16;
+    auto attributeDescriptions = packedVertices ? PackedVertex::getAtrributeDescription() : Vertex::getAtrributeDescription();
+
+    GraphicsPipelineDesc desc;
+    desc.vertexShader = "shaders/shader.vert.spv";
+    desc.fragmentShader = "shaders/shader.frag.spv";
+    auto instanceAttributeDescriptions = InstanceData::getAtrributeDescription();
+    desc.bindings = {packedVertices ? PackedVertex::getBindingDescription() : Vertex::getBindingDescription(),
+                     InstanceData::getBindingDescription()};
+    desc.attributes.assign(attributeDescriptions.begin(), attributeDescriptions.end());
+    desc.attributes.insert(desc.attributes.end(), instanceAttributeDescriptions.begin(), instanceAttributeDescriptions.end());
+    desc.samples = msaaSamples;
+    desc.layout = pipelineLayout;
+    desc.renderPass = renderPass;
+    if(config.wireframe){
+      if(fillModeNonSolid){
+        desc.polygonMode = VK_POLYGON_MODE_LINE;
+        desc.cullMode = VK_CULL_MODE_NONE;
+      } else {
+        std::cout << "fillModeNonSolid is not supported, ignoring --wireframe" << std::endl;
+      }
     }
 
-    vkDestroyShaderModule(device, vertShaderModule, nullptr);
-    vkDestroyShaderModule(device, fragShaderModule, nullptr);
-  }
+    // minimal state variant compiled right away, frames are drawn with it until the full pipeline is ready
+    fallbackPipeline = pipelineRegistry->getNow(desc);
+    std::cout << "fallback pipeline created in " << fallbackPipeline.wait().compileMs << " ms ("
+              << (!pipelineCache ? "no cache" : pipelineCache->warm() ? "warm cache" : "cold cache") << ")" << std::endl;
 
-  VkShaderModule createShaderModule(const std::vector<char>& code){
-    VkShaderModuleCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    createInfo.codeSize = code.size();
-    createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+    desc.alphaBlend = true;
+    desc.minSampleShading = .2f;
+    graphicsPipeline = pipelineRegistry->get(desc);
+  }
 
-    VkShaderModule shaderModule;
-    if (vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS){
-      throw std::runtime_error("Could not create shader module!");
+  void createPipelineCache(){
+    if(config.pipelineCachePath.empty()){
+      return;
     }
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    pipelineCache = std::make_unique<PipelineCache>(device, properties, config.pipelineCachePath);
+    std::cout << "pipeline cache " << config.pipelineCachePath << ": " << pipelineCache->loadStatus() << std::endl;
+  }
 
-    return shaderModule;
+  void createPipelineCompiler(){
+    pipelineCompiler = std::make_unique<PipelineCompiler>(device, pipelineCache ? pipelineCache->handle() : VK_NULL_HANDLE,
+                                                          workers);
+    pipelineRegistry = std::make_unique<PipelineRegistry>(*pipelineCompiler);
   }
 
   void createRenderPass(){
@@ -1067,7 +1458,8 @@ private:
     colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    // offscreen targets are only ever copied out, swapchain images are presented
+    colorAttachmentResolve.finalLayout = config.headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     VkAttachmentReference colorAttachmentResolveRef{};
     colorAttachmentResolveRef.attachment = 2;
@@ -1145,14 +1537,14 @@ private:
   }
 
   void createCommandBuffers(){
-    commandBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    commandBuffers.resize(framesInFlight);
     VkCommandBufferAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.commandPool = commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = (uint32_t) commandBuffers.size();
 
-    if (vkAllocateCommandBuffers(device, &allocInfo, &commandBuffers[currentFrame]) != VK_SUCCESS){
+    if (vkAllocateCommandBuffers(device, &allocInfo, commandBuffers.data()) != VK_SUCCESS){
       throw std::runtime_error("Failed to create command buffers!");
     }
   }
@@ -1171,6 +1563,65 @@ private:
       throw std::runtime_error("Failed to begin recording command buffer!");
     }
 
+    uint32_t frameScope = 0;
+    if(gpuProfiler){
+      gpuProfiler->beginFrame(commandBuffer, currentFrame);
+      frameScope = gpuProfiler->beginScope(commandBuffer, "frame");
+    }
+
+    // take ownership of whatever the transfer queue finished since the last frame
+    uploader->acquire(commandBuffer, uploadWaits[currentFrame]);
+
+    if(gpuCuller){
+      CpuTraceScope traceScope("cull");
+      uint32_t cullScope = gpuProfiler ? gpuProfiler->beginScope(commandBuffer, "cull") : 0;
+      Frustum frustum = extractFrustum(frameUbo.proj * frameUbo.view);
+      BoundingSphere sphere = transformSphere(frameUbo.model, modelBounds);
+      std::optional<uint32_t> reference;
+      if(config.verifyCulling){
+        reference = cullInstancesCpu(frustum, sphere, instances);
+      }
+      gpuCuller->record(commandBuffer, currentFrame, frustum, sphere, reference);
+      if(gpuProfiler){
+        gpuProfiler->endScope(commandBuffer, cullScope);
+      }
+    }
+    if(cpuCuller){
+      CpuTraceScope traceScope("cpu cull");
+      BoundingSphere sphere = transformSphere(frameUbo.model, modelBounds);
+      workers.parallelFor(instances.size(), CpuCuller::CHUNK_SIZE, [&](size_t begin, size_t end){
+        for(size_t i = begin; i < end; i++){
+          instanceSpheres.set(i, transformSphere(instances[i].model, sphere));
+        }
+      });
+      cpuCuller->setCamera(frameUbo.proj * frameUbo.view);
+      cpuCuller->cull(instanceSpheres, visibleInstances);
+      cpuCullingStats.frames++;
+      cpuCullingStats.tested += instances.size();
+      cpuCullingStats.drawn += visibleInstances.size();
+    }
+    if(config.lodSelection){
+      CpuTraceScope traceScope("lod select");
+      selectLods();
+    }
+    if(meshletCuller){
+      CpuTraceScope traceScope("meshlet cull");
+      uint32_t cullScope = gpuProfiler ? gpuProfiler->beginScope(commandBuffer, "meshlet cull") : 0;
+      // the meshlet bounds stay in model space, the frustum and camera are moved there instead
+      glm::mat4 modelView = frameUbo.view * instances[0].model * frameUbo.model;
+      Frustum frustum = extractFrustum(frameUbo.proj * modelView);
+      glm::vec3 camera = glm::vec3(glm::inverse(modelView)[3]);
+      std::optional<uint32_t> reference;
+      if(config.verifyCulling){
+        reference = cullMeshletsCpu(frustum, camera, meshletCuller->usesConeCulling(), meshCache.meshletData(),
+                                    meshCache.meshletCount());
+      }
+      meshletCuller->record(commandBuffer, currentFrame, frustum, camera, reference);
+      if(gpuProfiler){
+        gpuProfiler->endScope(commandBuffer, cullScope);
+      }
+    }
+
     VkRenderPassBeginInfo renderPassInfo{};
     renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassInfo.renderPass = renderPass;
@@ -1182,9 +1633,88 @@ private:
     renderPassInfo.clearValueCount = static_cast<uint32_t>(clearValues.size());
     renderPassInfo.pClearValues = clearValues.data();
 
-    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    if(!graphicsPipelineReported && graphicsPipeline.ready()){
+      graphicsPipelineReported = true;
+      std::cout << "graphics pipeline compiled in " << graphicsPipeline.wait().compileMs << " ms, replacing the fallback"
+                << std::endl;
+    }
+    VkPipeline pipeline = graphicsPipeline.getOr(fallbackPipeline.wait().pipeline);
+
+    uint32_t renderPassScope = gpuProfiler ? gpuProfiler->beginScope(commandBuffer, "render pass") : 0;
+    if(secondaryRecorder){
+      // timestamps can't be written inside a pass that only executes secondaries, "render pass" covers the draws
+      vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+      const std::vector<VkCommandBuffer>& secondaries = secondaryRecorder->record(
+        workers, currentFrame, renderPass, 0, swapChainFrambuffers[imageIndex], drawItemCount(),
+        [this, pipeline](VkCommandBuffer secondary, size_t begin, size_t end){ recordDraws(secondary, pipeline, begin, end); });
+      vkCmdExecuteCommands(commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
+    } else {
+      vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+      uint32_t drawScope = gpuProfiler ? gpuProfiler->beginScope(commandBuffer, "draw") : 0;
+      recordDraws(commandBuffer, pipeline, 0, drawItemCount());
+      if(gpuProfiler){
+        gpuProfiler->endScope(commandBuffer, drawScope);
+      }
+    }
 
-    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+    vkCmdEndRenderPass(commandBuffer);
+
+    if(gpuProfiler){
+      gpuProfiler->endScope(commandBuffer, renderPassScope);
+      gpuProfiler->endScope(commandBuffer, frameScope);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+      throw std::runtime_error("Failed to record command buffer!");
+    }
+  }
+
+  // Picks the level of every copy recordDraws will draw from the screen space
+  // size of its error: a world space distance of 1 at view distance 1 covers
+  // pixelsPerUnit pixels, so the error projects to error * pixelsPerUnit /
+  // distance. The distance is the nearest point of the bounding sphere, a copy
+  // the camera is inside gets full detail.
+  void selectLods(){
+    float pixelsPerUnit = 0.5f * static_cast<float>(swapChainExtent.height) * std::abs(frameUbo.proj[1][1]);
+    BoundingSphere sphere = transformSphere(frameUbo.model, modelBounds);
+    float scale = maxAxisScale(frameUbo.model);
+    size_t count = drawItemCount();
+    workers.parallelFor(count, LOD_SELECT_CHUNK_SIZE, [&](size_t begin, size_t end){
+      for(size_t i = begin; i < end; i++){
+        uint32_t instance = cpuCuller ? visibleInstances[i] : static_cast<uint32_t>(i);
+        const glm::mat4& model = instances[instance].model;
+        BoundingSphere instanceSphere = transformSphere(model, sphere);
+        float distance = glm::length(glm::vec3(frameUbo.view * glm::vec4(instanceSphere.center, 1.0f))) - instanceSphere.radius;
+        instanceLods[instance] = static_cast<uint8_t>(selectLod(meshCache.lodData(), meshCache.lodCount(),
+                                                                scale * maxAxisScale(model), std::max(distance, 0.0f),
+                                                                pixelsPerUnit, config.lodErrorPixels));
+      }
+    });
+
+    uint64_t drawnTriangles = 0;
+    for(size_t i = 0; i < count; i++){
+      uint32_t level = instanceLods[cpuCuller ? visibleInstances[i] : i];
+      drawnTriangles += meshCache.lod(level).indexCount / 3;
+      lodStats.levelDraws[level]++;
+    }
+    lodStats.frames++;
+    lodStats.fullTriangles += count * (meshCache.lod(0).indexCount / 3);
+    lodStats.drawnTriangles += drawnTriangles;
+    lodStats.minDrawnTriangles = std::min(lodStats.minDrawnTriangles, drawnTriangles);
+    lodStats.maxDrawnTriangles = std::max(lodStats.maxDrawnTriangles, drawnTriangles);
+  }
+
+  // what recordDraws splits into ranges: the single indirect draw, the visible indices or every instance
+  size_t drawItemCount() const {
+    if(gpuCuller || meshletCuller){
+      return 1;
+    }
+    return cpuCuller ? visibleInstances.size() : instances.size();
+  }
+
+  // binds everything itself, so it works for the primary and for secondaries that inherit no state
+  void recordDraws(VkCommandBuffer commandBuffer, VkPipeline pipeline, size_t begin, size_t end){
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
 
     VkViewport viewport{};
     viewport.x = 0.0f;
@@ -1200,28 +1730,85 @@ private:
     scissor.extent = swapChainExtent;
     vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-    VkBuffer vertexBuffers[] = {vertexBuffer};
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+    VkBuffer vertexBuffers[] = {vertexBuffer, gpuCuller ? gpuCuller->visibleInstances(currentFrame) : instanceBuffer};
+    VkDeviceSize offsets[] = {0, 0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
 
-    vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdBindIndexBuffer(commandBuffer, meshletCuller ? meshletCuller->visibleIndices(currentFrame) : indexBuffer, 0,
+                         VK_INDEX_TYPE_UINT32);
 
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
                             &descriptorSet[currentFrame], 0, nullptr);
-    vkCmdDrawIndexed(commandBuffer, static_cast<uint32_t>(indices.size()), 1, 0, 0, 0);
-
-    vkCmdEndRenderPass(commandBuffer);
-
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
-      throw std::runtime_error("Failed to record command buffer!");
+    if(gpuCuller){
+      // the culled draw is a single indirect command, recorded by whoever owns range 0
+      if(begin == 0){
+        gpuCuller->draw(commandBuffer, currentFrame);
+      }
+      return;
+    }
+    if(meshletCuller){
+      if(begin == 0){
+        meshletCuller->draw(commandBuffer, currentFrame);
+      }
+      return;
+    }
+    if(cpuCuller || config.lodSelection){
+      // visible indices ascend, so each run of consecutive copies at the same level is one instanced draw
+      auto instanceAt = [this](size_t i){ return cpuCuller ? visibleInstances[i] : static_cast<uint32_t>(i); };
+      auto levelOf = [this](uint32_t instance){ return config.lodSelection ? instanceLods[instance] : 0u; };
+      for(size_t i = begin; i < end;){
+        uint32_t first = instanceAt(i);
+        uint32_t level = levelOf(first);
+        size_t runEnd = i + 1;
+        while(config.instanced && runEnd < end && instanceAt(runEnd) == instanceAt(runEnd - 1) + 1
+              && levelOf(instanceAt(runEnd)) == level){
+          runEnd++;
+        }
+        const MeshLod& lod = meshCache.lod(level);
+        vkCmdDrawIndexed(commandBuffer, lod.indexCount, static_cast<uint32_t>(runEnd - i), lod.firstIndex, 0, first);
+        i = runEnd;
+      }
+      return;
+    }
+    // the full mesh is the first level
+    uint32_t indexCount = meshCache.lod(0).indexCount;
+    if(config.instanced){
+      vkCmdDrawIndexed(commandBuffer, indexCount, static_cast<uint32_t>(end - begin), 0, 0, static_cast<uint32_t>(begin));
+      return;
+    }
+    for(size_t i = begin; i < end; i++){
+      vkCmdDrawIndexed(commandBuffer, indexCount, 1, 0, 0, static_cast<uint32_t>(i));
     }
   }
 
   void drawFrame(){
-    vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    {
+      CpuTraceScope traceScope("vkWaitForFences");
+      vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX);
+    }
+    auto cpuStartTime = std::chrono::high_resolution_clock::now();
+    if(gpuProfiler){
+      gpuProfiler->collect(currentFrame);
+    }
+    if(gpuCuller){
+      gpuCuller->collect(currentFrame);
+    }
+    if(meshletCuller){
+      meshletCuller->collect(currentFrame);
+    }
+    uploader->collect();
+    uploader->recycle(uploadWaits[currentFrame]);
+    updateTextureBinding();
 
+    auto acquireStartTime = std::chrono::high_resolution_clock::now();
     uint32_t imageIndex;
-    VkResult result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    VkResult result = VK_SUCCESS;
+    if(config.headless){
+      imageIndex = static_cast<uint32_t>(renderedFrames % swapChainImages.size());
+    } else {
+      CpuTraceScope traceScope("vkAcquireNextImageKHR");
+      result = vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+    }
 
     if(result == VK_ERROR_OUT_OF_DATE_KHR) {
       recreateSwapChain();
@@ -1230,57 +1817,122 @@ private:
       throw std::runtime_error("failed to acquire swap chain image");
     }
 
-    updateUniformBuffer(currentFrame);
+    // with more frames in flight than swapchain images, an older frame may still be rendering into this one
+    if(imagesInFlight[imageIndex] != VK_NULL_HANDLE){
+      CpuTraceScope traceScope("wait for image");
+      vkWaitForFences(device, 1, &imagesInFlight[imageIndex], VK_TRUE, UINT64_MAX);
+    }
+    imagesInFlight[imageIndex] = inFlightFences[currentFrame];
+    auto acquireEndTime = std::chrono::high_resolution_clock::now();
+
+    {
+      CpuTraceScope traceScope("updateUniformBuffer");
+      updateUniformBuffer(currentFrame);
+    }
 
     vkResetFences(device, 1, &inFlightFences[currentFrame]);
 
-    vkResetCommandBuffer(commandBuffers[currentFrame], 0);
-    recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    {
+      CpuTraceScope traceScope("recordCommandBuffer");
+      vkResetCommandBuffer(commandBuffers[currentFrame], 0);
+      recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+    }
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-    VkSemaphore waitSemaphore[] = {imageAvailableSemaphores[currentFrame]};
-    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-    submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = waitSemaphore;
-    submitInfo.pWaitDstStageMask = waitStages;
+    std::vector<VkSemaphore>& waitSemaphore = submitWaitSemaphores;
+    std::vector<VkPipelineStageFlags>& waitStages = submitWaitStages;
+    waitSemaphore.clear();
+    waitStages.clear();
+    if(!config.headless){
+      waitSemaphore.push_back(imageAvailableSemaphores[currentFrame]);
+      waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    const UploadWaits& uploads = uploadWaits[currentFrame];
+    waitSemaphore.insert(waitSemaphore.end(), uploads.semaphores.begin(), uploads.semaphores.end());
+    waitStages.insert(waitStages.end(), uploads.stages.begin(), uploads.stages.end());
+    submitInfo.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphore.size());
+    submitInfo.pWaitSemaphores = waitSemaphore.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
     
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &commandBuffers[currentFrame];
 
     VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
-    submitInfo.signalSemaphoreCount = 1;
+    // without a present nothing would wait on it
+    submitInfo.signalSemaphoreCount = config.headless ? 0 : 1;
     submitInfo.pSignalSemaphores = signalSemaphores;
 
-    if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS){
-      throw std::runtime_error("Failed to submit draw command buffer!");
+    {
+      CpuTraceScope traceScope("vkQueueSubmit");
+      if(vkQueueSubmit(graphicsQueue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS){
+        throw std::runtime_error("Failed to submit draw command buffer!");
+      }
     }
-    
-    VkPresentInfoKHR presentInfo{};
-    presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    auto cpuEndTime = std::chrono::high_resolution_clock::now();
+    lastCpuMs = std::chrono::duration<double, std::milli>((acquireStartTime - cpuStartTime) + (cpuEndTime - acquireEndTime)).count();
+    renderedFrames++;
+    lastImageIndex = imageIndex;
 
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = signalSemaphores;
+    if(!config.headless){
+      VkPresentInfoKHR presentInfo{};
+      presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
 
-    VkSwapchainKHR swapChains[] = {swapChain};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = swapChains;
-    presentInfo.pImageIndices = &imageIndex;
+      presentInfo.waitSemaphoreCount = 1;
+      presentInfo.pWaitSemaphores = signalSemaphores;
 
-    presentInfo.pResults = nullptr;
+      VkSwapchainKHR swapChains[] = {swapChain};
+      presentInfo.swapchainCount = 1;
+      presentInfo.pSwapchains = swapChains;
+      presentInfo.pImageIndices = &imageIndex;
 
-    vkQueuePresentKHR(presentQueue, &presentInfo);
+      presentInfo.pResults = nullptr;
 
-    if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
-      recreateSwapChain();
-      return;
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR){
-      throw std::runtime_error("failed to present swap chain image");
+      {
+        CpuTraceScope traceScope("vkQueuePresentKHR");
+        result = vkQueuePresentKHR(presentQueue, &presentInfo);
+      }
+
+      if(result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
+        recreateSwapChain();
+        return;
+      } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR){
+        throw std::runtime_error("failed to present swap chain image");
+      }
     }
 
-    currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+    currentFrame = (currentFrame + 1) % framesInFlight;
 
+    if(framePacer){
+      uint32_t frames = framePacer->addSample(framesInFlight, lastCpuMs, gpuProfiler->lastMs("frame"));
+      if(frames != framesInFlight){
+        const FramePacingStats& stats = framePacer->lastWindow();
+        std::cout << "frame pacing: cpu " << stats.cpuMeanMs << " ms (p95 " << stats.cpuP95Ms << " ms), gpu "
+                  << stats.gpuMeanMs << " ms, " << framesInFlight << " -> " << frames << " frames in flight" << std::endl;
+        setFramesInFlight(frames);
+      }
+    }
+  }
+
+  // copies of the model on a square grid scaled to the footprint of one, a single object is the plain model
+  void createInstances(){
+    uint32_t side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(config.objectCount))));
+    float spacing = 2.0f / side;
+
+    instances.clear();
+    instances.reserve(config.objectCount);
+    for(uint32_t i = 0; i < config.objectCount; i++){
+      glm::vec3 offset((i % side + 0.5f) * spacing - 1.0f, (i / side + 0.5f) * spacing - 1.0f, 0.0f);
+      instances.push_back(InstanceData{glm::scale(glm::translate(glm::mat4(1.0f), offset), glm::vec3(1.0f / side))});
+    }
+    if(config.lodSelection){
+      instanceLods.assign(instances.size(), 0);
+    }
+    std::cout << "drawing " << config.objectCount << " objects with "
+              << (config.instanced ? "instanced draws, " : "one draw per object, ")
+              << (config.recordThreads > 0 ? "recorded into " + std::to_string(config.recordThreads) + " secondary command buffers"
+                                           : std::string("recorded inline")) << std::endl;
   }
 
   void updateUniformBuffer(uint32_t currentImage) {
@@ -1288,21 +1940,123 @@ private:
 
     auto currentTime = std::chrono::high_resolution_clock::now();
     float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+    glm::vec3 eye(2.0f, 2.0f, 2.0f);
+    if(config.deterministic){
+      time = renderedFrames * DETERMINISTIC_FRAME_SECONDS;
+      // slow orbit with a height sweep, so a run covers near, far and grazing views of the model
+      float angle = time * glm::radians(20.0f);
+      eye = glm::vec3(2.8f * std::cos(angle), 2.8f * std::sin(angle), 1.0f + 1.5f * std::sin(time * 0.3f));
+    }
 
     UniformBufferObject ubo{};
     ubo.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
-    ubo.view = glm::lookAt(glm::vec3(2.0f, 2.0f, 2.0f), glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    ubo.view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
     ubo.proj = glm::perspective(glm::radians(45.0f), swapChainExtent.width / (float) swapChainExtent.height, 0.1f, 10.0f);
 
     ubo.proj[1][1] *= -1;
+
+    const float* dequant = meshCache.header().positionDequant;
+    ubo.positionOffset = glm::vec4(dequant[0], dequant[1], dequant[2], 0.0f);
+    ubo.positionScale = glm::vec4(dequant[3], dequant[4], dequant[5], 0.0f);
     
     memcpy(uniformBuffersMapped[currentFrame], &ubo, sizeof(ubo));
+    frameUbo = ubo;
+  }
+
+  void createGpuProfiler(){
+    // frame stats of runs with a frame limit include GPU time
+    if(!config.framePacing && config.gpuProfilePath.empty() && config.frameLimit == 0){
+      return;
+    }
+
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
+    uint32_t timestampValidBits = queueFamilies[indices.graphicsFamily.value()].timestampValidBits;
+
+    if(timestampValidBits == 0){
+      std::cout << "no timestamp queries on the graphics queue, GPU profiling and frame pacing are disabled, keeping "
+                << framesInFlight << " frames in flight" << std::endl;
+      return;
+    }
+
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    gpuProfiler = std::make_unique<GpuProfiler>(device, framesInFlight, properties.limits.timestampPeriod, timestampValidBits);
+    if(config.framePacing){
+      framePacer = std::make_unique<FramePacer>(MIN_FRAMES_IN_FLIGHT, MAX_FRAMES_IN_FLIGHT);
+    }
+  }
+
+  // everything that is sized by framesInFlight
+  void createFrameResources(){
+    createUniformBuffers();
+    createDescriptorPool();
+    createDescriptorSet();
+    createCommandBuffers();
+    createSyncObjects();
+    if(config.recordThreads > 0){
+      QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+      secondaryRecorder = std::make_unique<SecondaryRecorder>(device, indices.graphicsFamily.value(), framesInFlight,
+                                                              config.recordThreads);
+    }
+  }
+
+  void cleanupFrameResources(){
+    secondaryRecorder.reset();
+
+    for(size_t i = 0; i < framesInFlight; i++){
+      vkDestroyBuffer(device, uniformBuffers[i], nullptr);
+      allocator->free(uniformBuffersMemory[i]);
+    }
+
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+
+    vkFreeCommandBuffers(device, commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+
+    for(size_t i = 0; i < framesInFlight; i++){
+      vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+      vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+      vkDestroyFence(device, inFlightFences[i], nullptr);
+    }
+  }
+
+  void setFramesInFlight(uint32_t count){
+    vkDeviceWaitIdle(device);
+    for(UploadWaits& waits : uploadWaits){
+      uploader->recycle(waits);
+    }
+    if(gpuProfiler){
+      for(uint32_t i = 0; i < framesInFlight; i++){
+        gpuProfiler->collect(i);
+      }
+      gpuProfiler->setFrameCount(count);
+    }
+    if(gpuCuller){
+      for(uint32_t i = 0; i < framesInFlight; i++){
+        gpuCuller->collect(i);
+      }
+    }
+    if(meshletCuller){
+      for(uint32_t i = 0; i < framesInFlight; i++){
+        meshletCuller->collect(i);
+      }
+    }
+
+    cleanupFrameResources();
+    framesInFlight = count;
+    currentFrame = 0;
+    createFrameResources();
+    std::fill(imagesInFlight.begin(), imagesInFlight.end(), VK_NULL_HANDLE);
   }
 
   void createSyncObjects(){
-    imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-    inFlightFences.resize(MAX_FRAMES_IN_FLIGHT);
+    imageAvailableSemaphores.resize(framesInFlight);
+    renderFinishedSemaphores.resize(framesInFlight);
+    inFlightFences.resize(framesInFlight);
+    uploadWaits.resize(framesInFlight);
 
     VkSemaphoreCreateInfo semaphoreInfo{};
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
@@ -1311,7 +2065,7 @@ private:
     fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
     fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++){
+    for(size_t i = 0; i < framesInFlight; i++){
       if ( vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]) != VK_SUCCESS 
           || vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]) != VK_SUCCESS 
           || vkCreateFence(device, &fenceInfo, nullptr, &inFlightFences[i]) != VK_SUCCESS
@@ -1324,74 +2078,189 @@ private:
   void createUniformBuffers() {
     VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-    uniformBuffers.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMemory.resize(MAX_FRAMES_IN_FLIGHT);
-    uniformBuffersMapped.resize(MAX_FRAMES_IN_FLIGHT);
+    uniformBuffers.resize(framesInFlight);
+    uniformBuffersMemory.resize(framesInFlight);
+    uniformBuffersMapped.resize(framesInFlight);
 
-    for(size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++){
+    for(size_t i = 0; i < framesInFlight; i++){
       createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT
                    | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i], uniformBuffersMemory[i]);
-      vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
+      uniformBuffersMapped[i] = uniformBuffersMemory[i].mapped;
     }
   }
 
   void createIndexBuffer(){
-    VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+    VkDeviceSize bufferSize = meshCache.indexDataSize();
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
-                 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    // the meshlet culling pass reads the indices it compacts, before any draw does
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    VkAccessFlags dstAccess = VK_ACCESS_INDEX_READ_BIT;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    if(config.meshletCulling){
+      usage |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+      dstAccess |= VK_ACCESS_SHADER_READ_BIT;
+      dstStage |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    createBuffer(bufferSize, usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, indices.data(), (size_t) bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    uploader->uploadBuffer(indexBuffer, 0, meshCache.indexData(), bufferSize, dstAccess, dstStage);
+  }
 
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, indexBuffer, indexBufferMemory);
+  // binding 1, read once per instance, so an instanced draw covers any range of copies
+  void createInstanceBuffer(){
+    VkDeviceSize bufferSize = sizeof(InstanceData) * instances.size();
 
-    copyBuffer(stagingBuffer, indexBuffer, bufferSize);
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT
+                 | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, instanceBuffer, instanceBufferMemory);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    // the culling pass reads the transforms as a storage buffer before any draw does
+    VkAccessFlags dstAccess = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT;
+    if(config.gpuCulling){
+      dstAccess |= VK_ACCESS_SHADER_READ_BIT;
+      dstStage |= VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    }
+    uploader->uploadBuffer(instanceBuffer, 0, instances.data(), bufferSize, dstAccess, dstStage);
   }
 
-  void createVertexBuffer(){
-    VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
+  void createGpuCuller(){
+    if(!config.gpuCulling){
+      return;
+    }
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+    if(drawIndirectCount){
+      drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    // one slot per possible frame in flight, so changing the count keeps the culler
+    gpuCuller = std::make_unique<GpuCuller>(device, *allocator, pipelineCache ? pipelineCache->handle() : VK_NULL_HANDLE,
+                                            CULL_SHADER_PATH, instanceBuffer, static_cast<uint32_t>(instances.size()),
+                                            meshCache.lod(0).indexCount, MAX_FRAMES_IN_FLIGHT, drawIndexedIndirectCount);
+    std::cout << "gpu culling " << instances.size() << " instances, drawn with "
+              << (gpuCuller->usesDrawIndirectCount() ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect")
+              << std::endl;
+  }
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
-                 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+  void createCpuCuller(){
+    if(!config.cpuCulling){
+      return;
+    }
+    cpuCuller = std::make_unique<CpuCuller>(&workers);
+    instanceSpheres.resize(instances.size());
+    visibleInstances.reserve(instances.size());
+    std::cout << "cpu culling " << instances.size() << " instances, " << (cpuCuller->usesAvx2() ? "AVX2" : "scalar")
+              << " on " << workers.size() << " workers" << std::endl;
+  }
+
+  void createMeshletCuller(){
+    if(!config.meshletCulling){
+      return;
+    }
+    if(meshCache.meshletCount() == 0){
+      throw std::runtime_error("mesh cache has no meshlets to cull!");
+    }
+    VkDeviceSize bufferSize = meshCache.meshletDataSize();
+    createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, meshletBuffer, meshletBufferMemory);
+    uploader->uploadBuffer(meshletBuffer, 0, meshCache.meshletData(), bufferSize,
+                           VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    PFN_vkCmdDrawIndexedIndirectCountKHR drawIndexedIndirectCount = nullptr;
+    if(drawIndirectCount){
+      drawIndexedIndirectCount = reinterpret_cast<PFN_vkCmdDrawIndexedIndirectCountKHR>(
+        vkGetDeviceProcAddr(device, "vkCmdDrawIndexedIndirectCountKHR"));
+    }
+    // wireframe draws back faces too, so only the frustum is tested then
+    bool coneCulling = !(config.wireframe && fillModeNonSolid);
+    meshletCuller = std::make_unique<MeshletCuller>(device, *allocator, pipelineCache ? pipelineCache->handle() : VK_NULL_HANDLE,
+                                                    MESHLET_CULL_SHADER_PATH, meshletBuffer, meshCache.meshletCount(),
+                                                    indexBuffer, meshCache.lod(0).indexCount, static_cast<uint32_t>(instances.size()),
+                                                    coneCulling, MAX_FRAMES_IN_FLIGHT, drawIndexedIndirectCount);
+    std::cout << "meshlet culling " << meshCache.meshletCount() << " meshlets, "
+              << (coneCulling ? "frustum and backface" : "frustum only") << ", drawn with "
+              << (meshletCuller->usesDrawIndirectCount() ? "vkCmdDrawIndexedIndirectCount" : "vkCmdDrawIndexedIndirect")
+              << std::endl;
+  }
+
+  // culling stats of every frame, each slot has completed by now
+  void reportCulling(){
+    if(gpuCuller){
+      for(uint32_t i = 0; i < framesInFlight; i++){
+        gpuCuller->collect(i);
+      }
+      reportCullingStats("gpu culling", "instances", gpuCuller->statistics());
+    }
+    if(cpuCuller){
+      reportCullingStats("cpu culling", "instances", cpuCullingStats);
+    }
+    if(meshletCuller){
+      for(uint32_t i = 0; i < framesInFlight; i++){
+        meshletCuller->collect(i);
+      }
+      reportCullingStats("meshlet culling", "indices", meshletCuller->statistics());
+    }
+  }
+
+  void reportLodSelection(){
+    if(lodStats.frames == 0){
+      return;
+    }
+    double drawnPercent = lodStats.fullTriangles > 0 ? 100.0 * lodStats.drawnTriangles / lodStats.fullTriangles : 0.0;
+    std::cout << "lod selection: drew " << lodStats.drawnTriangles / lodStats.frames << " of "
+              << lodStats.fullTriangles / lodStats.frames << " triangles per frame on average (" << drawnPercent
+              << "%), " << lodStats.minDrawnTriangles << " to " << lodStats.maxDrawnTriangles << " per frame over "
+              << lodStats.frames << " frames" << std::endl;
+    std::cout << "lod selection: copies drawn per level";
+    for(uint32_t level = 0; level < meshCache.lodCount(); level++){
+      std::cout << " " << level << ": " << lodStats.levelDraws[level];
+    }
+    std::cout << std::endl;
+  }
+
+  static void reportCullingStats(const char* name, const char* unit, const CullingStats& stats){
+    if(stats.frames == 0){
+      return;
+    }
+    double drawnPercent = stats.tested > 0 ? 100.0 * stats.drawn / stats.tested : 0.0;
+    std::cout << name << ": drew " << stats.drawn / stats.frames << " of " << stats.tested / stats.frames
+              << " " << unit << " per frame on average (" << 100.0 - drawnPercent << "% culled) over " << stats.frames
+              << " frames" << std::endl;
+    if(stats.referenceFrames > 0){
+      std::cout << name << ": cpu reference disagreed on " << stats.referenceMismatches << " of " << stats.referenceFrames
+                << " frames" << std::endl;
+    }
+  }
+
+  void createVertexBuffer(){
+    VkDeviceSize bufferSize = meshCache.vertexDataSize();
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, vertices.data(), (size_t) bufferSize); 
-    vkUnmapMemory(device, stagingBufferMemory);
-    
     createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, vertexBuffer, vertexBufferMemory);
-    copyBuffer(stagingBuffer, vertexBuffer, bufferSize);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    uploader->uploadBuffer(vertexBuffer, 0, meshCache.vertexData(), bufferSize,
+                           VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
   }
 
-  uint32_t findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties){
+  void createUploader(){
+    QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+    uint32_t uploadFamily = indices.transferFamily.value_or(indices.graphicsFamily.value());
+    uploader = std::make_unique<StagingUploader>(device, *allocator, transferQueue, uploadFamily, indices.graphicsFamily.value());
+    std::cout << "uploads on " << (uploader->transfersOwnership() ? "dedicated transfer" : "graphics")
+              << " queue family " << uploadFamily << std::endl;
+  }
+
+  void createAllocator(){
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
 
-    for(uint32_t i = 0; i < memProperties.memoryTypeCount; ++i){
-      if ((typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-        return i;
-      }
-    }
+    VkPhysicalDeviceProperties properties{};
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
 
-    throw std::runtime_error("Failed to find suitable memory type!");
+    allocator = std::make_unique<DeviceMemoryAllocator>(memProperties, properties.limits.bufferImageGranularity,
+                                                        DeviceMemoryBackend::vulkan(device));
   }
 
-  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties, VkBuffer& buffer, DeviceAllocation& bufferMemory) {
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = size;
@@ -1404,34 +2273,17 @@ private:
 
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-    
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
 
-    if(vkAllocateMemory(device, &allocInfo, nullptr, &bufferMemory) != VK_SUCCESS) {
-      throw std::runtime_error("failed to allocate vertex buffer memory!");
-    }
-
-    vkBindBufferMemory(device, buffer, bufferMemory, 0);
+    bufferMemory = allocator->allocate(memRequirements, properties, ResourceKind::Linear);
 
-  }
+    vkBindBufferMemory(device, buffer, bufferMemory.memory, bufferMemory.offset);
 
-void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-    VkBufferCopy copyRegion{};
-    copyRegion.size = size;
-    vkCmdCopyBuffer(commandBuffer, srcBuffer, dstBuffer, 1, &copyRegion);
-
-    endSingleTimeCommandBuffer(commandBuffer);
   }
 
   void cleanupSwapChain() {
     vkDestroyImageView(device, colorImageView, nullptr);
     vkDestroyImage(device, colorImage, nullptr);
-    vkFreeMemory(device, colorImageMemory, nullptr);
+    allocator->free(colorImageMemory);
 
     for(size_t i = 0; i < swapChainFrambuffers.size(); i++){
       vkDestroyFramebuffer(device, swapChainFrambuffers[i], nullptr);
@@ -1441,6 +2293,13 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
       vkDestroyImageView(device, swapChainImageViews[i], nullptr);
     }
 
+    if(config.headless){
+      for(size_t i = 0; i < swapChainImages.size(); i++){
+        vkDestroyImage(device, swapChainImages[i], nullptr);
+        allocator->free(offscreenImageMemory[i]);
+      }
+      return;
+    }
     vkDestroySwapchainKHR(device, swapChain, nullptr);
 
   }
@@ -1466,48 +2325,212 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
   }
 
   void createTextureImage() {
-    int texWidth, texHeight, texChannels;
-    stbi_uc* pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-
-    if(!pixels){
-      throw std::runtime_error("failed to load texture image!");
+    if(loadBakedTexture()){
+      return;
     }
 
+    // only the header is read here, the pixels are decoded on the worker pool
+    int texWidth, texHeight;
+    readImageInfo(TEXTURE_PATH, texWidth, texHeight);
+
+    // blitting needs linear filtering support, without it the CPU builds the chain
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_SRGB, &formatProperties);
+    bool linearBlit = formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    bool cpuMips = config.mipGeneration == MipGeneration::Cpu || !linearBlit;
+    textureDecode = decodeImageAsync(workers, TEXTURE_PATH, cpuMips);
+
     mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
 
-    createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT 
-                 | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer, stagingBufferMemory);
+    createPlaceholderTexture();
+  }
 
-    void* data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data);
-    memcpy(data, pixels, static_cast<uint32_t>(imageSize));
-    vkUnmapMemory(device, stagingBufferMemory);
+  // uploads the pre-encoded mip chain of a baked texture, returns false if the
+  // bake is missing, stale or the device can't sample its format
+  bool loadBakedTexture(){
+    auto startTime = std::chrono::high_resolution_clock::now();
 
-    stbi_image_free(pixels);
+    TextureContainer container;
+    if(!container.open(BAKED_TEXTURE_PATH, hashFile(TEXTURE_PATH))){
+      return false;
+    }
 
-    createImage(texWidth, texHeight, mipLevels, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 
-                VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+    VkFormat format = static_cast<VkFormat>(container.header().vkFormat);
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+    if(!textureCompressionBC || !(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)){
+      return false;
+    }
+
+    textureFormat = format;
+    mipLevels = container.header().levelCount;
+    createImage(container.header().width, container.header().height, mipLevels, VK_SAMPLE_COUNT_1_BIT, textureFormat,
+                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage, textureImageMemory);
 
-    VkCommandBuffer setupBuf = setupCommandBuffer();
+    // staged in one piece, so a baked texture can't exceed the ring (StagingUploader::DEFAULT_CAPACITY)
+    StagingRegion staging = uploader->allocate(container.dataSize());
+    memcpy(staging.mapped, container.data(), container.dataSize());
+
+    std::vector<VkBufferImageCopy> regions(mipLevels);
+    for(uint32_t i = 0; i < mipLevels; i++){
+      const TextureLevel& level = container.level(i);
+      regions[i].bufferOffset = staging.offset + level.offset;
+      regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      regions[i].imageSubresource.mipLevel = i;
+      regions[i].imageSubresource.baseArrayLayer = 0;
+      regions[i].imageSubresource.layerCount = 1;
+      regions[i].imageOffset = {0, 0, 0};
+      regions[i].imageExtent = {level.width, level.height, 1};
+    }
+
+    recordTextureLevelsUpload(staging, regions);
+    textureReady = true;
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::cout << "texture: baked " << BAKED_TEXTURE_PATH << " (" << mipLevels << " levels, "
+              << container.dataSize() / 1024 << " KiB) took "
+              << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms" << std::endl;
+    return true;
+  }
+
+  // 1x1 texture bound until the decoded one has been uploaded
+  void createPlaceholderTexture(){
+    const uint8_t pixel[4] = {128, 128, 128, 255};
+    StagingRegion staging = uploader->allocate(sizeof(pixel));
+    memcpy(staging.mapped, pixel, sizeof(pixel));
+
+    createImage(1, 1, 1, VK_SAMPLE_COUNT_1_BIT, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
+                VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, placeholderImage, placeholderImageMemory);
+
+    VkCommandBuffer setupBuf = uploader->commandBuffer();
+    transitionImageLayout(setupBuf, placeholderImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1);
+    copyBufferToImage(setupBuf, staging.buffer, staging.offset, placeholderImage, 1, 1);
+
+    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    uploader->releaseImage(placeholderImage, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    uploader->onGraphicsQueue([this](VkCommandBuffer commandBuffer){
+      transitionImageLayout(commandBuffer, placeholderImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 1);
+    });
+
+    placeholderImageView = createImageView(placeholderImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+  }
+
+  // one multi-region copy of every level, no blits needed afterwards
+  void recordTextureLevelsUpload(const StagingRegion& staging, const std::vector<VkBufferImageCopy>& regions){
+    VkCommandBuffer setupBuf = uploader->commandBuffer();
+    transitionImageLayout(setupBuf, textureImage, textureFormat, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
+    vkCmdCopyBufferToImage(setupBuf, staging.buffer, textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>(regions.size()), regions.data());
+
+    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+    uploader->releaseImage(textureImage, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+    uint32_t levels = mipLevels;
+    uploader->onGraphicsQueue([this, levels](VkCommandBuffer commandBuffer){
+      transitionImageLayout(commandBuffer, textureImage, textureFormat, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, levels);
+    });
+  }
+
+  void uploadTexture(const DecodedImage& image){
+    if(!image.mips.empty()){
+      uploadTextureWithMips(image);
+    } else {
+      uploadTextureGenerateMips(image);
+    }
+    uploader->flush();
+  }
+
+  // level 0 plus the chain the worker built
+  void uploadTextureWithMips(const DecodedImage& image){
+    std::vector<VkBufferImageCopy> regions(mipLevels);
+    std::vector<const uint8_t*> sources(mipLevels);
+    VkDeviceSize totalSize = 0;
+    for(uint32_t i = 0; i < mipLevels; i++){
+      uint32_t width = i == 0 ? static_cast<uint32_t>(image.width) : image.mips[i - 1].width;
+      uint32_t height = i == 0 ? static_cast<uint32_t>(image.height) : image.mips[i - 1].height;
+      sources[i] = i == 0 ? image.pixels.get() : image.mips[i - 1].pixels.data();
+
+      regions[i].bufferOffset = totalSize;
+      regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      regions[i].imageSubresource.mipLevel = i;
+      regions[i].imageSubresource.baseArrayLayer = 0;
+      regions[i].imageSubresource.layerCount = 1;
+      regions[i].imageOffset = {0, 0, 0};
+      regions[i].imageExtent = {width, height, 1};
+      totalSize += (static_cast<VkDeviceSize>(width) * height * 4 + 15) & ~VkDeviceSize(15);
+    }
+
+    // the whole chain is staged in one piece and has to fit the ring
+    StagingRegion staging = uploader->allocate(totalSize);
+    for(uint32_t i = 0; i < mipLevels; i++){
+      VkDeviceSize size = static_cast<VkDeviceSize>(regions[i].imageExtent.width) * regions[i].imageExtent.height * 4;
+      memcpy(static_cast<uint8_t*>(staging.mapped) + regions[i].bufferOffset, sources[i], static_cast<size_t>(size));
+      regions[i].bufferOffset += staging.offset;
+    }
+
+    recordTextureLevelsUpload(staging, regions);
+  }
+
+  // level 0 only, the chain is blitted on the graphics queue
+  void uploadTextureGenerateMips(const DecodedImage& image){
+    VkDeviceSize imageSize = image.byteSize();
+    int32_t texWidth = image.width;
+    int32_t texHeight = image.height;
+
+    // level 0 is staged in one piece and has to fit the ring
+    StagingRegion staging = uploader->allocate(imageSize);
+    memcpy(staging.mapped, image.pixels.get(), static_cast<size_t>(imageSize));
+
+    VkCommandBuffer setupBuf = uploader->commandBuffer();
 
     transitionImageLayout(setupBuf,textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels);
-    copyBufferToImage(setupBuf, stagingBuffer, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
-    generateMipmaps(setupBuf, textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, mipLevels);
+    copyBufferToImage(setupBuf, staging.buffer, staging.offset, textureImage, static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight));
+
+    VkImageSubresourceRange range{VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0, 1};
+    uploader->releaseImage(textureImage, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+    // blits need a graphics queue, transfer-only families can't generate the mips
+    uint32_t levels = mipLevels;
+    uploader->onGraphicsQueue([this, texWidth, texHeight, levels](VkCommandBuffer commandBuffer){
+      generateMipmaps(commandBuffer, textureImage, VK_FORMAT_R8G8B8A8_SRGB, texWidth, texHeight, levels);
+    });
+  }
 
-    flushSetupCommandBuffer(setupBuf);
+  // called once the frame's previous submit has finished, so its descriptor set
+  // is not in use and can be pointed at the decoded texture
+  void updateTextureBinding(){
+    if(textureDecode.valid() && textureDecode.wait_for(std::chrono::seconds(0)) == std::future_status::ready){
+      DecodedImage image = textureDecode.get();
+      uploadTexture(image);
+      textureReady = true;
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+      auto readyTime = std::chrono::high_resolution_clock::now();
+      std::cout << "texture: decoded in " << image.decodeMs << " ms on a worker, "
+                << (image.mips.empty() ? std::string("mips blitted on the GPU")
+                                       : "mips built on the CPU in " + std::to_string(image.mipMs) + " ms")
+                << ", uploaded "
+                << std::chrono::duration<double, std::milli>(readyTime - initStartTime).count()
+                << " ms after initVulkan started" << std::endl;
+    }
 
+    if(textureReady && !textureBound[currentFrame]){
+      writeTextureDescriptor(descriptorSet[currentFrame], textureImageView);
+      textureBound[currentFrame] = true;
+    }
   }
 
   void createImage(uint32_t width, uint32_t height, uint32_t mipLvls, VkSampleCountFlagBits numSamples, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage,
-                   VkMemoryPropertyFlags properties, VkImage& image, VkDeviceMemory& imageMemory) {
+                   VkMemoryPropertyFlags properties, VkImage& image, DeviceAllocation& imageMemory) {
     VkImageCreateInfo imageInfo{};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1530,16 +2553,12 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
     VkMemoryRequirements memRequirements;
     vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties);
-
-    if (vkAllocateMemory(device, &allocInfo, nullptr, &imageMemory) != VK_SUCCESS) {
-        throw std::runtime_error("failed to allocate image memory!");
-    }
+    // render targets are recreated with the swap chain, keep them out of the shared blocks
+    bool dedicated = usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
+    ResourceKind kind = tiling == VK_IMAGE_TILING_OPTIMAL ? ResourceKind::Optimal : ResourceKind::Linear;
+    imageMemory = allocator->allocate(memRequirements, properties, kind, dedicated);
 
-    vkBindImageMemory(device, image, imageMemory, 0);
+    vkBindImageMemory(device, image, imageMemory.memory, imageMemory.offset);
   }
 
   VkCommandBuffer beginSingleTimeCommands() {
@@ -1575,39 +2594,6 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
     vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
   }
 
-  VkCommandBuffer setupCommandBuffer() {
-    VkCommandBufferAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandPool = commandPool;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer commandBuffer;
-    vkAllocateCommandBuffers(device, &allocInfo, &commandBuffer);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-
-    vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
-    return commandBuffer;
-  }
-  
-  void flushSetupCommandBuffer(VkCommandBuffer commandBuffer) {
-    vkEndCommandBuffer(commandBuffer);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &commandBuffer;
-
-    vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(graphicsQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
-  }
-
   void transitionImageLayout(VkCommandBuffer commandBuffer, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout, uint32_t mipLvls){
 
     VkImageMemoryBarrier barrier{};
@@ -1670,10 +2656,10 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
 
   }
 
-  void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height){
+  void copyBufferToImage(VkCommandBuffer commandBuffer, VkBuffer buffer, VkDeviceSize bufferOffset, VkImage image, uint32_t width, uint32_t height){
 
     VkBufferImageCopy region{};
-    region.bufferOffset = 0;
+    region.bufferOffset = bufferOffset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
 
@@ -1690,7 +2676,7 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
   }
 
   void createTextureImageView(){
-    textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB,VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
+    textureImageView = createImageView(textureImage, textureFormat,VK_IMAGE_ASPECT_COLOR_BIT, mipLevels);
   }
 
   VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLvls){
@@ -1780,40 +2766,78 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
   }
 
   void loadModel(){
-    tinyobj::attrib_t attrib;
-    std::vector<tinyobj::shape_t> shapes;
-    std::vector<tinyobj::material_t> materials;
-    std::string err;
-    std::string warn;
+    auto startTime = std::chrono::high_resolution_clock::now();
+
+    bool packed = config.vertexFormat == VertexFormat::Packed16;
+    const std::string& cachePath = packed ? PACKED_MESH_CACHE_PATH : MESH_CACHE_PATH;
+    uint32_t vertexFormat = static_cast<uint32_t>(config.vertexFormat);
+    uint32_t vertexStride = packed ? sizeof(PackedVertex) : sizeof(Vertex);
+
+    uint64_t sourceHash = hashFile(MODEL_PATH);
+    bool cacheHit = meshCache.open(cachePath, sourceHash, vertexFormat, vertexStride);
+
+    if(!cacheHit){
+      std::vector<Vertex> vertices;
+      std::vector<uint32_t> indices;
+      loadObjModel(MODEL_PATH, vertices, indices, workers);
+
+      MeshOptimizationReport report = optimizeMesh(vertices, indices);
+      std::cout << "optimizeMesh: ACMR " << report.before.acmr << " -> " << report.after.acmr
+                << ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+
+      // the simplified levels are appended to indices and index the same vertices
+      std::vector<MeshLod> lods = buildLodChain(indices, vertices.size(), [&](uint32_t i){ return vertices[i].pos; });
+      uint32_t fullIndexCount = lods[0].indexCount;
+
+      std::vector<uint8_t> blob;
+      if(packed){
+        VertexQuantization quantization{};
+        std::vector<PackedVertex> packedVertices = packVertices(vertices, quantization);
+        std::vector<Meshlet> meshlets = buildMeshlets(indices, fullIndexCount, packedVertices.size(), [&](uint32_t i){
+          return unpackPosition(packedVertices[i], quantization);
+        });
+        blob = MeshCache::build(sourceHash, vertexFormat, packedVertices, indices, meshlets, lods,
+                                {quantization.offset.x, quantization.offset.y, quantization.offset.z,
+                                 quantization.scale.x, quantization.scale.y, quantization.scale.z});
+      } else {
+        std::vector<Meshlet> meshlets = buildMeshlets(indices, fullIndexCount, vertices.size(),
+                                                      [&](uint32_t i){ return vertices[i].pos; });
+        blob = MeshCache::build(sourceHash, vertexFormat, vertices, indices, meshlets, lods);
+      }
 
-    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str())) {
-      throw std::runtime_error(err);
+      if(!MeshCache::write(cachePath, blob)){
+        std::cerr << "failed to write mesh cache " << cachePath << std::endl;
+      }
+      if(!meshCache.open(cachePath, sourceHash, vertexFormat, vertexStride)
+         && !meshCache.open(std::move(blob), sourceHash, vertexFormat, vertexStride)){
+        throw std::runtime_error("failed to load mesh cache!");
+      }
     }
 
-    std::unordered_map<Vertex, uint32_t> uniqueVertices{};
-    
-    for (const auto& shape : shapes) {
-      for (const auto& index : shape.mesh.indices) {
-        Vertex vertex{};
-        vertex.pos = {
-          attrib.vertices[3 * index.vertex_index + 0],
-          attrib.vertices[3 * index.vertex_index + 1],
-          attrib.vertices[3 * index.vertex_index + 2]
-        };
-
-        vertex.texCoord = {
-          attrib.texcoords[2 * index.texcoord_index + 0],
-          1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
-        };
-
-        vertex.color = {1.0f, 1.0f, 1.0f};
-        if( uniqueVertices.count(vertex) == 0) {
-          uniqueVertices[vertex] = static_cast<uint32_t>(vertices.size());
-          vertices.push_back(vertex);
-        }
-        indices.push_back(uniqueVertices[vertex]);
+    const float* dequant = meshCache.header().positionDequant;
+    VertexQuantization quantization{glm::vec3(dequant[0], dequant[1], dequant[2]), glm::vec3(dequant[3], dequant[4], dequant[5])};
+    const uint8_t* vertexData = static_cast<const uint8_t*>(meshCache.vertexData());
+    modelBounds = computeBoundingSphere(meshCache.vertexCount(), [&](size_t i){
+      if(packed){
+        PackedVertex vertex;
+        memcpy(&vertex, vertexData + i * sizeof(PackedVertex), sizeof(vertex));
+        return unpackPosition(vertex, quantization);
       }
+      Vertex vertex;
+      memcpy(&vertex, vertexData + i * sizeof(Vertex), sizeof(vertex));
+      return vertex.pos;
+    });
+
+    auto endTime = std::chrono::high_resolution_clock::now();
+    std::cout << "loadModel: " << (cacheHit ? "warm mesh cache" : "cold OBJ import") << " took "
+              << std::chrono::duration<double, std::milli>(endTime - startTime).count() << " ms ("
+              << meshCache.vertexCount() << " vertices, " << meshCache.vertexDataSize() << " vertex bytes, "
+              << meshCache.indexCount() << " indices, " << meshCache.meshletCount() << " meshlets)" << std::endl;
+    std::cout << "levels of detail:";
+    for(uint32_t level = 0; level < meshCache.lodCount(); level++){
+      std::cout << " " << meshCache.lod(level).indexCount / 3 << " triangles (error " << meshCache.lod(level).error << ")";
     }
+    std::cout << std::endl;
   }
 
   void generateMipmaps(VkCommandBuffer commandBuffer, VkImage image, VkFormat imageFormat, int32_t texWidth, int32_t texHeight, uint32_t mipLvls){
@@ -1860,7 +2884,7 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
       blit.srcSubresource.layerCount = 1;
 
       blit.dstOffsets[0] = {0, 0, 0};
-      blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth/2 : 1, mipHeight > 1 ? mipWidth/2 : 1, 1};
+      blit.dstOffsets[1] = {mipWidth > 1 ? mipWidth/2 : 1, mipHeight > 1 ? mipHeight/2 : 1, 1};
       blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
       blit.dstSubresource.mipLevel = i;
       blit.dstSubresource.baseArrayLayer = 0;
@@ -1887,7 +2911,7 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
       if(mipHeight > 1) mipHeight /= 2;
     }
 
-    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    barrier.subresourceRange.baseMipLevel = mipLvls - 1;
     barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
     barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
@@ -1929,10 +2953,120 @@ void copyBuffer(VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize size) {
 };
 
 
-int main() {
-  HelloTriangleApplication app;
+#ifdef VK_BENCH
+// replaced in the vk_bench build to count heap allocations per frame
+void* operator new(std::size_t size){
+  heapAllocationCounter().fetch_add(1, std::memory_order_relaxed);
+  if(void* p = std::malloc(size == 0 ? 1 : size)){
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
 
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+static FrameStatsSummary runBenchApp(std::vector<std::string> args){
+  std::vector<char*> argv;
+  for(std::string& arg : args){
+    argv.push_back(arg.data());
+  }
+  HelloTriangleApplication app(parseArgs(static_cast<int>(argv.size()), argv.data()));
+  app.run();
+  return app.frameSummary();
+}
+
+// Reproducible benchmark: headless, frame-indexed animation, 60 warmup and 600
+// measured frames unless overridden. Fails when a metric regresses past the
+// baseline by more than the tolerance. --sweep-objects instead runs once per
+// object count from 1 to 100k and prints how frame cost scales.
+//   vk_bench [--baseline=path] [--update-baseline] [--tolerance=0.1] [--sweep-objects] [VK_tutorial options]
+int main(int argc, char** argv) {
+  std::string baselinePath;
+  bool updateBaseline = false;
+  double tolerance = 0.1;
+  bool sweepObjects = false;
+  // user options come after the defaults and override them
+  std::vector<std::string> appArgs = {argv[0], "--headless", "--deterministic", "--warmup=60", "--frames=600"};
+  for(int i = 1; i < argc; i++){
+    std::string arg = argv[i];
+    if(arg.rfind("--baseline=", 0) == 0){
+      baselinePath = arg.substr(strlen("--baseline="));
+    } else if(arg == "--update-baseline"){
+      updateBaseline = true;
+    } else if(arg.rfind("--tolerance=", 0) == 0){
+      tolerance = std::strtod(arg.c_str() + strlen("--tolerance="), nullptr);
+    } else if(arg == "--sweep-objects"){
+      sweepObjects = true;
+    } else {
+      appArgs.push_back(arg);
+    }
+  }
+
+  try {
+    if(updateBaseline && baselinePath.empty()){
+      throw std::invalid_argument("--update-baseline needs --baseline=path");
+    }
+    if(sweepObjects){
+      if(!baselinePath.empty()){
+        throw std::invalid_argument("--sweep-objects is not checked against a baseline");
+      }
+      std::vector<std::pair<uint32_t, FrameStatsSummary>> results;
+      for(uint32_t objects = 1; objects <= 100000; objects *= 10){
+        std::vector<std::string> runArgs = appArgs;
+        runArgs.push_back("--objects=" + std::to_string(objects));
+        results.emplace_back(objects, runBenchApp(runArgs));
+      }
+      std::cout << "objects, frame p50 ms, frame p95 ms, cpu ms, gpu ms, allocations/frame" << std::endl;
+      for(const auto& [objects, result] : results){
+        std::cout << objects << ", " << result.frameP50Ms << ", " << result.frameP95Ms << ", " << result.cpuMeanMs << ", "
+                  << result.gpuMeanMs << ", " << result.allocationsPerFrame << std::endl;
+      }
+      return EXIT_SUCCESS;
+    }
+    FrameStatsSummary summary = runBenchApp(appArgs);
+
+    if(baselinePath.empty()){
+      return EXIT_SUCCESS;
+    }
+    if(updateBaseline){
+      std::string text = formatBaseline(summary, "vk_bench baseline over " + std::to_string(summary.frames) + " frames");
+      if(!writeFileAtomic(baselinePath, std::vector<uint8_t>(text.begin(), text.end()))){
+        throw std::runtime_error("failed to write baseline " + baselinePath);
+      }
+      std::cout << "baseline written to " << baselinePath << std::endl;
+      return EXIT_SUCCESS;
+    }
+
+    std::ifstream file(baselinePath);
+    if(!file.is_open()){
+      throw std::runtime_error("no baseline at " + baselinePath + ", record one with --update-baseline");
+    }
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::vector<std::string> regressions = checkBaseline(summary, parseBaseline(text), tolerance);
+    for(const std::string& regression : regressions){
+      std::cerr << "regression: " << regression << std::endl;
+    }
+    if(!regressions.empty()){
+      return EXIT_FAILURE;
+    }
+    std::cout << "no regressions against " << baselinePath << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+#else
+int main(int argc, char** argv) {
   try {
+    HelloTriangleApplication app(parseArgs(argc, argv));
     app.run();
   } catch (const std::exception &e) {
     std::cerr << e.what() << std::endl;
@@ -1941,3 +3075,4 @@ int main() {
 
   return EXIT_SUCCESS;
 }
+#endif
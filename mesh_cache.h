@@ -0,0 +1,330 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Binary mesh cache written after the first OBJ import. The file is laid out as
+//   MeshCacheHeader | vertex array | uint32_t index array | Meshlet array
+// with every section aligned so the mapped arrays can be memcpy'd straight into
+// staging memory without any parsing. The index array holds every level of
+// detail back to back, all of them indexing the one vertex array.
+constexpr uint32_t MESH_CACHE_MAGIC = 0x434d4b56; // "VKMC"
+constexpr uint32_t MESH_CACHE_VERSION = 5;
+constexpr uint64_t MESH_CACHE_ALIGNMENT = 16;
+constexpr uint32_t MESH_CACHE_MAX_LODS = 5;
+
+// one level of detail, a range of the index array; level 0 is the full mesh
+struct MeshLod{
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  // simplification error in model units, 0 for the full mesh
+  float error;
+  uint32_t padding;
+};
+
+struct MeshCacheHeader{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t vertexStride;
+  uint32_t vertexCount;
+  uint32_t indexCount;
+  uint32_t vertexFormat;
+  uint64_t vertexOffset;
+  uint64_t indexOffset;
+  uint64_t fileSize;
+  // dequantization for packed positions, offset xyz then scale xyz
+  float positionDequant[6];
+  uint32_t meshletCount;
+  uint64_t meshletOffset;
+  uint32_t lodCount;
+  uint32_t padding;
+  MeshLod lods[MESH_CACHE_MAX_LODS];
+};
+
+// A cluster of at most 64 vertices and 124 triangles of level 0, its triangles
+// are the contiguous index range [firstIndex, firstIndex + indexCount). Laid out as
+// std430 so the array is uploaded to meshlet_cull.comp as is.
+struct Meshlet{
+  // model space bounding sphere, center xyz then radius
+  float sphere[4];
+  // normal cone, axis xyz then the cutoff tested by meshletVisible()
+  float cone[4];
+  uint32_t firstIndex;
+  uint32_t indexCount;
+  uint32_t vertexCount;
+  uint32_t padding;
+};
+static_assert(sizeof(Meshlet) == 48, "Meshlet must match the std430 layout in meshlet_cull.comp");
+
+// 64 bit FNV-1a, used to detect a changed source asset
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ull){
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  for(size_t i = 0; i < size; i++){
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+// read-only memory mapping of a whole file
+class MappedFile{
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if(this != &other){
+      close();
+      mapping = other.mapping;
+      mappingSize = other.mappingSize;
+      other.mapping = nullptr;
+      other.mappingSize = 0;
+    }
+    return *this;
+  }
+
+  ~MappedFile() { close(); }
+
+  bool open(const std::string& path){
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0){
+      return false;
+    }
+
+    struct stat st{};
+    if(fstat(fd, &st) != 0 || st.st_size == 0){
+      ::close(fd);
+      return false;
+    }
+
+    void* ptr = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(ptr == MAP_FAILED){
+      return false;
+    }
+
+    mapping = ptr;
+    mappingSize = static_cast<size_t>(st.st_size);
+    return true;
+  }
+
+  void close(){
+    if(mapping != nullptr){
+      munmap(mapping, mappingSize);
+      mapping = nullptr;
+      mappingSize = 0;
+    }
+  }
+
+  const uint8_t* data() const { return static_cast<const uint8_t*>(mapping); }
+  size_t size() const { return mappingSize; }
+  bool isOpen() const { return mapping != nullptr; }
+
+private:
+  void* mapping = nullptr;
+  size_t mappingSize = 0;
+};
+
+inline uint64_t hashFile(const std::string& path){
+  MappedFile file;
+  if(!file.open(path)){
+    throw std::runtime_error("failed to open " + path);
+  }
+  return hashBytes(file.data(), file.size());
+}
+
+// writes to a temporary file and renames it, so concurrently starting
+// instances never map a half written file
+inline bool writeFileAtomic(const std::string& path, const std::vector<uint8_t>& blob){
+  std::string tmpPath = path + ".tmp." + std::to_string(getpid());
+  {
+    std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+    if(!file.is_open()){
+      return false;
+    }
+    file.write(reinterpret_cast<const char*>(blob.data()), static_cast<std::streamsize>(blob.size()));
+    if(!file.good()){
+      std::remove(tmpPath.c_str());
+      return false;
+    }
+  }
+  if(std::rename(tmpPath.c_str(), path.c_str()) != 0){
+    std::remove(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+class MeshCache{
+public:
+  // serializes a mesh into the cache layout, without lods all indices are a single level
+  template<typename VertexT>
+  static std::vector<uint8_t> build(uint64_t sourceHash, uint32_t vertexFormat, const std::vector<VertexT>& vertices,
+                                    const std::vector<uint32_t>& indices, const std::vector<Meshlet>& meshlets = {},
+                                    const std::vector<MeshLod>& lods = {},
+                                    const std::array<float, 6>& positionDequant = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f}){
+    static_assert(std::is_trivially_copyable_v<VertexT>, "cached vertices must be trivially copyable");
+    if(lods.size() > MESH_CACHE_MAX_LODS){
+      throw std::runtime_error("too many levels of detail for the mesh cache");
+    }
+
+    MeshCacheHeader header{};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.sourceHash = sourceHash;
+    header.vertexStride = sizeof(VertexT);
+    header.vertexCount = static_cast<uint32_t>(vertices.size());
+    header.indexCount = static_cast<uint32_t>(indices.size());
+    header.vertexFormat = vertexFormat;
+    memcpy(header.positionDequant, positionDequant.data(), sizeof(header.positionDequant));
+    if(lods.empty()){
+      header.lodCount = 1;
+      header.lods[0] = MeshLod{0, header.indexCount, 0.0f, 0};
+    } else {
+      header.lodCount = static_cast<uint32_t>(lods.size());
+      memcpy(header.lods, lods.data(), lods.size() * sizeof(MeshLod));
+    }
+    header.vertexOffset = alignUp(sizeof(MeshCacheHeader));
+    header.indexOffset = alignUp(header.vertexOffset + vertices.size() * sizeof(VertexT));
+    header.meshletCount = static_cast<uint32_t>(meshlets.size());
+    header.meshletOffset = alignUp(header.indexOffset + indices.size() * sizeof(uint32_t));
+    header.fileSize = header.meshletOffset + meshlets.size() * sizeof(Meshlet);
+
+    std::vector<uint8_t> blob(header.fileSize, 0);
+    memcpy(blob.data(), &header, sizeof(header));
+    memcpy(blob.data() + header.vertexOffset, vertices.data(), vertices.size() * sizeof(VertexT));
+    memcpy(blob.data() + header.indexOffset, indices.data(), indices.size() * sizeof(uint32_t));
+    memcpy(blob.data() + header.meshletOffset, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+    return blob;
+  }
+
+  static bool write(const std::string& path, const std::vector<uint8_t>& blob){
+    return writeFileAtomic(path, blob);
+  }
+
+  // maps an existing cache file, returns false if it is missing or stale
+  bool open(const std::string& path, uint64_t sourceHash, uint32_t vertexFormat, uint32_t vertexStride){
+    close();
+    if(!file.open(path)){
+      return false;
+    }
+    if(!validate(file.data(), file.size(), sourceHash, vertexFormat, vertexStride)){
+      file.close();
+      return false;
+    }
+    base = file.data();
+    return true;
+  }
+
+  // uses an in-memory blob, for when the cache could not be written to disk
+  bool open(std::vector<uint8_t> blob, uint64_t sourceHash, uint32_t vertexFormat, uint32_t vertexStride){
+    close();
+    if(!validate(blob.data(), blob.size(), sourceHash, vertexFormat, vertexStride)){
+      return false;
+    }
+    ownedBlob = std::move(blob);
+    base = ownedBlob.data();
+    return true;
+  }
+
+  void close(){
+    file.close();
+    ownedBlob.clear();
+    base = nullptr;
+  }
+
+  bool isOpen() const { return base != nullptr; }
+
+  const MeshCacheHeader& header() const { return *reinterpret_cast<const MeshCacheHeader*>(base); }
+
+  const void* vertexData() const { return base + header().vertexOffset; }
+  size_t vertexDataSize() const { return static_cast<size_t>(header().vertexCount) * header().vertexStride; }
+  uint32_t vertexCount() const { return header().vertexCount; }
+
+  const uint32_t* indexData() const { return reinterpret_cast<const uint32_t*>(base + header().indexOffset); }
+  size_t indexDataSize() const { return static_cast<size_t>(header().indexCount) * sizeof(uint32_t); }
+  // all levels together
+  uint32_t indexCount() const { return header().indexCount; }
+
+  const MeshLod* lodData() const { return header().lods; }
+  const MeshLod& lod(uint32_t level) const { return header().lods[level]; }
+  uint32_t lodCount() const { return header().lodCount; }
+
+  const Meshlet* meshletData() const { return reinterpret_cast<const Meshlet*>(base + header().meshletOffset); }
+  size_t meshletDataSize() const { return static_cast<size_t>(header().meshletCount) * sizeof(Meshlet); }
+  uint32_t meshletCount() const { return header().meshletCount; }
+
+private:
+  MappedFile file;
+  std::vector<uint8_t> ownedBlob;
+  const uint8_t* base = nullptr;
+
+  static uint64_t alignUp(uint64_t offset){
+    return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+  }
+
+  static bool validate(const uint8_t* data, size_t size, uint64_t sourceHash, uint32_t vertexFormat, uint32_t vertexStride){
+    if(size < sizeof(MeshCacheHeader)){
+      return false;
+    }
+
+    MeshCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    bool valid = header.magic == MESH_CACHE_MAGIC
+        && header.version == MESH_CACHE_VERSION
+        && header.sourceHash == sourceHash
+        && header.vertexFormat == vertexFormat
+        && header.vertexStride == vertexStride
+        && header.fileSize == size
+        && header.indexOffset % MESH_CACHE_ALIGNMENT == 0
+        && header.vertexOffset + static_cast<uint64_t>(header.vertexCount) * header.vertexStride <= header.indexOffset
+        && header.indexOffset + static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t) <= header.meshletOffset
+        && header.meshletOffset + static_cast<uint64_t>(header.meshletCount) * sizeof(Meshlet) <= size;
+    if(!valid || header.lodCount == 0 || header.lodCount > MESH_CACHE_MAX_LODS){
+      return false;
+    }
+
+    for(uint32_t i = 0; i < header.lodCount; i++){
+      if(static_cast<uint64_t>(header.lods[i].firstIndex) + header.lods[i].indexCount > header.indexCount){
+        return false;
+      }
+    }
+
+    // the culling pass copies meshlet index ranges without bounds checks
+    for(uint32_t i = 0; i < header.meshletCount; i++){
+      Meshlet meshlet;
+      memcpy(&meshlet, data + header.meshletOffset + i * sizeof(Meshlet), sizeof(meshlet));
+      if(static_cast<uint64_t>(meshlet.firstIndex) + meshlet.indexCount > header.indexCount){
+        return false;
+      }
+    }
+
+    // the vertex shader fetches whatever the indices point at, nothing on the GPU bounds checks them
+    const uint32_t* indices = reinterpret_cast<const uint32_t*>(data + header.indexOffset);
+    for(uint32_t i = 0; i < header.indexCount; i++){
+      if(indices[i] >= header.vertexCount){
+        return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+// Post-transform vertex cache size assumed by the optimizer and the simulator.
+// Real hardware does not behave like a strict FIFO, but a 16 entry FIFO ranks
+// index orders the same way in practice.
+constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStats{
+  uint32_t misses = 0;
+  // average cache miss ratio, transformed vertices per triangle (0.5 is optimal on large meshes)
+  float acmr = 0.0f;
+  // average transform to vertex ratio, transformed vertices per referenced vertex (1.0 is optimal)
+  float atvr = 0.0f;
+};
+
+// simulates a FIFO post-transform cache over a triangle list
+inline VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+                                           uint32_t cacheSize = VERTEX_CACHE_SIZE){
+  VertexCacheStats stats{};
+  if(indices.empty()){
+    return stats;
+  }
+
+  // a vertex is in the cache when it was inserted less than cacheSize misses ago
+  std::vector<uint32_t> insertedAt(vertexCount, 0);
+  std::vector<bool> referenced(vertexCount, false);
+  uint32_t time = cacheSize + 1;
+  size_t referencedCount = 0;
+
+  for(uint32_t index : indices){
+    if(time - insertedAt[index] > cacheSize){
+      insertedAt[index] = time++;
+      stats.misses++;
+    }
+    if(!referenced[index]){
+      referenced[index] = true;
+      referencedCount++;
+    }
+  }
+
+  stats.acmr = static_cast<float>(stats.misses) / static_cast<float>(indices.size() / 3);
+  stats.atvr = static_cast<float>(stats.misses) / static_cast<float>(referencedCount);
+  return stats;
+}
+
+// Tipsify (Sander, Nehab, Barczak 2007): fans out around a focus vertex and picks
+// the next focus among the vertices just emitted, preferring ones that are still in
+// the cache and have few remaining triangles. Returns the reordered triangle list.
+// If clusterStarts is given it receives the first triangle of every run that
+// started after a dead end; those are the hard boundaries used by optimizeOverdraw().
+inline std::vector<uint32_t> optimizeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount,
+                                                 std::vector<uint32_t>* clusterStarts = nullptr,
+                                                 uint32_t cacheSize = VERTEX_CACHE_SIZE){
+  size_t triangleCount = indices.size() / 3;
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  if(clusterStarts != nullptr){
+    clusterStarts->clear();
+  }
+  if(triangleCount == 0){
+    return result;
+  }
+
+  // vertex -> triangle adjacency in CSR form
+  std::vector<uint32_t> liveTriangles(vertexCount, 0);
+  for(uint32_t index : indices){
+    liveTriangles[index]++;
+  }
+  std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+  for(size_t v = 0; v < vertexCount; v++){
+    adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+  }
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+  for(size_t i = 0; i < indices.size(); i++){
+    adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+  }
+
+  std::vector<uint32_t> cacheTime(vertexCount, 0);
+  std::vector<bool> emitted(triangleCount, false);
+  std::vector<uint32_t> deadEnd;
+  std::vector<uint32_t> candidates;
+  uint32_t time = cacheSize + 1;
+  size_t cursor = 0;
+
+  auto skipDeadEnd = [&]() -> int64_t {
+    while(!deadEnd.empty()){
+      uint32_t vertex = deadEnd.back();
+      deadEnd.pop_back();
+      if(liveTriangles[vertex] > 0){
+        return vertex;
+      }
+    }
+    while(cursor < vertexCount){
+      if(liveTriangles[cursor] > 0){
+        return static_cast<int64_t>(cursor);
+      }
+      cursor++;
+    }
+    return -1;
+  };
+
+  int64_t focus = skipDeadEnd();
+  bool newCluster = true;
+  while(focus >= 0){
+    if(newCluster && clusterStarts != nullptr){
+      clusterStarts->push_back(static_cast<uint32_t>(result.size() / 3));
+    }
+
+    candidates.clear();
+    for(uint32_t a = adjacencyOffsets[focus]; a < adjacencyOffsets[focus + 1]; a++){
+      uint32_t triangle = adjacency[a];
+      if(emitted[triangle]){
+        continue;
+      }
+      emitted[triangle] = true;
+      for(uint32_t corner = 0; corner < 3; corner++){
+        uint32_t vertex = indices[triangle * 3 + corner];
+        result.push_back(vertex);
+        deadEnd.push_back(vertex);
+        candidates.push_back(vertex);
+        liveTriangles[vertex]--;
+        if(time - cacheTime[vertex] > cacheSize){
+          cacheTime[vertex] = time++;
+        }
+      }
+    }
+
+    // next focus: a live candidate that stays in the cache while its fan is emitted
+    int64_t best = -1;
+    int64_t bestPriority = -1;
+    for(uint32_t vertex : candidates){
+      if(liveTriangles[vertex] == 0){
+        continue;
+      }
+      int64_t priority = 0;
+      if(time - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize){
+        priority = time - cacheTime[vertex];
+      }
+      if(priority > bestPriority){
+        bestPriority = priority;
+        best = vertex;
+      }
+    }
+
+    newCluster = best < 0;
+    focus = newCluster ? skipDeadEnd() : best;
+  }
+
+  return result;
+}
+
+// Reorders the clusters produced by optimizeVertexCache() so that triangles on the
+// outside of the mesh, facing away from its center, are drawn first and occlude
+// the rest (the overdraw half of Tipsify). Hard clusters are additionally split
+// wherever their running ACMR is within threshold of the whole mesh, which keeps
+// cache efficiency while giving the sort finer granularity.
+inline std::vector<uint32_t> optimizeOverdraw(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusterStarts,
+                                              const float* positions, size_t positionStride, size_t vertexCount,
+                                              float threshold = 1.05f, uint32_t cacheSize = VERTEX_CACHE_SIZE){
+  size_t triangleCount = indices.size() / 3;
+  if(triangleCount == 0 || clusterStarts.empty()){
+    return indices;
+  }
+
+  auto position = [&](uint32_t vertex, int axis){
+    return *reinterpret_cast<const float*>(reinterpret_cast<const uint8_t*>(positions) + vertex * positionStride + axis * sizeof(float));
+  };
+
+  float targetAcmr = analyzeVertexCache(indices, vertexCount, cacheSize).acmr * threshold;
+
+  // split hard clusters into soft ones
+  std::vector<uint32_t> starts;
+  std::vector<uint32_t> insertedAt(vertexCount, 0);
+  uint32_t time = cacheSize + 1;
+  for(size_t c = 0; c < clusterStarts.size(); c++){
+    uint32_t begin = clusterStarts[c];
+    uint32_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : static_cast<uint32_t>(triangleCount);
+    starts.push_back(begin);
+
+    uint32_t misses = 0;
+    uint32_t softStart = begin;
+    time += cacheSize + 1; // flush
+    for(uint32_t t = begin; t < end; t++){
+      for(uint32_t corner = 0; corner < 3; corner++){
+        uint32_t vertex = indices[t * 3 + corner];
+        if(time - insertedAt[vertex] > cacheSize){
+          insertedAt[vertex] = time++;
+          misses++;
+        }
+      }
+      uint32_t triangles = t + 1 - softStart;
+      if(t + 1 < end && triangles >= cacheSize && static_cast<float>(misses) / triangles <= targetAcmr){
+        starts.push_back(t + 1);
+        softStart = t + 1;
+        misses = 0;
+        time += cacheSize + 1;
+      }
+    }
+  }
+
+  struct Cluster{
+    uint32_t begin;
+    uint32_t end;
+    float sortKey;
+  };
+  std::vector<Cluster> clusters(starts.size());
+
+  float meshCenter[3] = {0.0f, 0.0f, 0.0f};
+  float meshArea = 0.0f;
+  std::vector<float> clusterData(starts.size() * 7, 0.0f); // centroid * area, normal * area, area
+
+  for(size_t c = 0; c < starts.size(); c++){
+    clusters[c].begin = starts[c];
+    clusters[c].end = c + 1 < starts.size() ? starts[c + 1] : static_cast<uint32_t>(triangleCount);
+
+    float* data = &clusterData[c * 7];
+    for(uint32_t t = clusters[c].begin; t < clusters[c].end; t++){
+      float p[3][3];
+      for(int corner = 0; corner < 3; corner++){
+        for(int axis = 0; axis < 3; axis++){
+          p[corner][axis] = position(indices[t * 3 + corner], axis);
+        }
+      }
+      float e1[3] = {p[1][0] - p[0][0], p[1][1] - p[0][1], p[1][2] - p[0][2]};
+      float e2[3] = {p[2][0] - p[0][0], p[2][1] - p[0][1], p[2][2] - p[0][2]};
+      float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+      float area = 0.5f * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+      for(int axis = 0; axis < 3; axis++){
+        float centroid = (p[0][axis] + p[1][axis] + p[2][axis]) / 3.0f;
+        data[axis] += centroid * area;
+        data[3 + axis] += 0.5f * n[axis];
+        meshCenter[axis] += centroid * area;
+      }
+      data[6] += area;
+      meshArea += area;
+    }
+  }
+
+  for(int axis = 0; axis < 3; axis++){
+    meshCenter[axis] = meshArea > 0.0f ? meshCenter[axis] / meshArea : 0.0f;
+  }
+
+  for(size_t c = 0; c < clusters.size(); c++){
+    const float* data = &clusterData[c * 7];
+    float area = data[6] > 0.0f ? data[6] : 1.0f;
+    float normalLength = std::sqrt(data[3] * data[3] + data[4] * data[4] + data[5] * data[5]);
+    float key = 0.0f;
+    if(normalLength > 0.0f){
+      for(int axis = 0; axis < 3; axis++){
+        key += (data[axis] / area - meshCenter[axis]) * data[3 + axis] / normalLength;
+      }
+    }
+    clusters[c].sortKey = key;
+  }
+
+  std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b){
+    return a.sortKey > b.sortKey;
+  });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for(const Cluster& cluster : clusters){
+    result.insert(result.end(), indices.begin() + cluster.begin * 3, indices.begin() + cluster.end * 3);
+  }
+  return result;
+}
+
+// Reorders vertices by first use in the index buffer and rewrites the indices,
+// so vertex fetch walks memory almost linearly. Unreferenced vertices are dropped.
+template<typename VertexT>
+void optimizeVertexFetch(std::vector<VertexT>& vertices, std::vector<uint32_t>& indices){
+  constexpr uint32_t UNUSED = UINT32_MAX;
+  std::vector<uint32_t> remap(vertices.size(), UNUSED);
+  std::vector<VertexT> reordered;
+  reordered.reserve(vertices.size());
+
+  for(uint32_t& index : indices){
+    if(remap[index] == UNUSED){
+      remap[index] = static_cast<uint32_t>(reordered.size());
+      reordered.push_back(vertices[index]);
+    }
+    index = remap[index];
+  }
+
+  vertices = std::move(reordered);
+}
+
+struct MeshOptimizationReport{
+  VertexCacheStats before;
+  VertexCacheStats after;
+};
+
+// the full stage run between loadModel() and buffer creation
+template<typename VertexT>
+MeshOptimizationReport optimizeMesh(std::vector<VertexT>& vertices, std::vector<uint32_t>& indices, float overdrawThreshold = 1.05f){
+  MeshOptimizationReport report{};
+  report.before = analyzeVertexCache(indices, vertices.size());
+  if(indices.empty()){
+    return report;
+  }
+
+  std::vector<uint32_t> clusterStarts;
+  indices = optimizeVertexCache(indices, vertices.size(), &clusterStarts);
+  indices = optimizeOverdraw(indices, clusterStarts, &vertices[0].pos.x, sizeof(VertexT), vertices.size(), overdrawThreshold);
+  optimizeVertexFetch(vertices, indices);
+
+  report.after = analyzeVertexCache(indices, vertices.size());
+  return report;
+}
@@ -0,0 +1,562 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_cache.h"
+#include "mesh_optimizer.h"
+#include "vertex.h"
+
+// a simplified level must keep at most this share of its parent's triangles, otherwise the chain ends
+constexpr float LOD_MIN_REDUCTION = 0.85f;
+// largest error of a single collapse while building a level, relative to the mesh's bounding box diagonal
+constexpr float LOD_MAX_COLLAPSE_ERROR = 0.02f;
+// border edges resist collapsing this many times more than the surface around them
+constexpr double SIMPLIFY_BORDER_WEIGHT = 10.0;
+// a collapse may turn a triangle's normal by at most about 78 degrees, so slivers can't fold over across passes
+constexpr float SIMPLIFY_MIN_NORMAL_COS = 0.2f;
+
+// Quadric error metric (Garland, Heckbert 1997): the weighted sum of squared
+// distances to a set of planes as the 10 unique entries of a symmetric 4x4
+// matrix. Dividing by the summed weight makes the error an average squared
+// distance, in model units squared.
+struct Quadric{
+  double a00 = 0.0, a11 = 0.0, a22 = 0.0, a01 = 0.0, a02 = 0.0, a12 = 0.0;
+  double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+  double c = 0.0;
+  double weight = 0.0;
+
+  // the plane n.p + d = 0 with a unit normal
+  void addPlane(double nx, double ny, double nz, double d, double w){
+    a00 += w * nx * nx;
+    a11 += w * ny * ny;
+    a22 += w * nz * nz;
+    a01 += w * nx * ny;
+    a02 += w * nx * nz;
+    a12 += w * ny * nz;
+    b0 += w * nx * d;
+    b1 += w * ny * d;
+    b2 += w * nz * d;
+    c += w * d * d;
+    weight += w;
+  }
+
+  Quadric& operator+=(const Quadric& other){
+    a00 += other.a00;
+    a11 += other.a11;
+    a22 += other.a22;
+    a01 += other.a01;
+    a02 += other.a02;
+    a12 += other.a12;
+    b0 += other.b0;
+    b1 += other.b1;
+    b2 += other.b2;
+    c += other.c;
+    weight += other.weight;
+    return *this;
+  }
+
+  double error(const glm::vec3& p) const {
+    if(weight <= 0.0){
+      return 0.0;
+    }
+    double x = p.x, y = p.y, z = p.z;
+    double rx = a00 * x + a01 * y + a02 * z + 2.0 * b0;
+    double ry = a01 * x + a11 * y + a12 * z + 2.0 * b1;
+    double rz = a02 * x + a12 * y + a22 * z + 2.0 * b2;
+    return std::fabs(x * rx + y * ry + z * rz + c) / weight;
+  }
+};
+
+// How a vertex may move. Vertices that share a position but differ in
+// texture coordinates or color form a seam, the other vertices at the same
+// position are its wedges.
+enum class SimplifyVertexKind : uint8_t {
+  // a single wedge with closed edges all around, collapses onto any neighbour
+  Manifold,
+  // a single wedge on an open boundary, only collapses along that boundary
+  Border,
+  // two wedges on a seam, both collapse along the seam together
+  Seam,
+  // anything else, never moves
+  Locked,
+};
+
+struct SimplifyOptions{
+  size_t targetIndexCount = 0;
+  // largest error of a single collapse, a distance in model units
+  float maxError = 0.0f;
+  // Vertices that only differ in their attributes stay split along their
+  // seam. Without it they collapse by position and each wedge takes the
+  // attributes of a neighbouring wedge of the target, which stretches the
+  // texture across the seam.
+  bool preserveSeams = true;
+};
+
+// Outgoing half-edges of every vertex, rebuilt after each simplification pass
+struct SimplifyEdges{
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> targets;
+
+  void build(const std::vector<uint32_t>& indices, size_t vertexCount){
+    offsets.assign(vertexCount + 1, 0);
+    for(uint32_t index : indices){
+      offsets[index + 1]++;
+    }
+    for(size_t i = 0; i < vertexCount; i++){
+      offsets[i + 1] += offsets[i];
+    }
+    targets.resize(indices.size());
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for(size_t i = 0; i + 2 < indices.size(); i += 3){
+      for(int corner = 0; corner < 3; corner++){
+        targets[fill[indices[i + corner]]++] = indices[i + (corner + 1) % 3];
+      }
+    }
+  }
+
+  bool has(uint32_t from, uint32_t to) const {
+    for(uint32_t i = offsets[from]; i < offsets[from + 1]; i++){
+      if(targets[i] == to){
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+// Edge collapse simplification in the style of meshoptimizer's
+// meshopt_simplify. A vertex is only ever collapsed onto an existing
+// neighbour, so the result indexes the unchanged vertex buffer and every
+// level of detail can share it. Each pass collects the cheapest collapse of
+// every edge by quadric error, performs as many of them as are needed to
+// reach the target with each position touched at most once, rejects the ones
+// that would flip a triangle, and drops the triangles that became
+// degenerate. Simplification stops early rather than perform a collapse
+// above maxError. error receives the largest performed collapse's error.
+template<typename PositionFn>
+std::vector<uint32_t> simplifyMesh(const std::vector<uint32_t>& indices, size_t vertexCount, PositionFn position,
+                                   const SimplifyOptions& options, float& error){
+  constexpr uint32_t NONE = UINT32_MAX;
+  constexpr uint32_t MANY = UINT32_MAX - 1;
+
+  std::vector<uint32_t> result(indices.begin(), indices.begin() + static_cast<ptrdiff_t>(indices.size() / 3 * 3));
+  error = 0.0f;
+
+  std::vector<glm::vec3> positions(vertexCount);
+  for(size_t i = 0; i < vertexCount; i++){
+    positions[i] = position(static_cast<uint32_t>(i));
+  }
+
+  // remap[i] is the first vertex at the same position, wedge[] links all vertices at one position in a ring
+  std::vector<uint32_t> remap(vertexCount);
+  std::vector<uint32_t> wedge(vertexCount);
+  {
+    struct PositionHash{
+      size_t operator()(const std::array<uint32_t, 3>& key) const {
+        return static_cast<size_t>(hashBytes(key.data(), sizeof(key)));
+      }
+    };
+    std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHash> firstAt;
+    firstAt.reserve(vertexCount);
+    for(uint32_t i = 0; i < vertexCount; i++){
+      std::array<uint32_t, 3> key;
+      // + 0.0f folds -0 into 0
+      for(int axis = 0; axis < 3; axis++){
+        float value = positions[i][axis] + 0.0f;
+        memcpy(&key[axis], &value, sizeof(float));
+      }
+      auto it = firstAt.emplace(key, i).first;
+      remap[i] = it->second;
+      wedge[i] = i;
+      if(it->second != i){
+        wedge[i] = wedge[it->second];
+        wedge[it->second] = i;
+      }
+    }
+  }
+
+  SimplifyEdges edges;
+  edges.build(result, vertexCount);
+
+  // an edge between the positions of from and to, whichever wedges it uses
+  auto hasPositionalEdge = [&](uint32_t from, uint32_t to){
+    uint32_t w = from;
+    do {
+      for(uint32_t i = edges.offsets[w]; i < edges.offsets[w + 1]; i++){
+        if(remap[edges.targets[i]] == remap[to]){
+          return true;
+        }
+      }
+      w = wedge[w];
+    } while(w != from);
+    return false;
+  };
+
+  // The single open outgoing and incoming edge of every vertex by vertex
+  // index, where seams are open too, and of every position by position,
+  // where only borders are.
+  std::vector<uint32_t> openOut(vertexCount, NONE);
+  std::vector<uint32_t> openIn(vertexCount, NONE);
+  std::vector<uint32_t> positionOpenOut(vertexCount, NONE);
+  std::vector<uint32_t> positionOpenIn(vertexCount, NONE);
+  auto addOpenEdge = [&](std::vector<uint32_t>& open, uint32_t at, uint32_t other){
+    open[at] = open[at] == NONE || open[at] == other ? other : MANY;
+  };
+  auto findOpenEdges = [&](){
+    std::fill(openOut.begin(), openOut.end(), NONE);
+    std::fill(openIn.begin(), openIn.end(), NONE);
+    std::fill(positionOpenOut.begin(), positionOpenOut.end(), NONE);
+    std::fill(positionOpenIn.begin(), positionOpenIn.end(), NONE);
+    for(uint32_t from = 0; from < vertexCount; from++){
+      for(uint32_t i = edges.offsets[from]; i < edges.offsets[from + 1]; i++){
+        uint32_t to = edges.targets[i];
+        if(!edges.has(to, from)){
+          addOpenEdge(openOut, from, to);
+          addOpenEdge(openIn, to, from);
+          if(!hasPositionalEdge(to, from)){
+            addOpenEdge(positionOpenOut, remap[from], remap[to]);
+            addOpenEdge(positionOpenIn, remap[to], remap[from]);
+          }
+        }
+      }
+    }
+  };
+  findOpenEdges();
+
+  std::vector<SimplifyVertexKind> kinds(vertexCount, SimplifyVertexKind::Locked);
+  for(uint32_t i = 0; i < vertexCount; i++){
+    if(!options.preserveSeams){
+      // every wedge moves with its position, only borders are restricted
+      uint32_t root = remap[i];
+      if(positionOpenOut[root] == NONE && positionOpenIn[root] == NONE){
+        kinds[i] = SimplifyVertexKind::Manifold;
+      } else if(positionOpenOut[root] < MANY && positionOpenIn[root] < MANY){
+        kinds[i] = SimplifyVertexKind::Border;
+      }
+    } else if(wedge[i] == i){
+      if(openOut[i] == NONE && openIn[i] == NONE){
+        kinds[i] = SimplifyVertexKind::Manifold;
+      } else if(openOut[i] < MANY && openIn[i] < MANY && !hasPositionalEdge(openOut[i], i) && !hasPositionalEdge(i, openIn[i])){
+        kinds[i] = SimplifyVertexKind::Border;
+      }
+    } else if(wedge[wedge[i]] == i){
+      uint32_t other = wedge[i];
+      if(openOut[i] < MANY && openIn[i] < MANY && openOut[other] < MANY && openIn[other] < MANY
+         && remap[openIn[i]] == remap[openOut[other]] && remap[openOut[i]] == remap[openIn[other]]){
+        kinds[i] = SimplifyVertexKind::Seam;
+      }
+    }
+  }
+
+  // one quadric per position, from the planes of the triangles around it and of the open edges, and the
+  // area weighted normal of those triangles, which collapses merge like the quadrics
+  std::vector<Quadric> quadrics(vertexCount);
+  std::vector<glm::vec3> sourceNormals(vertexCount, glm::vec3(0.0f));
+  for(size_t i = 0; i + 2 < result.size(); i += 3){
+    glm::vec3 p0 = positions[result[i]];
+    glm::vec3 p1 = positions[result[i + 1]];
+    glm::vec3 p2 = positions[result[i + 2]];
+    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+    float length = glm::length(normal);
+    if(length <= 0.0f){
+      continue;
+    }
+    normal /= length;
+    double d = -glm::dot(normal, p0);
+    for(int corner = 0; corner < 3; corner++){
+      quadrics[remap[result[i + corner]]].addPlane(normal.x, normal.y, normal.z, d, length * 0.5);
+      sourceNormals[remap[result[i + corner]]] += normal * length;
+    }
+
+    for(int corner = 0; corner < 3; corner++){
+      uint32_t from = result[i + corner];
+      uint32_t to = result[i + (corner + 1) % 3];
+      if(hasPositionalEdge(to, from)){
+        continue;
+      }
+      // a plane through the open edge, perpendicular to the triangle, keeps the boundary in place
+      glm::vec3 edge = positions[to] - positions[from];
+      glm::vec3 edgeNormal = glm::cross(edge, normal);
+      float edgeLength = glm::length(edgeNormal);
+      if(edgeLength <= 0.0f){
+        continue;
+      }
+      edgeNormal /= edgeLength;
+      double edgeD = -glm::dot(edgeNormal, positions[from]);
+      double w = glm::dot(edge, edge) * SIMPLIFY_BORDER_WEIGHT;
+      quadrics[remap[from]].addPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, edgeD, w);
+      quadrics[remap[to]].addPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, edgeD, w);
+    }
+  }
+
+  // the wedge that moves along with a seam collapse from -> to, NONE if the seam doesn't continue that way
+  auto seamPartner = [&](uint32_t from, uint32_t to, uint32_t& partnerFrom, uint32_t& partnerTo){
+    partnerFrom = wedge[from];
+    if(openOut[from] == to){
+      partnerTo = openIn[partnerFrom];
+    } else if(openIn[from] == to){
+      partnerTo = openOut[partnerFrom];
+    } else {
+      return false;
+    }
+    return partnerTo < MANY && remap[partnerTo] == remap[to] && partnerTo != to;
+  };
+
+  auto canCollapse = [&](uint32_t from, uint32_t to){
+    switch(kinds[from]){
+    case SimplifyVertexKind::Manifold:
+      return true;
+    case SimplifyVertexKind::Border:
+      return kinds[to] == SimplifyVertexKind::Border
+          && (positionOpenOut[remap[from]] == remap[to] || positionOpenIn[remap[from]] == remap[to]);
+    case SimplifyVertexKind::Seam:
+      if(kinds[to] == SimplifyVertexKind::Seam){
+        uint32_t partnerFrom = 0, partnerTo = 0;
+        return seamPartner(from, to, partnerFrom, partnerTo);
+      }
+      return false;
+    default:
+      return false;
+    }
+  };
+
+  struct Collapse{
+    uint32_t from;
+    uint32_t to;
+    double error;
+  };
+  std::vector<Collapse> collapses;
+  std::vector<uint32_t> collapseRemap(vertexCount);
+  std::vector<uint8_t> collapseLocked(vertexCount);
+  // triangles around every position, for the flip test
+  std::vector<uint32_t> triangleOffsets;
+  std::vector<uint32_t> triangles;
+  double errorLimit = static_cast<double>(options.maxError) * options.maxError;
+  double resultError = 0.0;
+
+  // true if moving the position of from onto to turns any triangle around it over, either against its
+  // current normal or, since each collapse may turn it a little, against the source surface under it
+  auto flips = [&](uint32_t from, uint32_t to){
+    uint32_t fromPosition = remap[from];
+    uint32_t toPosition = remap[to];
+    for(uint32_t i = triangleOffsets[fromPosition]; i < triangleOffsets[fromPosition + 1]; i++){
+      const uint32_t* triangle = &result[triangles[i] * 3];
+      uint32_t corners[3] = {collapseRemap[triangle[0]], collapseRemap[triangle[1]], collapseRemap[triangle[2]]};
+      if(remap[corners[0]] == toPosition || remap[corners[1]] == toPosition || remap[corners[2]] == toPosition){
+        continue;
+      }
+      glm::vec3 p[3] = {positions[corners[0]], positions[corners[1]], positions[corners[2]]};
+      glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+      for(int corner = 0; corner < 3; corner++){
+        if(remap[corners[corner]] == fromPosition){
+          p[corner] = positions[to];
+        }
+      }
+      glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+      if(glm::dot(before, after) <= SIMPLIFY_MIN_NORMAL_COS * glm::length(before) * glm::length(after)){
+        return true;
+      }
+      glm::vec3 source = sourceNormals[remap[corners[0]]] + sourceNormals[remap[corners[1]]]
+                       + sourceNormals[remap[corners[2]]] + sourceNormals[toPosition];
+      if(glm::dot(source, after) <= SIMPLIFY_MIN_NORMAL_COS * glm::length(source) * glm::length(after)){
+        return true;
+      }
+    }
+    return false;
+  };
+
+  // the wedge of to that w shares an edge with, so attributes stay continuous, or to itself
+  auto wedgeTarget = [&](uint32_t w, uint32_t to){
+    uint32_t t = to;
+    do {
+      if(edges.has(w, t) || edges.has(t, w)){
+        return t;
+      }
+      t = wedge[t];
+    } while(t != to);
+    return to;
+  };
+
+  while(result.size() > options.targetIndexCount){
+    size_t triangleCount = result.size() / 3;
+
+    triangleOffsets.assign(vertexCount + 1, 0);
+    for(uint32_t index : result){
+      triangleOffsets[remap[index] + 1]++;
+    }
+    for(size_t i = 0; i < vertexCount; i++){
+      triangleOffsets[i + 1] += triangleOffsets[i];
+    }
+    triangles.resize(result.size());
+    std::vector<uint32_t> fill(triangleOffsets.begin(), triangleOffsets.end() - 1);
+    for(size_t i = 0; i < result.size(); i++){
+      triangles[fill[remap[result[i]]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    // the cheaper direction of every edge, an edge shared by two triangles is only seen from one of them
+    collapses.clear();
+    for(size_t i = 0; i < result.size(); i += 3){
+      for(int corner = 0; corner < 3; corner++){
+        uint32_t a = result[i + corner];
+        uint32_t b = result[i + (corner + 1) % 3];
+        if(remap[a] == remap[b] || (remap[a] > remap[b] && hasPositionalEdge(b, a))){
+          continue;
+        }
+        bool forward = canCollapse(a, b);
+        bool backward = canCollapse(b, a);
+        if(!forward && !backward){
+          continue;
+        }
+        double forwardError = forward ? quadrics[remap[a]].error(positions[b]) : 0.0;
+        double backwardError = backward ? quadrics[remap[b]].error(positions[a]) : 0.0;
+        if(forward && (!backward || forwardError <= backwardError)){
+          collapses.push_back(Collapse{a, b, forwardError});
+        } else {
+          collapses.push_back(Collapse{b, a, backwardError});
+        }
+      }
+    }
+    if(collapses.empty()){
+      break;
+    }
+    std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y){ return x.error < y.error; });
+
+    // a manifold collapse removes two triangles
+    size_t collapseGoal = std::max<size_t>((triangleCount - options.targetIndexCount / 3) / 2, 1);
+    for(uint32_t i = 0; i < vertexCount; i++){
+      collapseRemap[i] = i;
+    }
+    std::fill(collapseLocked.begin(), collapseLocked.end(), 0);
+
+    size_t performed = 0;
+    for(const Collapse& collapse : collapses){
+      if(performed >= collapseGoal || collapse.error > errorLimit){
+        break;
+      }
+      uint32_t fromPosition = remap[collapse.from];
+      uint32_t toPosition = remap[collapse.to];
+      if(collapseLocked[fromPosition] || collapseLocked[toPosition] || flips(collapse.from, collapse.to)){
+        continue;
+      }
+
+      // every wedge at the position moves, a seam's second wedge onto the target's second wedge
+      uint32_t w = collapse.from;
+      do {
+        collapseRemap[w] = wedgeTarget(w, collapse.to);
+        w = wedge[w];
+      } while(w != collapse.from);
+      quadrics[toPosition] += quadrics[fromPosition];
+      sourceNormals[toPosition] += sourceNormals[fromPosition];
+      collapseLocked[fromPosition] = 1;
+      collapseLocked[toPosition] = 1;
+      resultError = std::max(resultError, collapse.error);
+      performed++;
+    }
+    if(performed == 0){
+      break;
+    }
+
+    size_t write = 0;
+    for(size_t i = 0; i < result.size(); i += 3){
+      uint32_t a = collapseRemap[result[i]];
+      uint32_t b = collapseRemap[result[i + 1]];
+      uint32_t c = collapseRemap[result[i + 2]];
+      if(remap[a] == remap[b] || remap[b] == remap[c] || remap[a] == remap[c]){
+        continue;
+      }
+      result[write++] = a;
+      result[write++] = b;
+      result[write++] = c;
+    }
+    result.resize(write);
+
+    edges.build(result, vertexCount);
+    findOpenEdges();
+  }
+
+  error = static_cast<float>(std::sqrt(resultError));
+  return result;
+}
+
+// Appends up to MESH_CACHE_MAX_LODS - 1 simplified levels behind the full mesh
+// in indices, each aiming at half the triangles of the level before and
+// reordered for the vertex cache. Every level is simplified from its parent,
+// so its error is the sum of the errors along the chain, an upper bound of
+// its distance from the full mesh. Texture seams are kept until a level can't
+// be reduced enough with them, from then on the remaining levels collapse
+// across them.
+template<typename PositionFn>
+std::vector<MeshLod> buildLodChain(std::vector<uint32_t>& indices, size_t vertexCount, PositionFn position){
+  std::vector<MeshLod> lods;
+  lods.push_back(MeshLod{0, static_cast<uint32_t>(indices.size()), 0.0f, 0});
+  if(indices.empty()){
+    return lods;
+  }
+
+  glm::vec3 minPos = position(indices[0]);
+  glm::vec3 maxPos = minPos;
+  for(uint32_t index : indices){
+    minPos = glm::min(minPos, position(index));
+    maxPos = glm::max(maxPos, position(index));
+  }
+  float maxCollapseError = glm::length(maxPos - minPos) * LOD_MAX_COLLAPSE_ERROR;
+
+  std::vector<uint32_t> level(indices);
+  float error = 0.0f;
+  bool preserveSeams = true;
+  while(lods.size() < MESH_CACHE_MAX_LODS){
+    SimplifyOptions options;
+    options.targetIndexCount = level.size() / 6 * 3;
+    options.maxError = maxCollapseError;
+    options.preserveSeams = preserveSeams;
+    auto reduced = [&](const std::vector<uint32_t>& simplified){
+      return !simplified.empty() && simplified.size() <= level.size() * LOD_MIN_REDUCTION;
+    };
+
+    float levelError = 0.0f;
+    std::vector<uint32_t> simplified = simplifyMesh(level, vertexCount, position, options, levelError);
+    if(!reduced(simplified) && preserveSeams){
+      options.preserveSeams = preserveSeams = false;
+      simplified = simplifyMesh(level, vertexCount, position, options, levelError);
+    }
+    if(!reduced(simplified)){
+      break;
+    }
+    simplified = optimizeVertexCache(simplified, vertexCount);
+    error += levelError;
+    lods.push_back(MeshLod{static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(simplified.size()), error, 0});
+    indices.insert(indices.end(), simplified.begin(), simplified.end());
+    level = std::move(simplified);
+  }
+  return lods;
+}
+
+// The coarsest level whose error, scaled into world units and projected at
+// distance, covers at most maxPixels. pixelsPerUnit is the projected size of
+// one world unit at distance 1: half the viewport height times proj[1][1].
+inline uint32_t selectLod(const MeshLod* lods, uint32_t lodCount, float scale, float distance, float pixelsPerUnit,
+                          float maxPixels){
+  for(uint32_t level = lodCount - 1; level > 0; level--){
+    if(lods[level].error * scale * pixelsPerUnit <= maxPixels * distance){
+      return level;
+    }
+  }
+  return 0;
+}
+
+// triangles of the drawn copies at full detail and at their selected levels, summed over frames
+struct LodStats{
+  uint64_t frames = 0;
+  uint64_t fullTriangles = 0;
+  uint64_t drawnTriangles = 0;
+  uint64_t minDrawnTriangles = UINT64_MAX;
+  uint64_t maxDrawnTriangles = 0;
+  // copies drawn at each level
+  std::array<uint64_t, MESH_CACHE_MAX_LODS> levelDraws{};
+};
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu_culling.h"
+#include "mesh_cache.h"
+#include "vertex.h"
+
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+// Bounding sphere and normal cone of the triangles in
+// [meshlet.firstIndex, meshlet.firstIndex + meshlet.indexCount). The cone
+// axis is the average triangle normal, the cutoff the sine of the widest
+// angle between it and any normal, so a cone wider than a hemisphere gets a
+// cutoff of 1 and is never culled.
+template<typename PositionFn>
+void computeMeshletBounds(Meshlet& meshlet, const std::vector<uint32_t>& indices, PositionFn position){
+  const uint32_t* triangleIndices = indices.data() + meshlet.firstIndex;
+  BoundingSphere sphere = computeBoundingSphere(meshlet.indexCount, [&](size_t i){ return position(triangleIndices[i]); });
+
+  std::vector<glm::vec3> normals;
+  normals.reserve(meshlet.indexCount / 3);
+  glm::vec3 normalSum(0.0f);
+  for(uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3){
+    glm::vec3 a = position(triangleIndices[i]);
+    glm::vec3 normal = glm::cross(position(triangleIndices[i + 1]) - a, position(triangleIndices[i + 2]) - a);
+    float length = glm::length(normal);
+    // degenerate triangles face nowhere and don't widen the cone
+    if(length > 0.0f){
+      normals.push_back(normal / length);
+      normalSum += normal / length;
+    }
+  }
+
+  glm::vec3 axis(0.0f, 0.0f, 0.0f);
+  float cutoff = 1.0f;
+  float sumLength = glm::length(normalSum);
+  if(sumLength > 0.0f){
+    axis = normalSum / sumLength;
+    float minDot = 1.0f;
+    for(const glm::vec3& normal : normals){
+      minDot = std::min(minDot, glm::dot(axis, normal));
+    }
+    if(minDot > 0.0f){
+      cutoff = std::sqrt(std::max(0.0f, 1.0f - minDot * minDot));
+    }
+  }
+
+  meshlet.sphere[0] = sphere.center.x;
+  meshlet.sphere[1] = sphere.center.y;
+  meshlet.sphere[2] = sphere.center.z;
+  meshlet.sphere[3] = sphere.radius;
+  meshlet.cone[0] = axis.x;
+  meshlet.cone[1] = axis.y;
+  meshlet.cone[2] = axis.z;
+  meshlet.cone[3] = cutoff;
+}
+
+// Splits a triangle list into meshlets by walking the triangles in order and
+// closing the current meshlet when the next triangle would exceed either
+// limit. Run after optimizeMesh(), whose cache friendly order keeps
+// neighbouring triangles sharing vertices, so the clusters stay compact and
+// every meshlet is a contiguous range of the unchanged index buffer.
+// Only the first indexCount indices are split, the full mesh in front of its
+// simplified levels. position(i) is the model space position of vertex i as
+// the vertex shader sees it, dequantized for packed vertices.
+template<typename PositionFn>
+std::vector<Meshlet> buildMeshlets(const std::vector<uint32_t>& indices, size_t indexCount, size_t vertexCount,
+                                   PositionFn position){
+  std::vector<Meshlet> meshlets;
+  // the meshlet that last counted each vertex
+  std::vector<uint32_t> owner(vertexCount, UINT32_MAX);
+
+  Meshlet current{};
+  uint32_t triangles = 0;
+  auto finish = [&](uint32_t endIndex){
+    current.indexCount = endIndex - current.firstIndex;
+    computeMeshletBounds(current, indices, position);
+    meshlets.push_back(current);
+    current = Meshlet{};
+    current.firstIndex = endIndex;
+    triangles = 0;
+  };
+
+  for(size_t i = 0; i + 2 < indexCount; i += 3){
+    uint32_t id = static_cast<uint32_t>(meshlets.size());
+    const uint32_t* triangle = &indices[i];
+    uint32_t newVertices = 0;
+    for(int corner = 0; corner < 3; corner++){
+      bool repeated = (corner > 0 && triangle[corner] == triangle[0]) || (corner > 1 && triangle[corner] == triangle[1]);
+      if(owner[triangle[corner]] != id && !repeated){
+        newVertices++;
+      }
+    }
+    if(triangles == MESHLET_MAX_TRIANGLES || current.vertexCount + newVertices > MESHLET_MAX_VERTICES){
+      finish(static_cast<uint32_t>(i));
+      id++;
+    }
+
+    for(int corner = 0; corner < 3; corner++){
+      if(owner[triangle[corner]] != id){
+        owner[triangle[corner]] = id;
+        current.vertexCount++;
+      }
+    }
+    triangles++;
+  }
+  if(triangles > 0){
+    finish(static_cast<uint32_t>(indexCount / 3 * 3));
+  }
+  return meshlets;
+}
+
+// Frustum and backface test of one meshlet, with the frustum and camera in
+// the meshlet's model space. The cone test culls when the camera sees every
+// triangle from behind. Mirrors meshlet_cull.comp.
+inline bool meshletVisible(const Frustum& frustum, const glm::vec3& camera, bool coneCulling, const Meshlet& meshlet){
+  BoundingSphere sphere{glm::vec3(meshlet.sphere[0], meshlet.sphere[1], meshlet.sphere[2]), meshlet.sphere[3]};
+  if(!sphereInFrustum(frustum, sphere)){
+    return false;
+  }
+  if(!coneCulling){
+    return true;
+  }
+  glm::vec3 offset = sphere.center - camera;
+  glm::vec3 axis(meshlet.cone[0], meshlet.cone[1], meshlet.cone[2]);
+  return glm::dot(offset, axis) < meshlet.cone[3] * glm::length(offset) + sphere.radius;
+}
+
+// CPU reference of the meshlet culling pass: the number of indices it keeps
+inline uint32_t cullMeshletsCpu(const Frustum& frustum, const glm::vec3& camera, bool coneCulling,
+                                const Meshlet* meshlets, uint32_t meshletCount){
+  uint32_t indexCount = 0;
+  for(uint32_t i = 0; i < meshletCount; i++){
+    if(meshletVisible(frustum, camera, coneCulling, meshlets[i])){
+      indexCount += meshlets[i].indexCount;
+    }
+  }
+  return indexCount;
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "thread_pool.h"
+
+// the AVX2 kernel is compiled for its own target and picked at runtime, so
+// builds without -mavx2 still use it on CPUs that have it
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MIP_GENERATOR_AVX2 1
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MIP_GENERATOR_SSE 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define MIP_GENERATOR_NEON 1
+#endif
+
+// RGBA8 image with sRGB color channels and linear alpha
+struct ImageRGBA8{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint8_t> pixels;
+};
+
+// Box averages the source texels covered by each output texel, which is the
+// exact 2x2 average for even sizes and a 3-tap coverage filter for odd ones.
+// Kaiser is a Kaiser-windowed sinc (width 3, alpha 4), sharper at the cost of
+// 13 taps per axis for a 2x reduction, ceil(6 * scale) + 1 in general.
+enum class MipFilter : uint32_t{
+  Box = 0,
+  Kaiser = 1,
+};
+
+inline uint32_t mipLevelCount(uint32_t width, uint32_t height){
+  return static_cast<uint32_t>(std::floor(std::log2(std::max(width, height)))) + 1;
+}
+
+inline const std::array<float, 256>& srgbToLinearTable(){
+  static const std::array<float, 256> table = []{
+    std::array<float, 256> t{};
+    for(int i = 0; i < 256; i++){
+      float c = i / 255.0f;
+      t[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    }
+    return t;
+  }();
+  return table;
+}
+
+inline uint8_t linearToSrgb(float c){
+  c = std::clamp(c, 0.0f, 1.0f);
+  float s = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+  return static_cast<uint8_t>(s * 255.0f + 0.5f);
+}
+
+namespace mip_detail{
+
+constexpr uint32_t LINEAR_TO_SRGB_STEPS = 1 << 16;
+constexpr float KAISER_WIDTH = 3.0f;
+constexpr float KAISER_ALPHA = 4.0f;
+
+// linearToSrgb() sampled finely enough that the result matches it to +-1
+inline const std::vector<uint8_t>& linearToSrgbTable(){
+  static const std::vector<uint8_t> table = []{
+    std::vector<uint8_t> t(LINEAR_TO_SRGB_STEPS);
+    for(uint32_t i = 0; i < LINEAR_TO_SRGB_STEPS; i++){
+      t[i] = linearToSrgb(static_cast<float>(i) / (LINEAR_TO_SRGB_STEPS - 1));
+    }
+    return t;
+  }();
+  return table;
+}
+
+// RGBA, linear color and alpha, kept in float between levels so the chain is
+// only quantized once per level
+struct LinearImage{
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<float> pixels;
+};
+
+// weights to resample one axis from srcSize to dstSize samples, with the
+// source index of every tap already clamped to the edge
+struct AxisFilter{
+  uint32_t taps = 0;
+  std::vector<uint32_t> sources;
+  std::vector<float> weights;
+};
+
+inline double besselI0(double x){
+  double sum = 1.0;
+  double term = 1.0;
+  for(int k = 1; k < 32; k++){
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+    if(term < sum * 1e-12){
+      break;
+    }
+  }
+  return sum;
+}
+
+inline double kaiser(double x){
+  if(std::abs(x) >= KAISER_WIDTH){
+    return 0.0;
+  }
+  double sinc = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+  double t = x / KAISER_WIDTH;
+  return sinc * besselI0(KAISER_ALPHA * std::sqrt(1.0 - t * t)) / besselI0(KAISER_ALPHA);
+}
+
+inline AxisFilter makeAxisFilter(uint32_t srcSize, uint32_t dstSize, MipFilter filter){
+  double scale = static_cast<double>(srcSize) / dstSize;
+  double support = filter == MipFilter::Box ? scale : 2.0 * KAISER_WIDTH * scale;
+
+  AxisFilter axis;
+  // an integer box scale starts on a texel boundary and needs no extra tap
+  bool aligned = filter == MipFilter::Box && scale == std::floor(scale);
+  axis.taps = static_cast<uint32_t>(std::ceil(support)) + (aligned ? 0 : 1);
+  axis.sources.resize(static_cast<size_t>(dstSize) * axis.taps);
+  axis.weights.resize(static_cast<size_t>(dstSize) * axis.taps);
+
+  for(uint32_t x = 0; x < dstSize; x++){
+    double center = (x + 0.5) * scale;
+    int64_t first = static_cast<int64_t>(std::floor(center - support / 2.0));
+    double sum = 0.0;
+    std::vector<double> w(axis.taps);
+
+    for(uint32_t t = 0; t < axis.taps; t++){
+      int64_t i = first + t;
+      if(filter == MipFilter::Box){
+        double lo = std::max<double>(static_cast<double>(i), x * scale);
+        double hi = std::min<double>(static_cast<double>(i + 1), (x + 1) * scale);
+        w[t] = std::max(0.0, hi - lo);
+      } else {
+        w[t] = kaiser((i + 0.5 - center) / scale);
+      }
+      sum += w[t];
+    }
+
+    for(uint32_t t = 0; t < axis.taps; t++){
+      int64_t i = std::clamp<int64_t>(first + t, 0, static_cast<int64_t>(srcSize) - 1);
+      axis.sources[x * axis.taps + t] = static_cast<uint32_t>(i);
+      axis.weights[x * axis.taps + t] = static_cast<float>(w[t] / sum);
+    }
+  }
+  return axis;
+}
+
+// runs fn over [0, count) rows, on the pool if there is one
+template<typename F>
+void forRows(ThreadPool* pool, uint32_t count, uint32_t rowPixels, F&& fn){
+  if(pool == nullptr){
+    fn(0, count);
+    return;
+  }
+  size_t rowsPerChunk = std::max<size_t>(1, (64 * 1024) / std::max<uint32_t>(rowPixels, 1));
+  pool->parallelFor(count, rowsPerChunk, [&](size_t begin, size_t end){
+    fn(static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+  });
+}
+
+// out pixel x = sum of weights * row pixels
+inline void filterRowScalar(const float* row, const AxisFilter& axis, uint32_t width, float* out){
+  for(uint32_t x = 0; x < width; x++){
+    const uint32_t* src = &axis.sources[x * axis.taps];
+    const float* w = &axis.weights[x * axis.taps];
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    for(uint32_t t = 0; t < axis.taps; t++){
+      const float* p = row + src[t] * 4;
+      for(int c = 0; c < 4; c++){
+        acc[c] += w[t] * p[c];
+      }
+    }
+    for(int c = 0; c < 4; c++){
+      out[x * 4 + c] = acc[c];
+    }
+  }
+}
+
+// out = sum of weights[t] * rows[t], over floats [begin, end)
+inline void blendRowsScalar(const float* const* rows, const float* weights, uint32_t taps, size_t begin, size_t end, float* out){
+  for(size_t i = begin; i < end; i++){
+    float acc = 0.0f;
+    for(uint32_t t = 0; t < taps; t++){
+      acc += weights[t] * rows[t][i];
+    }
+    out[i] = acc;
+  }
+}
+
+inline void filterRowSimd(const float* row, const AxisFilter& axis, uint32_t width, float* out){
+#if defined(MIP_GENERATOR_SSE)
+  // one RGBA texel per register
+  for(uint32_t x = 0; x < width; x++){
+    const uint32_t* src = &axis.sources[x * axis.taps];
+    const float* w = &axis.weights[x * axis.taps];
+    __m128 acc = _mm_setzero_ps();
+    for(uint32_t t = 0; t < axis.taps; t++){
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[t]), _mm_loadu_ps(row + src[t] * 4)));
+    }
+    _mm_storeu_ps(out + x * 4, acc);
+  }
+#elif defined(MIP_GENERATOR_NEON)
+  for(uint32_t x = 0; x < width; x++){
+    const uint32_t* src = &axis.sources[x * axis.taps];
+    const float* w = &axis.weights[x * axis.taps];
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for(uint32_t t = 0; t < axis.taps; t++){
+      acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(row + src[t] * 4), w[t]));
+    }
+    vst1q_f32(out + x * 4, acc);
+  }
+#else
+  filterRowScalar(row, axis, width, out);
+#endif
+}
+
+inline bool avx2Supported(){
+#if defined(MIP_GENERATOR_AVX2)
+  static const bool supported = __builtin_cpu_supports("avx2");
+  return supported;
+#else
+  return false;
+#endif
+}
+
+#if defined(MIP_GENERATOR_AVX2)
+// handles whole groups of eight floats and returns where the narrower loops start
+__attribute__((target("avx2")))
+inline size_t blendRowsAvx2(const float* const* rows, const float* weights, uint32_t taps, size_t count, float* out){
+  size_t i = 0;
+  for(; i + 8 <= count; i += 8){
+    __m256 acc = _mm256_setzero_ps();
+    for(uint32_t t = 0; t < taps; t++){
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(weights[t]), _mm256_loadu_ps(rows[t] + i)));
+    }
+    _mm256_storeu_ps(out + i, acc);
+  }
+  return i;
+}
+#endif
+
+inline void blendRowsSimd(const float* const* rows, const float* weights, uint32_t taps, size_t count, float* out){
+  size_t i = 0;
+#if defined(MIP_GENERATOR_AVX2)
+  if(avx2Supported()){
+    i = blendRowsAvx2(rows, weights, taps, count, out);
+  }
+#endif
+#if defined(MIP_GENERATOR_SSE)
+  for(; i + 4 <= count; i += 4){
+    __m128 acc = _mm_setzero_ps();
+    for(uint32_t t = 0; t < taps; t++){
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(weights[t]), _mm_loadu_ps(rows[t] + i)));
+    }
+    _mm_storeu_ps(out + i, acc);
+  }
+#elif defined(MIP_GENERATOR_NEON)
+  for(; i + 4 <= count; i += 4){
+    float32x4_t acc = vdupq_n_f32(0.0f);
+    for(uint32_t t = 0; t < taps; t++){
+      acc = vaddq_f32(acc, vmulq_n_f32(vld1q_f32(rows[t] + i), weights[t]));
+    }
+    vst1q_f32(out + i, acc);
+  }
+#endif
+  blendRowsScalar(rows, weights, taps, i, count, out);
+}
+
+// separable resample: horizontal pass into a dstWidth x srcHeight buffer,
+// then the vertical pass, both split into row ranges across the pool
+inline LinearImage resample(const LinearImage& src, uint32_t dstWidth, uint32_t dstHeight, MipFilter filter,
+                            ThreadPool* pool, bool simd){
+  AxisFilter axisX = makeAxisFilter(src.width, dstWidth, filter);
+  AxisFilter axisY = makeAxisFilter(src.height, dstHeight, filter);
+
+  std::vector<float> horizontal(static_cast<size_t>(dstWidth) * src.height * 4);
+  forRows(pool, src.height, src.width, [&](uint32_t begin, uint32_t end){
+    for(uint32_t y = begin; y < end; y++){
+      const float* row = &src.pixels[static_cast<size_t>(y) * src.width * 4];
+      float* out = &horizontal[static_cast<size_t>(y) * dstWidth * 4];
+      if(simd){
+        filterRowSimd(row, axisX, dstWidth, out);
+      } else {
+        filterRowScalar(row, axisX, dstWidth, out);
+      }
+    }
+  });
+
+  LinearImage dst;
+  dst.width = dstWidth;
+  dst.height = dstHeight;
+  dst.pixels.resize(static_cast<size_t>(dstWidth) * dstHeight * 4);
+  forRows(pool, dstHeight, dstWidth * axisY.taps, [&](uint32_t begin, uint32_t end){
+    std::vector<const float*> rows(axisY.taps);
+    for(uint32_t y = begin; y < end; y++){
+      for(uint32_t t = 0; t < axisY.taps; t++){
+        rows[t] = &horizontal[static_cast<size_t>(axisY.sources[y * axisY.taps + t]) * dstWidth * 4];
+      }
+      const float* weights = &axisY.weights[y * axisY.taps];
+      float* out = &dst.pixels[static_cast<size_t>(y) * dstWidth * 4];
+      if(simd){
+        blendRowsSimd(rows.data(), weights, axisY.taps, static_cast<size_t>(dstWidth) * 4, out);
+      } else {
+        blendRowsScalar(rows.data(), weights, axisY.taps, 0, static_cast<size_t>(dstWidth) * 4, out);
+      }
+    }
+  });
+  return dst;
+}
+
+inline LinearImage toLinear(const uint8_t* rgba, uint32_t width, uint32_t height, ThreadPool* pool){
+  const std::array<float, 256>& table = srgbToLinearTable();
+  LinearImage image;
+  image.width = width;
+  image.height = height;
+  image.pixels.resize(static_cast<size_t>(width) * height * 4);
+  forRows(pool, height, width, [&](uint32_t begin, uint32_t end){
+    for(size_t i = static_cast<size_t>(begin) * width; i < static_cast<size_t>(end) * width; i++){
+      image.pixels[i * 4 + 0] = table[rgba[i * 4 + 0]];
+      image.pixels[i * 4 + 1] = table[rgba[i * 4 + 1]];
+      image.pixels[i * 4 + 2] = table[rgba[i * 4 + 2]];
+      image.pixels[i * 4 + 3] = rgba[i * 4 + 3] / 255.0f;
+    }
+  });
+  return image;
+}
+
+inline ImageRGBA8 toSrgb(const LinearImage& image, ThreadPool* pool, bool exact){
+  const std::vector<uint8_t>& table = linearToSrgbTable();
+  ImageRGBA8 out;
+  out.width = image.width;
+  out.height = image.height;
+  out.pixels.resize(static_cast<size_t>(image.width) * image.height * 4);
+  forRows(pool, image.height, image.width, [&](uint32_t begin, uint32_t end){
+    for(size_t i = static_cast<size_t>(begin) * image.width; i < static_cast<size_t>(end) * image.width; i++){
+      for(int c = 0; c < 3; c++){
+        float v = std::clamp(image.pixels[i * 4 + c], 0.0f, 1.0f);
+        out.pixels[i * 4 + c] = exact ? linearToSrgb(v)
+                                      : table[static_cast<uint32_t>(v * (LINEAR_TO_SRGB_STEPS - 1) + 0.5f)];
+      }
+      float a = std::clamp(image.pixels[i * 4 + 3], 0.0f, 1.0f);
+      out.pixels[i * 4 + 3] = static_cast<uint8_t>(a * 255.0f + 0.5f);
+    }
+  });
+  return out;
+}
+
+inline std::vector<ImageRGBA8> generateMips(const uint8_t* rgba, uint32_t width, uint32_t height, MipFilter filter,
+                                            ThreadPool* pool, bool simd){
+  std::vector<ImageRGBA8> mips;
+  uint32_t levels = mipLevelCount(width, height);
+  if(levels < 2){
+    return mips;
+  }
+  mips.reserve(levels - 1);
+
+  LinearImage current = toLinear(rgba, width, height, pool);
+  for(uint32_t i = 1; i < levels; i++){
+    current = resample(current, std::max(current.width / 2, 1u), std::max(current.height / 2, 1u), filter, pool, simd);
+    mips.push_back(toSrgb(current, pool, !simd));
+  }
+  return mips;
+}
+
+} // namespace mip_detail
+
+// Levels 1..n of the chain for an RGBA8 sRGB image of any size. Filtering is
+// done in linear space with the SIMD kernels, rows are split across the pool
+// when one is given. Level sizes follow Vulkan's max(size >> i, 1).
+inline std::vector<ImageRGBA8> generateMips(const uint8_t* rgba, uint32_t width, uint32_t height,
+                                            MipFilter filter = MipFilter::Box, ThreadPool* pool = nullptr){
+  return mip_detail::generateMips(rgba, width, height, filter, pool, true);
+}
+
+// true if generateMips() blends rows eight floats at a time on this CPU
+inline bool mipGeneratorUsesAvx2(){
+  return mip_detail::avx2Supported();
+}
+
+// scalar, single threaded and with exact sRGB encoding, the baseline the
+// SIMD path is checked against
+inline std::vector<ImageRGBA8> generateMipsReference(const uint8_t* rgba, uint32_t width, uint32_t height,
+                                                     MipFilter filter = MipFilter::Box){
+  return mip_detail::generateMips(rgba, width, height, filter, nullptr, false);
+}
+
+// full mip chain, level 0 is the source image
+inline std::vector<ImageRGBA8> generateMipChain(ImageRGBA8 base, MipFilter filter = MipFilter::Box, ThreadPool* pool = nullptr){
+  std::vector<ImageRGBA8> mips = generateMips(base.pixels.data(), base.width, base.height, filter, pool);
+  std::vector<ImageRGBA8> chain;
+  chain.reserve(mips.size() + 1);
+  chain.push_back(std::move(base));
+  for(ImageRGBA8& mip : mips){
+    chain.push_back(std::move(mip));
+  }
+  return chain;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <tiny_obj_loader.h>
+
+#include "thread_pool.h"
+#include "vertex.h"
+#include "vertex_welder.h"
+
+// below this many corners per chunk the pool overhead outweighs the work
+constexpr size_t MIN_CHUNK_CORNERS = 64 * 1024;
+
+struct ObjData{
+  tinyobj::attrib_t attrib;
+  std::vector<tinyobj::shape_t> shapes;
+};
+
+inline ObjData parseObj(const std::string& path){
+  ObjData obj;
+  std::vector<tinyobj::material_t> materials;
+  std::string err;
+  std::string warn;
+
+  if (!tinyobj::LoadObj(&obj.attrib, &obj.shapes, &materials, &warn, &err, path.c_str())) {
+    throw std::runtime_error(err);
+  }
+  return obj;
+}
+
+inline Vertex makeObjVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& index){
+  Vertex vertex{};
+  vertex.pos = {
+    attrib.vertices[3 * index.vertex_index + 0],
+    attrib.vertices[3 * index.vertex_index + 1],
+    attrib.vertices[3 * index.vertex_index + 2]
+  };
+
+  vertex.texCoord = {
+    attrib.texcoords[2 * index.texcoord_index + 0],
+    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+  };
+
+  vertex.color = {1.0f, 1.0f, 1.0f};
+  return vertex;
+}
+
+inline size_t objIndexCount(const ObjData& obj){
+  size_t indexCount = 0;
+  for (const auto& shape : obj.shapes) {
+    indexCount += shape.mesh.indices.size();
+  }
+  return indexCount;
+}
+
+// welds identical vertices of all shapes into one indexed mesh
+inline void weldObj(const ObjData& obj, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                    float weldEpsilon = 0.0f){
+  size_t indexCount = objIndexCount(obj);
+
+  // OBJ corners share positions heavily, a third of the corner count is a
+  // generous upper bound for typical meshes and avoids most rehashing
+  VertexWelder welder(indexCount / 3, weldEpsilon);
+  indices.clear();
+  indices.reserve(indexCount);
+
+  for (const auto& shape : obj.shapes) {
+    for (const auto& index : shape.mesh.indices) {
+      indices.push_back(welder.weld(makeObjVertex(obj.attrib, index)));
+    }
+  }
+
+  vertices = welder.takeVertices();
+}
+
+// Same result as weldObj(), bit for bit. The corner stream is cut into chunks
+// that are welded independently on the pool; the chunk-local unique vertices
+// are then merged into the global welder in chunk order, which reproduces the
+// serial first-occurrence numbering, and finally the chunk-local indices are
+// remapped in parallel.
+inline void weldObjParallel(const ObjData& obj, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                            ThreadPool& pool, float weldEpsilon = 0.0f){
+  size_t indexCount = objIndexCount(obj);
+  if(pool.size() <= 1 || indexCount < 2 * MIN_CHUNK_CORNERS){
+    weldObj(obj, vertices, indices, weldEpsilon);
+    return;
+  }
+
+  // first global corner of every shape
+  std::vector<size_t> shapeOffsets(obj.shapes.size() + 1, 0);
+  for(size_t s = 0; s < obj.shapes.size(); s++){
+    shapeOffsets[s + 1] = shapeOffsets[s] + obj.shapes[s].mesh.indices.size();
+  }
+
+  size_t chunkSize = std::max(MIN_CHUNK_CORNERS, (indexCount + pool.size() * 4 - 1) / (pool.size() * 4));
+  size_t chunkCount = (indexCount + chunkSize - 1) / chunkSize;
+
+  std::vector<std::vector<Vertex>> chunkVertices(chunkCount);
+  indices.assign(indexCount, 0);
+
+  pool.parallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk){
+    for(size_t chunk = firstChunk; chunk < lastChunk; chunk++){
+      size_t begin = chunk * chunkSize;
+      size_t end = std::min(begin + chunkSize, indexCount);
+      VertexWelder welder((end - begin) / 3, weldEpsilon);
+
+      size_t shape = std::upper_bound(shapeOffsets.begin(), shapeOffsets.end(), begin) - shapeOffsets.begin() - 1;
+      for(size_t corner = begin; corner < end; corner++){
+        while(corner >= shapeOffsets[shape + 1]){
+          shape++;
+        }
+        const tinyobj::index_t& index = obj.shapes[shape].mesh.indices[corner - shapeOffsets[shape]];
+        indices[corner] = welder.weld(makeObjVertex(obj.attrib, index));
+      }
+      chunkVertices[chunk] = welder.takeVertices();
+    }
+  });
+
+  VertexWelder welder(indexCount / 3, weldEpsilon);
+  std::vector<std::vector<uint32_t>> chunkRemap(chunkCount);
+  for(size_t chunk = 0; chunk < chunkCount; chunk++){
+    chunkRemap[chunk].reserve(chunkVertices[chunk].size());
+    for(const Vertex& vertex : chunkVertices[chunk]){
+      chunkRemap[chunk].push_back(welder.weld(vertex));
+    }
+  }
+
+  pool.parallelFor(chunkCount, 1, [&](size_t firstChunk, size_t lastChunk){
+    for(size_t chunk = firstChunk; chunk < lastChunk; chunk++){
+      size_t begin = chunk * chunkSize;
+      size_t end = std::min(begin + chunkSize, indexCount);
+      const std::vector<uint32_t>& remap = chunkRemap[chunk];
+      for(size_t corner = begin; corner < end; corner++){
+        indices[corner] = remap[indices[corner]];
+      }
+    }
+  });
+
+  vertices = welder.takeVertices();
+}
+
+// parses an OBJ file and welds identical vertices into an indexed mesh
+inline void loadObjModel(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                         float weldEpsilon = 0.0f){
+  weldObj(parseObj(path), vertices, indices, weldEpsilon);
+}
+
+inline void loadObjModel(const std::string& path, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices,
+                         ThreadPool& pool, float weldEpsilon = 0.0f){
+  weldObjParallel(parseObj(path), vertices, indices, pool, weldEpsilon);
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.h"
+
+// VkPipelineCache backed by a file. The blob is only handed to the driver
+// when its header names this vendor, device and pipelineCacheUUID (drivers
+// change the UUID whenever their cache format or compiler changes); anything
+// else starts an empty cache. save() writes through writeFileAtomic so two
+// instances exiting together never leave a torn file behind.
+class PipelineCache{
+public:
+  PipelineCache(VkDevice device, const VkPhysicalDeviceProperties& properties, std::string path)
+    : device(device), path(std::move(path)) {
+    std::vector<uint8_t> blob = readBlob();
+    const char* rejected = validate(blob, properties);
+    status = rejected ? rejected : "loaded";
+    if(rejected){
+      blob.clear();
+    }
+    loadedBytes = blob.size();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = blob.size();
+    cacheInfo.pInitialData = blob.empty() ? nullptr : blob.data();
+
+    if(vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache) != VK_SUCCESS){
+      throw std::runtime_error("failed to create pipeline cache!");
+    }
+  }
+
+  PipelineCache(const PipelineCache&) = delete;
+  PipelineCache& operator=(const PipelineCache&) = delete;
+
+  ~PipelineCache(){
+    vkDestroyPipelineCache(device, cache, nullptr);
+  }
+
+  VkPipelineCache handle() const { return cache; }
+
+  // true when pipelines can be served from the file that was loaded
+  bool warm() const { return loadedBytes > 0; }
+
+  // "loaded", or why the file on disk was not used
+  const std::string& loadStatus() const { return status; }
+
+  bool save(){
+    size_t size = 0;
+    if(vkGetPipelineCacheData(device, cache, &size, nullptr) != VK_SUCCESS){
+      return false;
+    }
+    std::vector<uint8_t> blob(size);
+    if(vkGetPipelineCacheData(device, cache, &size, blob.data()) != VK_SUCCESS){
+      return false;
+    }
+    blob.resize(size);
+    return writeFileAtomic(path, blob);
+  }
+
+private:
+  VkDevice device;
+  std::string path;
+  VkPipelineCache cache = VK_NULL_HANDLE;
+  size_t loadedBytes = 0;
+  std::string status;
+
+  std::vector<uint8_t> readBlob() const {
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open()){
+      return {};
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  }
+
+  // nullptr when the blob may be passed to the driver, the reason otherwise
+  static const char* validate(const std::vector<uint8_t>& blob, const VkPhysicalDeviceProperties& properties){
+    if(blob.empty()){
+      return "no cache file";
+    }
+    VkPipelineCacheHeaderVersionOne header{};
+    if(blob.size() < sizeof(header)){
+      return "truncated header";
+    }
+    memcpy(&header, blob.data(), sizeof(header));
+    if(header.headerSize < sizeof(header) || header.headerSize > blob.size()){
+      return "bad header size";
+    }
+    if(header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE){
+      return "unknown header version";
+    }
+    if(header.vendorID != properties.vendorID || header.deviceID != properties.deviceID){
+      return "written by another device";
+    }
+    if(memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0){
+      return "written by another driver version";
+    }
+    return nullptr;
+  }
+};
@@ -0,0 +1,273 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <fstream>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cpu_trace.h"
+#include "thread_pool.h"
+
+// Everything a graphics pipeline is built from. Viewport and scissor are
+// always dynamic, so one description serves every swapchain size.
+struct GraphicsPipelineDesc{
+  // SPIR-V files
+  std::string vertexShader;
+  std::string fragmentShader;
+
+  // per-vertex mesh data and optionally per-instance data
+  std::vector<VkVertexInputBindingDescription> bindings;
+  std::vector<VkVertexInputAttributeDescription> attributes;
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+
+  VkPolygonMode polygonMode = VK_POLYGON_MODE_FILL;
+  VkCullModeFlags cullMode = VK_CULL_MODE_BACK_BIT;
+  VkFrontFace frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+
+  bool depthTest = true;
+  bool depthWrite = true;
+  VkCompareOp depthCompareOp = VK_COMPARE_OP_LESS;
+  // source alpha blending on the single color attachment
+  bool alphaBlend = false;
+
+  VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+  // 0 leaves sample shading off
+  float minSampleShading = 0.0f;
+
+  VkPipelineLayout layout = VK_NULL_HANDLE;
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+  uint32_t subpass = 0;
+};
+
+struct CompiledPipeline{
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  double compileMs = 0.0;
+};
+
+inline std::vector<char> readShaderFile(const std::string& path){
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if(!file.is_open()){
+    throw std::runtime_error("failed to open shader " + path + "!");
+  }
+  std::vector<char> code(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(code.data(), static_cast<std::streamsize>(code.size()));
+  return code;
+}
+
+inline VkShaderModule createShaderModule(VkDevice device, const std::vector<char>& code){
+  VkShaderModuleCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  createInfo.codeSize = code.size();
+  createInfo.pCode = reinterpret_cast<const uint32_t*>(code.data());
+
+  VkShaderModule shaderModule;
+  if(vkCreateShaderModule(device, &createInfo, nullptr, &shaderModule) != VK_SUCCESS){
+    throw std::runtime_error("Could not create shader module!");
+  }
+  return shaderModule;
+}
+
+// blocking, safe to call from several threads with the same cache
+inline CompiledPipeline buildGraphicsPipeline(VkDevice device, VkPipelineCache cache, const GraphicsPipelineDesc& desc){
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  VkShaderModule vertShaderModule = createShaderModule(device, readShaderFile(desc.vertexShader));
+  VkShaderModule fragShaderModule = createShaderModule(device, readShaderFile(desc.fragmentShader));
+
+  VkPipelineShaderStageCreateInfo shaderStages[2]{};
+  shaderStages[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
+  shaderStages[0].module = vertShaderModule;
+  shaderStages[0].pName = "main";
+  shaderStages[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStages[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  shaderStages[1].module = fragShaderModule;
+  shaderStages[1].pName = "main";
+
+  VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState{};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
+
+  VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
+  vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertexInputInfo.vertexBindingDescriptionCount = static_cast<uint32_t>(desc.bindings.size());
+  vertexInputInfo.pVertexBindingDescriptions = desc.bindings.data();
+  vertexInputInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(desc.attributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = desc.attributes.data();
+
+  VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
+  inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  inputAssembly.topology = desc.topology;
+  inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+  // the actual viewport and scissor are set while recording
+  VkPipelineViewportStateCreateInfo viewportState{};
+  viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewportState.viewportCount = 1;
+  viewportState.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer{};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = desc.polygonMode;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = desc.cullMode;
+  rasterizer.frontFace = desc.frontFace;
+  rasterizer.depthBiasEnable = VK_FALSE;
+
+  VkPipelineMultisampleStateCreateInfo multisampling{};
+  multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = desc.minSampleShading > 0.0f ? VK_TRUE : VK_FALSE;
+  multisampling.rasterizationSamples = desc.samples;
+  multisampling.minSampleShading = desc.minSampleShading;
+  multisampling.pSampleMask = nullptr;
+  multisampling.alphaToCoverageEnable = VK_FALSE;
+  multisampling.alphaToOneEnable = VK_FALSE;
+
+  VkPipelineColorBlendAttachmentState colorBlendAttachment{};
+  colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.blendEnable = desc.alphaBlend ? VK_TRUE : VK_FALSE;
+  colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+  VkPipelineColorBlendStateCreateInfo colorBlending{};
+  colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  colorBlending.logicOpEnable = VK_FALSE;
+  colorBlending.logicOp = VK_LOGIC_OP_COPY;
+  colorBlending.attachmentCount = 1;
+  colorBlending.pAttachments = &colorBlendAttachment;
+
+  VkPipelineDepthStencilStateCreateInfo depthStencil{};
+  depthStencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depthStencil.depthTestEnable = desc.depthTest ? VK_TRUE : VK_FALSE;
+  depthStencil.depthWriteEnable = desc.depthWrite ? VK_TRUE : VK_FALSE;
+  depthStencil.depthCompareOp = desc.depthCompareOp;
+  depthStencil.depthBoundsTestEnable = VK_FALSE;
+  depthStencil.minDepthBounds = 0.0f;
+  depthStencil.maxDepthBounds = 1.0f;
+  depthStencil.stencilTestEnable = VK_FALSE;
+
+  VkGraphicsPipelineCreateInfo pipelineInfo{};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipelineInfo.stageCount = 2;
+  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.pVertexInputState = &vertexInputInfo;
+  pipelineInfo.pInputAssemblyState = &inputAssembly;
+  pipelineInfo.pViewportState = &viewportState;
+  pipelineInfo.pRasterizationState = &rasterizer;
+  pipelineInfo.pMultisampleState = &multisampling;
+  pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pColorBlendState = &colorBlending;
+  pipelineInfo.pDynamicState = &dynamicState;
+  pipelineInfo.layout = desc.layout;
+  pipelineInfo.renderPass = desc.renderPass;
+  pipelineInfo.subpass = desc.subpass;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+  pipelineInfo.basePipelineIndex = -1;
+
+  CompiledPipeline compiled;
+  VkResult result = vkCreateGraphicsPipelines(device, cache, 1, &pipelineInfo, nullptr, &compiled.pipeline);
+
+  vkDestroyShaderModule(device, vertShaderModule, nullptr);
+  vkDestroyShaderModule(device, fragShaderModule, nullptr);
+  if(result != VK_SUCCESS){
+    throw std::runtime_error("failed to create graphics pipeline!");
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  compiled.compileMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+  return compiled;
+}
+
+// A pipeline that may still be compiling. Cheap to copy; the compiler that
+// produced it owns the VkPipeline.
+class PipelineHandle{
+public:
+  PipelineHandle() = default;
+  explicit PipelineHandle(std::shared_future<CompiledPipeline> future) : future(std::move(future)) {}
+
+  bool valid() const { return future.valid(); }
+
+  bool ready() const {
+    return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  }
+
+  // blocks until compiled, compile errors are rethrown
+  const CompiledPipeline& wait() const { return future.get(); }
+
+  // never blocks: the compiled pipeline once it is ready, fallback until then
+  VkPipeline getOr(VkPipeline fallback) const {
+    return ready() ? future.get().pipeline : fallback;
+  }
+
+private:
+  std::shared_future<CompiledPipeline> future;
+};
+
+// Compiles pipeline descriptions on the worker pool. All of them go through
+// the one VkPipelineCache, which Vulkan synchronizes internally, so a
+// pipeline compiled once is cheap for every later run that loads the cache.
+// The compiler owns every pipeline it returned and destroys them, after
+// waiting for compiles still in progress, when it is destroyed.
+class PipelineCompiler{
+public:
+  PipelineCompiler(VkDevice device, VkPipelineCache cache, ThreadPool& pool)
+    : device(device), cache(cache), pool(pool) {}
+
+  PipelineCompiler(const PipelineCompiler&) = delete;
+  PipelineCompiler& operator=(const PipelineCompiler&) = delete;
+
+  ~PipelineCompiler(){
+    std::lock_guard<std::mutex> lock(mutex);
+    for(const std::shared_future<CompiledPipeline>& compile : compiles){
+      try{
+        vkDestroyPipeline(device, compile.get().pipeline, nullptr);
+      } catch(const std::exception&){
+        // a failed compile has nothing to destroy, its error went to whoever waited on it
+      }
+    }
+  }
+
+  PipelineHandle compileAsync(GraphicsPipelineDesc desc){
+    std::shared_future<CompiledPipeline> future = pool.submit([device = device, cache = cache, desc = std::move(desc)]{
+      CpuTraceScope traceScope("compile pipeline");
+      return buildGraphicsPipeline(device, cache, desc);
+    }).share();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    compiles.push_back(future);
+    return PipelineHandle(future);
+  }
+
+  // on the calling thread, for pipelines that are needed before the first frame
+  PipelineHandle compile(const GraphicsPipelineDesc& desc){
+    std::promise<CompiledPipeline> promise;
+    promise.set_value(buildGraphicsPipeline(device, cache, desc));
+    std::shared_future<CompiledPipeline> future = promise.get_future().share();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    compiles.push_back(future);
+    return PipelineHandle(future);
+  }
+
+private:
+  VkDevice device;
+  VkPipelineCache cache;
+  ThreadPool& pool;
+
+  std::mutex mutex;
+  std::vector<std::shared_future<CompiledPipeline>> compiles;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "mesh_cache.h"
+#include "pipeline_compiler.h"
+
+// Compact identity of a graphics pipeline. Shader paths and vertex layouts
+// are interned by the registry into small ids, so the key is a fixed size POD
+// that is hashed and compared bytewise.
+struct PipelineKey{
+  // pipelines are only shared with the exact render pass and layout they were
+  // created against, compatible render passes are not merged
+  uint64_t renderPass = 0;
+  uint64_t layout = 0;
+  uint32_t vertexShader = 0;
+  uint32_t fragmentShader = 0;
+  uint32_t vertexLayout = 0;
+  uint32_t subpass = 0;
+  uint32_t samples = 0;
+  uint32_t minSampleShadingBits = 0;
+  uint8_t topology = 0;
+  uint8_t polygonMode = 0;
+  uint8_t cullMode = 0;
+  uint8_t frontFace = 0;
+  uint8_t depthTest = 0;
+  uint8_t depthWrite = 0;
+  uint8_t depthCompareOp = 0;
+  uint8_t alphaBlend = 0;
+
+  bool operator==(const PipelineKey& other) const {
+    return memcmp(this, &other, sizeof(PipelineKey)) == 0;
+  }
+};
+static_assert(std::has_unique_object_representations_v<PipelineKey>, "PipelineKey is hashed bytewise, it must not have padding");
+
+struct PipelineKeyHash{
+  size_t operator()(const PipelineKey& key) const {
+    return static_cast<size_t>(hashBytes(&key, sizeof(key)));
+  }
+};
+
+// Returns the existing pipeline for a description it has seen before and
+// compiles one through the PipelineCompiler otherwise, so every variant
+// (wireframe, blend mode, sample count, ...) is created once. Callers keep
+// the handles; looking one up is meant for setup, not for every frame.
+class PipelineRegistry{
+public:
+  explicit PipelineRegistry(PipelineCompiler& compiler) : compiler(compiler) {}
+
+  // compiled on the worker pool the first time the key is seen
+  PipelineHandle get(const GraphicsPipelineDesc& desc){
+    return lookup(desc, true);
+  }
+
+  // compiled on the calling thread the first time the key is seen
+  PipelineHandle getNow(const GraphicsPipelineDesc& desc){
+    return lookup(desc, false);
+  }
+
+  PipelineKey makeKey(const GraphicsPipelineDesc& desc){
+    std::lock_guard<std::mutex> lock(mutex);
+    return makeKeyLocked(desc);
+  }
+
+  size_t size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines.size();
+  }
+
+  uint64_t hits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return hitCount;
+  }
+
+private:
+  struct VertexLayout{
+    std::vector<VkVertexInputBindingDescription> bindings;
+    std::vector<VkVertexInputAttributeDescription> attributes;
+  };
+
+  PipelineCompiler& compiler;
+  mutable std::mutex mutex;
+  std::vector<std::string> shaders;
+  std::vector<VertexLayout> vertexLayouts;
+  std::unordered_map<PipelineKey, PipelineHandle, PipelineKeyHash> pipelines;
+  uint64_t hitCount = 0;
+
+  // the lock is held through a synchronous compile, those only happen during setup
+  PipelineHandle lookup(const GraphicsPipelineDesc& desc, bool async){
+    std::lock_guard<std::mutex> lock(mutex);
+    PipelineKey key = makeKeyLocked(desc);
+    auto it = pipelines.find(key);
+    if(it != pipelines.end()){
+      hitCount++;
+      return it->second;
+    }
+    PipelineHandle handle = async ? compiler.compileAsync(desc) : compiler.compile(desc);
+    pipelines.emplace(key, handle);
+    return handle;
+  }
+
+  PipelineKey makeKeyLocked(const GraphicsPipelineDesc& desc){
+    PipelineKey key;
+    key.renderPass = handleBits(desc.renderPass);
+    key.layout = handleBits(desc.layout);
+    key.vertexShader = shaderId(desc.vertexShader);
+    key.fragmentShader = shaderId(desc.fragmentShader);
+    key.vertexLayout = vertexLayoutId(desc.bindings, desc.attributes);
+    key.subpass = desc.subpass;
+    key.samples = static_cast<uint32_t>(desc.samples);
+    memcpy(&key.minSampleShadingBits, &desc.minSampleShading, sizeof(float));
+    key.topology = static_cast<uint8_t>(desc.topology);
+    key.polygonMode = static_cast<uint8_t>(desc.polygonMode);
+    key.cullMode = static_cast<uint8_t>(desc.cullMode);
+    key.frontFace = static_cast<uint8_t>(desc.frontFace);
+    key.depthTest = desc.depthTest;
+    key.depthWrite = desc.depthWrite;
+    key.depthCompareOp = static_cast<uint8_t>(desc.depthCompareOp);
+    key.alphaBlend = desc.alphaBlend;
+    return key;
+  }
+
+  // Vulkan handles are pointers or uint64_t depending on the platform
+  template<typename Handle>
+  static uint64_t handleBits(Handle handle){
+    uint64_t bits = 0;
+    memcpy(&bits, &handle, sizeof(handle));
+    return bits;
+  }
+
+  uint32_t shaderId(const std::string& path){
+    for(size_t i = 0; i < shaders.size(); i++){
+      if(shaders[i] == path){
+        return static_cast<uint32_t>(i);
+      }
+    }
+    shaders.push_back(path);
+    return static_cast<uint32_t>(shaders.size() - 1);
+  }
+
+  uint32_t vertexLayoutId(const std::vector<VkVertexInputBindingDescription>& bindings,
+                          const std::vector<VkVertexInputAttributeDescription>& attributes){
+    for(size_t i = 0; i < vertexLayouts.size(); i++){
+      if(sameLayout(vertexLayouts[i], bindings, attributes)){
+        return static_cast<uint32_t>(i);
+      }
+    }
+    vertexLayouts.push_back(VertexLayout{bindings, attributes});
+    return static_cast<uint32_t>(vertexLayouts.size() - 1);
+  }
+
+  static bool sameLayout(const VertexLayout& layout, const std::vector<VkVertexInputBindingDescription>& bindings,
+                         const std::vector<VkVertexInputAttributeDescription>& attributes){
+    if(layout.bindings.size() != bindings.size() || layout.attributes.size() != attributes.size()){
+      return false;
+    }
+    for(size_t i = 0; i < bindings.size(); i++){
+      const VkVertexInputBindingDescription& a = layout.bindings[i];
+      const VkVertexInputBindingDescription& b = bindings[i];
+      if(a.binding != b.binding || a.stride != b.stride || a.inputRate != b.inputRate){
+        return false;
+      }
+    }
+    for(size_t i = 0; i < attributes.size(); i++){
+      const VkVertexInputAttributeDescription& a = layout.attributes[i];
+      const VkVertexInputAttributeDescription& b = attributes[i];
+      if(a.location != b.location || a.binding != b.binding || a.format != b.format || a.offset != b.offset){
+        return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include "cpu_trace.h"
+#include "thread_pool.h"
+
+// Records a draw list into secondary command buffers on the worker pool.
+// The list is split into up to slotCount contiguous ranges. Every slot owns
+// a command pool per frame in flight, so a slot only ever touches its own
+// pool and the pool is reset as a whole once the frame's fence has signaled.
+// The primary buffer begins the render pass with
+// VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS and executes what record()
+// returns.
+class SecondaryRecorder{
+public:
+  // records items [begin, end) into an already begun secondary buffer, it inherits no state
+  using RecordFn = std::function<void(VkCommandBuffer, size_t, size_t)>;
+
+  SecondaryRecorder(VkDevice device, uint32_t queueFamily, uint32_t frameCount, uint32_t slotCount,
+                    size_t minItemsPerSlot = 64)
+    : device(device), slotCount(std::max(slotCount, 1u)), minItemsPerSlot(std::max<size_t>(minItemsPerSlot, 1)) {
+    frames.resize(frameCount);
+    for(Frame& frame : frames){
+      frame.pools.resize(this->slotCount, VK_NULL_HANDLE);
+      frame.commandBuffers.resize(this->slotCount, VK_NULL_HANDLE);
+      for(uint32_t slot = 0; slot < this->slotCount; slot++){
+        VkCommandPoolCreateInfo poolInfo{};
+        poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        poolInfo.queueFamilyIndex = queueFamily;
+        if(vkCreateCommandPool(device, &poolInfo, nullptr, &frame.pools[slot]) != VK_SUCCESS){
+          throw std::runtime_error("failed to create secondary command pool!");
+        }
+
+        VkCommandBufferAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        allocInfo.commandPool = frame.pools[slot];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        allocInfo.commandBufferCount = 1;
+        if(vkAllocateCommandBuffers(device, &allocInfo, &frame.commandBuffers[slot]) != VK_SUCCESS){
+          throw std::runtime_error("failed to allocate secondary command buffer!");
+        }
+      }
+    }
+    executed.reserve(this->slotCount);
+  }
+
+  SecondaryRecorder(const SecondaryRecorder&) = delete;
+  SecondaryRecorder& operator=(const SecondaryRecorder&) = delete;
+
+  ~SecondaryRecorder(){
+    for(Frame& frame : frames){
+      for(VkCommandPool pool : frame.pools){
+        vkDestroyCommandPool(device, pool, nullptr);
+      }
+    }
+  }
+
+  uint32_t slots() const { return slotCount; }
+
+  // Blocks until every range is recorded. The frame's previous submission
+  // must have completed. The returned buffers stay valid until the next
+  // record() of the same frame.
+  const std::vector<VkCommandBuffer>& record(ThreadPool& pool, uint32_t frame, VkRenderPass renderPass, uint32_t subpass,
+                                             VkFramebuffer framebuffer, size_t itemCount, const RecordFn& fn){
+    Frame& slots = frames[frame];
+    size_t usedSlots = std::min<size_t>(slotCount, (itemCount + minItemsPerSlot - 1) / minItemsPerSlot);
+    usedSlots = std::max<size_t>(usedSlots, 1);
+    size_t itemsPerSlot = (itemCount + usedSlots - 1) / usedSlots;
+
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.renderPass = renderPass;
+    inheritance.subpass = subpass;
+    inheritance.framebuffer = framebuffer;
+
+    pool.parallelFor(usedSlots, 1, [&](size_t begin, size_t end){
+      for(size_t slot = begin; slot < end; slot++){
+        CpuTraceScope traceScope("record secondary");
+        vkResetCommandPool(device, slots.pools[slot], 0);
+
+        VkCommandBufferBeginInfo beginInfo{};
+        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+        beginInfo.pInheritanceInfo = &inheritance;
+
+        VkCommandBuffer commandBuffer = slots.commandBuffers[slot];
+        if(vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS){
+          throw std::runtime_error("failed to begin secondary command buffer!");
+        }
+        size_t first = std::min(itemCount, slot * itemsPerSlot);
+        fn(commandBuffer, first, std::min(itemCount, first + itemsPerSlot));
+        if(vkEndCommandBuffer(commandBuffer) != VK_SUCCESS){
+          throw std::runtime_error("failed to record secondary command buffer!");
+        }
+      }
+    });
+
+    executed.assign(slots.commandBuffers.begin(), slots.commandBuffers.begin() + static_cast<ptrdiff_t>(usedSlots));
+    return executed;
+  }
+
+private:
+  struct Frame{
+    std::vector<VkCommandPool> pools;
+    std::vector<VkCommandBuffer> commandBuffers;
+  };
+
+  VkDevice device;
+  uint32_t slotCount;
+  size_t minItemsPerSlot;
+  std::vector<Frame> frames;
+  std::vector<VkCommandBuffer> executed;
+};
@@ -4,17 +4,23 @@ layout(binding = 0) uniform UniformBufferObject {
     mat4 model;
     mat4 view;
     mat4 proj;
+    // dequantizes PackedVertex positions, identity for float vertices
+    vec4 positionScale;
+    vec4 positionOffset;
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inColor;
 layout(location = 2) in vec2 inTexCoord;
+// per instance: placement of the copy, applied after the model's own rotation
+layout(location = 3) in mat4 instanceModel;
 
 layout(location = 0) out vec3 fragColor;
 layout(location = 1) out vec2 fragTexCoord;
 
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    vec3 position = inPosition * ubo.positionScale.xyz + ubo.positionOffset.xyz;
+    gl_Position = ubo.proj * ubo.view * instanceModel * ubo.model * vec4(position, 1.0);
     fragColor = inColor;
     fragTexCoord = inTexCoord;
 }
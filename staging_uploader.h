@@ -0,0 +1,458 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "device_allocator.h"
+
+// Identifies the batch an upload was recorded into. The upload has landed on the
+// GPU once StagingUploader::isComplete() returns true for it.
+struct UploadTicket{
+  uint64_t batch = 0;
+};
+
+// A slice of the persistently mapped ring, write the source data to mapped and
+// reference buffer/offset in the copy commands.
+struct StagingRegion{
+  void* mapped = nullptr;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0;
+};
+
+// Semaphores and stages the graphics submit has to wait on before the acquire
+// barriers recorded by StagingUploader::acquire() may execute.
+struct UploadWaits{
+  std::vector<VkSemaphore> semaphores;
+  std::vector<VkPipelineStageFlags> stages;
+};
+
+// Persistently mapped staging ring. Uploads append to the open batch, which is
+// submitted with one vkQueueSubmit on flush(). Every submitted batch owns the
+// ring bytes it used until its fence signals, so writers only ever block when
+// the ring is full.
+//
+// When the upload queue belongs to a different family than the graphics queue,
+// destinations are released to the graphics family at the end of the batch and
+// the batch signals a semaphore. The renderer records the matching acquire
+// barriers (and any graphics-only follow-up work) with acquire() and waits on
+// the returned semaphores in its next submit, so copies overlap with rendering.
+//
+// A single allocate() can't exceed the ring capacity. uploadBuffer() splits
+// larger buffers into ring sized copies, image uploads that stage their data
+// with allocate() themselves are limited to it.
+class StagingUploader{
+public:
+  static constexpr VkDeviceSize DEFAULT_CAPACITY = 64ull << 20;
+  static constexpr VkDeviceSize MIN_ALIGNMENT = 16;
+
+  StagingUploader(VkDevice logicalDevice, DeviceMemoryAllocator& memoryAllocator, VkQueue uploadQueue,
+                  uint32_t queueFamily, uint32_t graphicsQueueFamily, VkDeviceSize ringCapacity = DEFAULT_CAPACITY)
+    : device(logicalDevice), allocator(memoryAllocator), queue(uploadQueue), uploadFamily(queueFamily),
+      graphicsFamily(graphicsQueueFamily), capacity(ringCapacity) {
+    VkCommandPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = uploadFamily;
+
+    if (vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool) != VK_SUCCESS){
+      throw std::runtime_error("failed to create upload command pool!");
+    }
+
+    VkBufferCreateInfo bufferInfo{};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = capacity;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    if(vkCreateBuffer(device, &bufferInfo, nullptr, &ringBuffer) != VK_SUCCESS){
+      throw std::runtime_error("failed to create staging ring buffer!");
+    }
+
+    VkMemoryRequirements memRequirements;
+    vkGetBufferMemoryRequirements(device, ringBuffer, &memRequirements);
+    ringMemory = allocator.allocate(memRequirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                    ResourceKind::Linear, true);
+    vkBindBufferMemory(device, ringBuffer, ringMemory.memory, ringMemory.offset);
+  }
+
+  StagingUploader(const StagingUploader&) = delete;
+  StagingUploader& operator=(const StagingUploader&) = delete;
+
+  ~StagingUploader(){
+    if(openBatch.commandBuffer != VK_NULL_HANDLE){
+      flush();
+    }
+    while(!inFlight.empty()){
+      retireOldest(true);
+    }
+    for(Batch& batch : freeBatches){
+      vkDestroyFence(device, batch.fence, nullptr);
+    }
+    for(VkSemaphore semaphore : semaphores){
+      vkDestroySemaphore(device, semaphore, nullptr);
+    }
+    vkDestroyCommandPool(device, commandPool, nullptr);
+    vkDestroyBuffer(device, ringBuffer, nullptr);
+    allocator.free(ringMemory);
+  }
+
+  // reserves ring space in the open batch; blocks only if the ring is full
+  StagingRegion allocate(VkDeviceSize size, VkDeviceSize alignment = MIN_ALIGNMENT){
+    if(size > capacity){
+      throw std::runtime_error("upload exceeds staging ring capacity!");
+    }
+    alignment = std::max(alignment, MIN_ALIGNMENT);
+
+    for(;;){
+      uint64_t start = (head + alignment - 1) / alignment * alignment;
+      // never wrap a region around the end of the ring
+      if(start % capacity + size > capacity){
+        start = (start / capacity + 1) * capacity;
+      }
+      if(start + size - tail <= capacity){
+        head = start + size;
+        commandBuffer();
+        return StagingRegion{static_cast<uint8_t*>(ringMemory.mapped) + start % capacity, ringBuffer, start % capacity};
+      }
+
+      if(!inFlight.empty()){
+        retireOldest(true);
+      } else if(openBatch.commandBuffer != VK_NULL_HANDLE){
+        flush();
+      } else {
+        // nothing in flight, restart at the beginning of the ring
+        head = tail = (head + capacity - 1) / capacity * capacity;
+      }
+    }
+  }
+
+  // command buffer of the open batch, for recording copies and layout transitions
+  VkCommandBuffer commandBuffer(){
+    if(openBatch.commandBuffer == VK_NULL_HANDLE){
+      beginBatch();
+    }
+    return openBatch.commandBuffer;
+  }
+
+  UploadTicket pendingTicket() const { return UploadTicket{nextBatchId}; }
+
+  // true if uploads run on their own queue family and need ownership transfers
+  bool transfersOwnership() const { return uploadFamily != graphicsFamily; }
+
+  // dstAccess/dstStage describe the first use of the data on the graphics queue.
+  // Buffers larger than half the ring go up in several copies, which may span
+  // batches. The ticket is the one of the last batch.
+  UploadTicket uploadBuffer(VkBuffer dst, VkDeviceSize dstOffset, const void* data, VkDeviceSize size,
+                            VkAccessFlags dstAccess, VkPipelineStageFlags dstStage){
+    VkDeviceSize chunkSize = std::max(capacity / 2, MIN_ALIGNMENT);
+    for(VkDeviceSize done = 0; done < size;){
+      VkDeviceSize chunk = std::min(size - done, chunkSize);
+      StagingRegion region = allocate(chunk);
+      memcpy(region.mapped, static_cast<const uint8_t*>(data) + done, static_cast<size_t>(chunk));
+
+      VkBufferCopy copyRegion{};
+      copyRegion.srcOffset = region.offset;
+      copyRegion.dstOffset = dstOffset + done;
+      copyRegion.size = chunk;
+      vkCmdCopyBuffer(commandBuffer(), region.buffer, dst, 1, &copyRegion);
+      done += chunk;
+    }
+
+    // orders every earlier copy on the upload queue, including those of batches flushed in between
+    releaseBuffer(dst, dstOffset, size, dstAccess, dstStage);
+    return pendingTicket();
+  }
+
+  // hands a buffer range written by the open batch over to the graphics family
+  void releaseBuffer(VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size,
+                     VkAccessFlags dstAccess, VkPipelineStageFlags dstStage){
+    if(!transfersOwnership()){
+      sameQueueAccess |= dstAccess;
+      sameQueueStages |= dstStage;
+      return;
+    }
+
+    VkBufferMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.srcQueueFamilyIndex = uploadFamily;
+    barrier.dstQueueFamilyIndex = graphicsFamily;
+    barrier.buffer = buffer;
+    barrier.offset = offset;
+    barrier.size = size;
+    vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 1, &barrier, 0, nullptr);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    pendingAcquire.bufferBarriers.push_back(barrier);
+    pendingAcquire.bufferStages.push_back(dstStage);
+  }
+
+  // hands an image written by the open batch over to the graphics family, the
+  // layout stays the same on both sides
+  void releaseImage(VkImage image, const VkImageSubresourceRange& range, VkImageLayout layout,
+                    VkAccessFlags dstAccess, VkPipelineStageFlags dstStage){
+    if(!transfersOwnership()){
+      sameQueueAccess |= dstAccess;
+      sameQueueStages |= dstStage;
+      return;
+    }
+
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = layout;
+    barrier.newLayout = layout;
+    barrier.srcQueueFamilyIndex = uploadFamily;
+    barrier.dstQueueFamilyIndex = graphicsFamily;
+    barrier.image = image;
+    barrier.subresourceRange = range;
+    vkCmdPipelineBarrier(commandBuffer(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = dstAccess;
+    pendingAcquire.imageBarriers.push_back(barrier);
+    pendingAcquire.imageStages.push_back(dstStage);
+  }
+
+  // work that needs a graphics queue (e.g. blits), recorded after the acquire
+  // barriers, or straight into the open batch if uploads already run there
+  void onGraphicsQueue(std::function<void(VkCommandBuffer)> work){
+    if(!transfersOwnership()){
+      work(commandBuffer());
+      return;
+    }
+    pendingAcquire.work.push_back(std::move(work));
+  }
+
+  // records the acquire side of every batch submitted since the last call into
+  // a graphics command buffer (outside a render pass) and appends the
+  // semaphores the submit of that command buffer must wait on
+  void acquire(VkCommandBuffer graphicsCommandBuffer, UploadWaits& waits){
+    for(Acquire& acq : submittedAcquires){
+      for(size_t i = 0; i < acq.bufferBarriers.size(); i++){
+        vkCmdPipelineBarrier(graphicsCommandBuffer, acq.bufferStages[i], acq.bufferStages[i],
+                             0, 0, nullptr, 1, &acq.bufferBarriers[i], 0, nullptr);
+      }
+      for(size_t i = 0; i < acq.imageBarriers.size(); i++){
+        vkCmdPipelineBarrier(graphicsCommandBuffer, acq.imageStages[i], acq.imageStages[i],
+                             0, 0, nullptr, 0, nullptr, 1, &acq.imageBarriers[i]);
+      }
+      for(auto& work : acq.work){
+        work(graphicsCommandBuffer);
+      }
+      waits.semaphores.push_back(acq.semaphore);
+      waits.stages.push_back(acq.waitStages);
+    }
+    submittedAcquires.clear();
+  }
+
+  // returns semaphores handed out by acquire() once the submit that waited on
+  // them has completed
+  void recycle(UploadWaits& waits){
+    freeSemaphores.insert(freeSemaphores.end(), waits.semaphores.begin(), waits.semaphores.end());
+    waits.semaphores.clear();
+    waits.stages.clear();
+  }
+
+  // submits everything recorded since the last flush in one vkQueueSubmit
+  UploadTicket flush(){
+    if(openBatch.commandBuffer == VK_NULL_HANDLE){
+      return UploadTicket{nextBatchId - 1};
+    }
+
+    if(!transfersOwnership()){
+      // make the copies visible to every later consumer on this queue, the
+      // draw stages plus whatever the uploads of this batch asked for
+      VkMemoryBarrier barrier{};
+      barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT
+                            | VK_ACCESS_UNIFORM_READ_BIT | VK_ACCESS_SHADER_READ_BIT | sameQueueAccess;
+      vkCmdPipelineBarrier(openBatch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                           VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT
+                           | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | sameQueueStages,
+                           0, 1, &barrier, 0, nullptr, 0, nullptr);
+      sameQueueAccess = 0;
+      sameQueueStages = 0;
+    }
+
+    if(vkEndCommandBuffer(openBatch.commandBuffer) != VK_SUCCESS){
+      throw std::runtime_error("failed to record upload command buffer!");
+    }
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &openBatch.commandBuffer;
+
+    if(transfersOwnership()){
+      pendingAcquire.semaphore = nextSemaphore();
+      pendingAcquire.waitStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+      for(VkPipelineStageFlags stage : pendingAcquire.bufferStages){
+        pendingAcquire.waitStages |= stage;
+      }
+      for(VkPipelineStageFlags stage : pendingAcquire.imageStages){
+        pendingAcquire.waitStages |= stage;
+      }
+      submitInfo.signalSemaphoreCount = 1;
+      submitInfo.pSignalSemaphores = &pendingAcquire.semaphore;
+    }
+
+    if(vkQueueSubmit(queue, 1, &submitInfo, openBatch.fence) != VK_SUCCESS){
+      throw std::runtime_error("failed to submit upload batch!");
+    }
+
+    if(transfersOwnership()){
+      submittedAcquires.push_back(std::move(pendingAcquire));
+      pendingAcquire = Acquire{};
+    }
+
+    openBatch.ringEnd = head;
+    UploadTicket ticket{openBatch.id};
+    inFlight.push_back(openBatch);
+    openBatch = Batch{};
+    nextBatchId++;
+    return ticket;
+  }
+
+  // reclaims ring space of finished batches without blocking
+  void collect(){
+    while(!inFlight.empty() && vkGetFenceStatus(device, inFlight.front().fence) == VK_SUCCESS){
+      retireOldest(false);
+    }
+  }
+
+  bool isComplete(UploadTicket ticket){
+    collect();
+    return ticket.batch <= completedBatch;
+  }
+
+  void wait(UploadTicket ticket){
+    if(ticket.batch >= nextBatchId){
+      flush();
+    }
+    while(completedBatch < ticket.batch && !inFlight.empty()){
+      retireOldest(true);
+    }
+  }
+
+private:
+  struct Batch{
+    uint64_t id = 0;
+    VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+    VkFence fence = VK_NULL_HANDLE;
+    uint64_t ringEnd = 0;
+  };
+
+  // acquire half of the ownership transfers of one batch
+  struct Acquire{
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    std::vector<VkPipelineStageFlags> bufferStages;
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    std::vector<VkPipelineStageFlags> imageStages;
+    std::vector<std::function<void(VkCommandBuffer)>> work;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    VkPipelineStageFlags waitStages = 0;
+  };
+
+  VkDevice device;
+  DeviceMemoryAllocator& allocator;
+  VkQueue queue;
+  uint32_t uploadFamily;
+  uint32_t graphicsFamily;
+  VkDeviceSize capacity;
+
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+  VkBuffer ringBuffer = VK_NULL_HANDLE;
+  DeviceAllocation ringMemory;
+
+  // monotonically increasing ring positions, the physical offset is position % capacity
+  uint64_t head = 0;
+  uint64_t tail = 0;
+
+  Batch openBatch;
+  std::deque<Batch> inFlight;
+  std::vector<Batch> freeBatches;
+  uint64_t nextBatchId = 1;
+  uint64_t completedBatch = 0;
+
+  Acquire pendingAcquire;
+  // first uses of the open batch's uploads when there is no ownership transfer
+  VkAccessFlags sameQueueAccess = 0;
+  VkPipelineStageFlags sameQueueStages = 0;
+  std::vector<Acquire> submittedAcquires;
+  std::vector<VkSemaphore> semaphores;
+  std::vector<VkSemaphore> freeSemaphores;
+
+  VkSemaphore nextSemaphore(){
+    if(!freeSemaphores.empty()){
+      VkSemaphore semaphore = freeSemaphores.back();
+      freeSemaphores.pop_back();
+      return semaphore;
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore;
+    if(vkCreateSemaphore(device, &semaphoreInfo, nullptr, &semaphore) != VK_SUCCESS){
+      throw std::runtime_error("failed to create upload semaphore!");
+    }
+    semaphores.push_back(semaphore);
+    return semaphore;
+  }
+
+  void beginBatch(){
+    if(!freeBatches.empty()){
+      openBatch = freeBatches.back();
+      freeBatches.pop_back();
+    } else {
+      VkCommandBufferAllocateInfo allocInfo{};
+      allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+      allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+      allocInfo.commandPool = commandPool;
+      allocInfo.commandBufferCount = 1;
+      if(vkAllocateCommandBuffers(device, &allocInfo, &openBatch.commandBuffer) != VK_SUCCESS){
+        throw std::runtime_error("failed to allocate upload command buffer!");
+      }
+
+      VkFenceCreateInfo fenceInfo{};
+      fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+      if(vkCreateFence(device, &fenceInfo, nullptr, &openBatch.fence) != VK_SUCCESS){
+        throw std::runtime_error("failed to create upload fence!");
+      }
+    }
+    openBatch.id = nextBatchId;
+
+    VkCommandBufferBeginInfo beginInfo{};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(openBatch.commandBuffer, &beginInfo);
+  }
+
+  void retireOldest(bool block){
+    Batch batch = inFlight.front();
+    if(block){
+      vkWaitForFences(device, 1, &batch.fence, VK_TRUE, UINT64_MAX);
+    }
+    inFlight.pop_front();
+
+    tail = batch.ringEnd;
+    completedBatch = batch.id;
+
+    vkResetFences(device, 1, &batch.fence);
+    vkResetCommandBuffer(batch.commandBuffer, 0);
+    freeBatches.push_back(batch);
+  }
+};
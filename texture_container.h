@@ -0,0 +1,131 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mesh_cache.h"
+
+// GPU-ready texture written by texture_baker. Like KTX2 it stores the Vulkan
+// format and every mip level pre-encoded, but without the supercompression and
+// key/value sections:
+//   TextureContainerHeader | TextureLevel[levelCount] | level data
+// Level data is aligned so each level can be the bufferOffset of a copy region.
+constexpr uint32_t TEXTURE_CONTAINER_MAGIC = 0x58544b56; // "VKTX"
+constexpr uint32_t TEXTURE_CONTAINER_VERSION = 1;
+constexpr uint64_t TEXTURE_CONTAINER_ALIGNMENT = 16;
+
+struct TextureContainerHeader{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t sourceHash;
+  uint32_t vkFormat;
+  uint32_t width;
+  uint32_t height;
+  uint32_t levelCount;
+  uint64_t dataOffset;
+  uint64_t dataSize;
+  uint64_t fileSize;
+};
+
+// offset is relative to the start of the level data
+struct TextureLevel{
+  uint64_t offset;
+  uint64_t size;
+  uint32_t width;
+  uint32_t height;
+};
+
+// encoded mip level as produced by the baker
+struct EncodedLevel{
+  uint32_t width;
+  uint32_t height;
+  std::vector<uint8_t> data;
+};
+
+class TextureContainer{
+public:
+  static std::vector<uint8_t> build(uint64_t sourceHash, uint32_t vkFormat, const std::vector<EncodedLevel>& levels){
+    TextureContainerHeader header{};
+    header.magic = TEXTURE_CONTAINER_MAGIC;
+    header.version = TEXTURE_CONTAINER_VERSION;
+    header.sourceHash = sourceHash;
+    header.vkFormat = vkFormat;
+    header.width = levels.empty() ? 0 : levels[0].width;
+    header.height = levels.empty() ? 0 : levels[0].height;
+    header.levelCount = static_cast<uint32_t>(levels.size());
+    header.dataOffset = alignUp(sizeof(TextureContainerHeader) + levels.size() * sizeof(TextureLevel));
+
+    std::vector<TextureLevel> table(levels.size());
+    uint64_t offset = 0;
+    for(size_t i = 0; i < levels.size(); i++){
+      table[i] = TextureLevel{offset, levels[i].data.size(), levels[i].width, levels[i].height};
+      offset = alignUp(offset + levels[i].data.size());
+    }
+    header.dataSize = offset;
+    header.fileSize = header.dataOffset + header.dataSize;
+
+    std::vector<uint8_t> blob(header.fileSize, 0);
+    memcpy(blob.data(), &header, sizeof(header));
+    memcpy(blob.data() + sizeof(header), table.data(), table.size() * sizeof(TextureLevel));
+    for(size_t i = 0; i < levels.size(); i++){
+      memcpy(blob.data() + header.dataOffset + table[i].offset, levels[i].data.data(), levels[i].data.size());
+    }
+    return blob;
+  }
+
+  // maps a baked texture, returns false if it is missing or stale
+  bool open(const std::string& path, uint64_t sourceHash){
+    file.close();
+    if(!file.open(path)){
+      return false;
+    }
+    if(!validate(sourceHash)){
+      file.close();
+      return false;
+    }
+    return true;
+  }
+
+  bool isOpen() const { return file.isOpen(); }
+
+  const TextureContainerHeader& header() const { return *reinterpret_cast<const TextureContainerHeader*>(file.data()); }
+
+  const TextureLevel& level(uint32_t i) const {
+    return reinterpret_cast<const TextureLevel*>(file.data() + sizeof(TextureContainerHeader))[i];
+  }
+
+  // all levels, ready to be copied into staging memory as one block
+  const uint8_t* data() const { return file.data() + header().dataOffset; }
+  size_t dataSize() const { return static_cast<size_t>(header().dataSize); }
+
+private:
+  MappedFile file;
+
+  static uint64_t alignUp(uint64_t offset){
+    return (offset + TEXTURE_CONTAINER_ALIGNMENT - 1) & ~(TEXTURE_CONTAINER_ALIGNMENT - 1);
+  }
+
+  bool validate(uint64_t sourceHash) const {
+    if(file.size() < sizeof(TextureContainerHeader)){
+      return false;
+    }
+
+    const TextureContainerHeader& h = header();
+    if(h.magic != TEXTURE_CONTAINER_MAGIC || h.version != TEXTURE_CONTAINER_VERSION || h.sourceHash != sourceHash
+       || h.fileSize != file.size() || h.levelCount == 0
+       || sizeof(TextureContainerHeader) + h.levelCount * sizeof(TextureLevel) > h.dataOffset
+       || h.dataOffset + h.dataSize != h.fileSize){
+      return false;
+    }
+
+    for(uint32_t i = 0; i < h.levelCount; i++){
+      const TextureLevel& l = level(i);
+      if(l.offset % TEXTURE_CONTAINER_ALIGNMENT != 0 || l.offset + l.size > h.dataSize){
+        return false;
+      }
+    }
+    return true;
+  }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "stb_image.h"
+
+#include "cpu_trace.h"
+#include "mip_generator.h"
+#include "thread_pool.h"
+
+// RGBA8 pixels as returned by stb_image, plus levels 1..n if requested
+struct DecodedImage{
+  int width = 0;
+  int height = 0;
+  std::unique_ptr<stbi_uc, void(*)(void*)> pixels{nullptr, stbi_image_free};
+  std::vector<ImageRGBA8> mips;
+  double decodeMs = 0.0;
+  double mipMs = 0.0;
+
+  size_t byteSize() const { return static_cast<size_t>(width) * static_cast<size_t>(height) * 4; }
+};
+
+// parses only the file header, cheap enough for the main thread
+inline void readImageInfo(const std::string& path, int& width, int& height){
+  int channels;
+  if(!stbi_info(path.c_str(), &width, &height, &channels)){
+    throw std::runtime_error("failed to read texture header " + path + "!");
+  }
+}
+
+inline DecodedImage decodeImage(const std::string& path){
+  auto startTime = std::chrono::high_resolution_clock::now();
+
+  DecodedImage image;
+  int channels;
+  image.pixels.reset(stbi_load(path.c_str(), &image.width, &image.height, &channels, STBI_rgb_alpha));
+  if(!image.pixels){
+    throw std::runtime_error("failed to load texture image!");
+  }
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+  image.decodeMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+  return image;
+}
+
+// decode errors are rethrown by the future's get(). With generateMipLevels the
+// mip chain is built on the same pool before the future becomes ready.
+inline std::future<DecodedImage> decodeImageAsync(ThreadPool& pool, std::string path, bool generateMipLevels = false){
+  return pool.submit([&pool, path = std::move(path), generateMipLevels]{
+    CpuTraceScope traceScope("decode texture");
+    DecodedImage image = decodeImage(path);
+    if(generateMipLevels){
+      CpuTraceScope mipScope("generate mips");
+      auto startTime = std::chrono::high_resolution_clock::now();
+      image.mips = generateMips(image.pixels.get(), static_cast<uint32_t>(image.width), static_cast<uint32_t>(image.height),
+                                MipFilter::Box, &pool);
+      auto endTime = std::chrono::high_resolution_clock::now();
+      image.mipMs = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    }
+    return image;
+  });
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Non-owning reference to a callable, so hot paths can take lambdas without the
+// heap allocation a std::function may need. Only valid while the callable lives.
+template<typename Signature>
+class FunctionRef;
+
+template<typename R, typename... Args>
+class FunctionRef<R(Args...)>{
+public:
+  template<typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, FunctionRef>>>
+  FunctionRef(F&& f)
+    : object(const_cast<void*>(static_cast<const void*>(std::addressof(f)))),
+      invoke([](void* o, Args... args) -> R {
+        return (*static_cast<std::remove_reference_t<F>*>(o))(std::forward<Args>(args)...);
+      }) {}
+
+  R operator()(Args... args) const { return invoke(object, std::forward<Args>(args)...); }
+
+private:
+  void* object;
+  R (*invoke)(void*, Args...);
+};
+
+// Fixed size worker pool shared by the CPU side loaders.
+class ThreadPool{
+public:
+  explicit ThreadPool(size_t threadCount = std::max(1u, std::thread::hardware_concurrency())){
+    for(size_t i = 0; i < threadCount; i++){
+      workers.emplace_back([this]{ workerLoop(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  ~ThreadPool(){
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for(std::thread& worker : workers){
+      worker.join();
+    }
+  }
+
+  size_t size() const { return workers.size(); }
+
+  template<typename F>
+  auto submit(F&& task) -> std::future<std::invoke_result_t<F>> {
+    using Result = std::invoke_result_t<F>;
+    auto packaged = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> future = packaged->get_future();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      tasks.emplace([packaged]{ (*packaged)(); });
+    }
+    wake.notify_one();
+    return future;
+  }
+
+  // splits [0, count) into chunks of chunkSize, runs fn(begin, end) for each on
+  // the pool and blocks until all chunks are done. Exceptions are rethrown. The
+  // calling thread works on chunks too, so this may be called from a pool task.
+  // Nothing is allocated: the job lives on the caller's stack and idle workers
+  // join it from the pool's job list, the caller unlinks it and waits for them
+  // to leave before returning.
+  void parallelFor(size_t count, size_t chunkSize, FunctionRef<void(size_t, size_t)> fn){
+    chunkSize = std::max<size_t>(chunkSize, 1);
+    size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+    if(chunkCount == 0){
+      return;
+    }
+
+    Job job{fn, count, chunkSize, chunkCount};
+    job.maxHelpers = std::min(workers.size(), chunkCount - 1);
+    if(job.maxHelpers > 0){
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        job.nextJob = jobs;
+        jobs = &job;
+      }
+      wake.notify_all();
+    }
+
+    runChunks(job);
+
+    if(job.maxHelpers > 0){
+      std::unique_lock<std::mutex> lock(mutex);
+      Job** link = &jobs;
+      while(*link != &job){
+        link = &(*link)->nextJob;
+      }
+      *link = job.nextJob;
+      // every chunk is claimed, the helpers still inside finish theirs before leaving
+      jobLeft.wait(lock, [&]{ return job.helpers == 0; });
+    }
+    if(job.error){
+      std::rethrow_exception(job.error);
+    }
+  }
+
+private:
+  // one parallelFor call, owned by the calling thread
+  struct Job{
+    FunctionRef<void(size_t, size_t)> fn;
+    size_t count;
+    size_t chunkSize;
+    size_t chunkCount;
+    std::atomic<size_t> next{0};
+    // guarded by the pool mutex
+    size_t maxHelpers = 0;
+    size_t helpers = 0;
+    Job* nextJob = nullptr;
+    std::exception_ptr error;
+  };
+
+  std::vector<std::thread> workers;
+  std::queue<std::function<void()>> tasks;
+  // parallelFor jobs that may still have unclaimed chunks, newest first
+  Job* jobs = nullptr;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable jobLeft;
+  bool stopping = false;
+
+  // a job with chunks left and room for another helper, called with the mutex held
+  Job* openJob() const {
+    for(Job* job = jobs; job != nullptr; job = job->nextJob){
+      if(job->helpers < job->maxHelpers && job->next.load() < job->chunkCount){
+        return job;
+      }
+    }
+    return nullptr;
+  }
+
+  void runChunks(Job& job){
+    for(;;){
+      size_t chunk = job.next.fetch_add(1);
+      if(chunk >= job.chunkCount){
+        return;
+      }
+      size_t begin = chunk * job.chunkSize;
+      try{
+        job.fn(begin, std::min(begin + job.chunkSize, job.count));
+      } catch(...){
+        std::lock_guard<std::mutex> lock(mutex);
+        if(!job.error){
+          job.error = std::current_exception();
+        }
+      }
+    }
+  }
+
+  void workerLoop(){
+    for(;;){
+      std::function<void()> task;
+      Job* job = nullptr;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]{ return stopping || !tasks.empty() || openJob() != nullptr; });
+        // parallelFor callers are blocked waiting, so their chunks go first
+        job = openJob();
+        if(job != nullptr){
+          job->helpers++;
+        } else if(tasks.empty()){
+          return;
+        } else {
+          task = std::move(tasks.front());
+          tasks.pop();
+        }
+      }
+      if(job != nullptr){
+        runChunks(*job);
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          job->helpers--;
+        }
+        jobLeft.notify_all();
+        continue;
+      }
+      task();
+    }
+  }
+};
@@ -0,0 +1,71 @@
+// Offline texture bake: decodes an image, builds a gamma-correct Kaiser mip
+// chain and writes every level BC1 compressed into a .vktx container
+// (texture_container.h).
+//   texture_baker input.png output.vktx
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "bc1_encoder.h"
+#include "mip_generator.h"
+#include "texture_container.h"
+#include "thread_pool.h"
+
+using Clock = std::chrono::high_resolution_clock;
+
+static double elapsedMs(Clock::time_point start){
+  return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+int main(int argc, char** argv){
+  if(argc != 3){
+    std::cerr << "usage: texture_baker input.png output.vktx" << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::string inputPath = argv[1];
+  std::string outputPath = argv[2];
+
+  auto start = Clock::now();
+
+  int width, height, channels;
+  stbi_uc* pixels = stbi_load(inputPath.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+  if(!pixels){
+    std::cerr << "failed to load " << inputPath << ": " << stbi_failure_reason() << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  ImageRGBA8 base;
+  base.width = static_cast<uint32_t>(width);
+  base.height = static_cast<uint32_t>(height);
+  base.pixels.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+  stbi_image_free(pixels);
+
+  // offline, so the sharper and slower filter is affordable
+  ThreadPool pool;
+  std::vector<ImageRGBA8> chain = generateMipChain(std::move(base), MipFilter::Kaiser, &pool);
+
+  std::vector<EncodedLevel> levels;
+  size_t rawBytes = 0;
+  for(const ImageRGBA8& level : chain){
+    levels.push_back(EncodedLevel{level.width, level.height, compressBC1(level, pool)});
+    rawBytes += level.pixels.size();
+  }
+
+  std::vector<uint8_t> blob = TextureContainer::build(hashFile(inputPath), VK_FORMAT_BC1_RGB_SRGB_BLOCK, levels);
+  if(!writeFileAtomic(outputPath, blob)){
+    std::cerr << "failed to write " << outputPath << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::cout << "baked " << inputPath << " -> " << outputPath << ": " << width << "x" << height << ", "
+            << levels.size() << " levels, " << rawBytes / 1024 << " KiB RGBA8 -> " << blob.size() / 1024
+            << " KiB BC1 in " << elapsedMs(start) << " ms" << std::endl;
+  return EXIT_SUCCESS;
+}
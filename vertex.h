@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <functional>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtx/hash.hpp>
+
+struct Vertex{
+  glm::vec3 pos;
+  glm::vec3 color;
+  glm::vec2 texCoord;
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(Vertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bindingDescription;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 3> getAtrributeDescription() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescription{};
+
+    attributeDescription[0].binding = 0;
+    attributeDescription[0].location = 0;
+    attributeDescription[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescription[0].offset = offsetof(Vertex, pos);
+
+    attributeDescription[1].binding = 0;
+    attributeDescription[1].location = 1;
+    attributeDescription[1].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescription[1].offset = offsetof(Vertex, color);
+
+    attributeDescription[2].binding = 0;
+    attributeDescription[2].location = 2;
+    attributeDescription[2].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescription[2].offset = offsetof(Vertex, texCoord);
+
+    return attributeDescription;
+  }
+
+  bool operator==(const Vertex& other) const{
+    return pos == other.pos && color == other.color && texCoord == other.texCoord;
+  }
+};
+
+namespace std {
+  template<> struct hash<Vertex>{
+    size_t operator()(Vertex const& vertex) const {
+      return ((hash<glm::vec3>()(vertex.pos) ^ 
+              (hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
+              (hash<glm::vec2>()(vertex.texCoord) << 1);
+    }
+  };
+}
+
+// Vertex layouts the mesh can be uploaded in, chosen at load time.
+enum class VertexFormat : uint32_t {
+  // Vertex, 32 bytes
+  Float32 = 0,
+  // PackedVertex, 16 bytes
+  Packed16 = 1,
+};
+
+// 16 byte vertex: positions are unorm16 relative to the mesh bounding box,
+// texture coordinates half floats and the color unorm8. shader.vert turns the
+// positions back into model space with VertexQuantization from the UBO.
+struct PackedVertex{
+  uint16_t pos[4];
+  uint16_t texCoord[2];
+  uint8_t color[4];
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 0;
+    bindingDescription.stride = sizeof(PackedVertex);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    return bindingDescription;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 3> getAtrributeDescription() {
+    std::array<VkVertexInputAttributeDescription, 3> attributeDescription{};
+
+    attributeDescription[0].binding = 0;
+    attributeDescription[0].location = 0;
+    attributeDescription[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+    attributeDescription[0].offset = offsetof(PackedVertex, pos);
+
+    attributeDescription[1].binding = 0;
+    attributeDescription[1].location = 1;
+    attributeDescription[1].format = VK_FORMAT_R8G8B8A8_UNORM;
+    attributeDescription[1].offset = offsetof(PackedVertex, color);
+
+    attributeDescription[2].binding = 0;
+    attributeDescription[2].location = 2;
+    attributeDescription[2].format = VK_FORMAT_R16G16_SFLOAT;
+    attributeDescription[2].offset = offsetof(PackedVertex, texCoord);
+
+    return attributeDescription;
+  }
+};
+
+// Per-instance data in vertex binding 1, advanced once per instance. The
+// mat4 takes four consecutive locations after the vertex attributes.
+struct InstanceData{
+  glm::mat4 model;
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription bindingDescription{};
+    bindingDescription.binding = 1;
+    bindingDescription.stride = sizeof(InstanceData);
+    bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    return bindingDescription;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 4> getAtrributeDescription() {
+    std::array<VkVertexInputAttributeDescription, 4> attributeDescription{};
+
+    for(uint32_t column = 0; column < 4; column++){
+      attributeDescription[column].binding = 1;
+      attributeDescription[column].location = 3 + column;
+      attributeDescription[column].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attributeDescription[column].offset = static_cast<uint32_t>(offsetof(InstanceData, model) + column * sizeof(glm::vec4));
+    }
+
+    return attributeDescription;
+  }
+};
+
+static_assert(sizeof(Vertex) == 32, "Vertex layout changed");
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must stay half the size of Vertex");
+static_assert(sizeof(InstanceData) == 64, "InstanceData is read as four vec4 columns");
+
+// model space position = unorm position * scale + offset
+struct VertexQuantization{
+  glm::vec3 offset{0.0f, 0.0f, 0.0f};
+  glm::vec3 scale{1.0f, 1.0f, 1.0f};
+};
+
+// the model space position shader.vert computes for a packed vertex
+inline glm::vec3 unpackPosition(const PackedVertex& vertex, const VertexQuantization& quantization){
+  return glm::vec3(vertex.pos[0] / 65535.0f * quantization.scale.x + quantization.offset.x,
+                   vertex.pos[1] / 65535.0f * quantization.scale.y + quantization.offset.y,
+                   vertex.pos[2] / 65535.0f * quantization.scale.z + quantization.offset.z);
+}
+
+inline std::vector<PackedVertex> packVertices(const std::vector<Vertex>& vertices, VertexQuantization& quantization){
+  glm::vec3 minPos(0.0f);
+  glm::vec3 maxPos(0.0f);
+  if(!vertices.empty()){
+    minPos = maxPos = vertices[0].pos;
+  }
+  for(const Vertex& vertex : vertices){
+    minPos = glm::min(minPos, vertex.pos);
+    maxPos = glm::max(maxPos, vertex.pos);
+  }
+
+  quantization.offset = minPos;
+  quantization.scale = maxPos - minPos;
+
+  auto unorm16 = [](float value){
+    return static_cast<uint16_t>(std::lround(std::fmin(std::fmax(value, 0.0f), 1.0f) * 65535.0f));
+  };
+  auto unorm8 = [](float value){
+    return static_cast<uint8_t>(std::lround(std::fmin(std::fmax(value, 0.0f), 1.0f) * 255.0f));
+  };
+
+  std::vector<PackedVertex> packed(vertices.size());
+  for(size_t i = 0; i < vertices.size(); i++){
+    const Vertex& vertex = vertices[i];
+    PackedVertex& out = packed[i];
+    for(int axis = 0; axis < 3; axis++){
+      float extent = quantization.scale[axis];
+      out.pos[axis] = unorm16(extent > 0.0f ? (vertex.pos[axis] - minPos[axis]) / extent : 0.0f);
+    }
+    out.pos[3] = 0;
+    out.texCoord[0] = glm::packHalf1x16(vertex.texCoord.x);
+    out.texCoord[1] = glm::packHalf1x16(vertex.texCoord.y);
+    out.color[0] = unorm8(vertex.color.x);
+    out.color[1] = unorm8(vertex.color.y);
+    out.color[2] = unorm8(vertex.color.z);
+    out.color[3] = 255;
+  }
+  return packed;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "vertex.h"
+
+// Deduplicates vertices with a flat, linearly probed hash table. Each slot is
+// 8 bytes (hash tag + vertex index) and a lookup or insert costs one hash and,
+// for a hit, usually one compare. With a non-zero epsilon, positions, colors and
+// texture coordinates are snapped to an epsilon grid before hashing/comparing, so
+// vertices falling into the same cell are welded together.
+class VertexWelder{
+public:
+  explicit VertexWelder(size_t expectedVertices = 0, float epsilon = 0.0f)
+    : invEpsilon(epsilon > 0.0f ? 1.0f / epsilon : 0.0f) {
+    size_t capacity = 16;
+    while(capacity < expectedVertices * 2){
+      capacity *= 2;
+    }
+    slots.assign(capacity, Slot{0, EMPTY});
+    mask = capacity - 1;
+    uniqueVertices.reserve(expectedVertices);
+  }
+
+  // returns the index of an equal vertex, inserting the vertex if it is new
+  uint32_t weld(const Vertex& vertex){
+    Key key = makeKey(vertex);
+    uint32_t tag = static_cast<uint32_t>(hashKey(key));
+
+    for(size_t i = tag & mask;; i = (i + 1) & mask){
+      Slot& slot = slots[i];
+      if(slot.index == EMPTY){
+        uint32_t index = static_cast<uint32_t>(uniqueVertices.size());
+        slot = Slot{tag, index};
+        uniqueVertices.push_back(vertex);
+        if(uniqueVertices.size() * 2 > slots.size()){
+          grow();
+        }
+        return index;
+      }
+      if(slot.tag == tag && makeKey(uniqueVertices[slot.index]) == key){
+        return slot.index;
+      }
+    }
+  }
+
+  const std::vector<Vertex>& vertices() const { return uniqueVertices; }
+  std::vector<Vertex> takeVertices() { return std::move(uniqueVertices); }
+  size_t size() const { return uniqueVertices.size(); }
+
+private:
+  static constexpr uint32_t EMPTY = UINT32_MAX;
+  // the range of doubles that convert to int64_t
+  static constexpr double CELL_MIN = -9223372036854775808.0;
+  static constexpr double CELL_MAX = 9223372036854774784.0;
+
+  struct Slot{
+    uint32_t tag;
+    uint32_t index;
+  };
+
+  // 64 bits per component, so epsilon grid cells of far away or finely snapped values don't wrap
+  using Key = std::array<uint64_t, 8>;
+
+  std::vector<Slot> slots;
+  std::vector<Vertex> uniqueVertices;
+  size_t mask = 0;
+  float invEpsilon;
+
+  uint64_t keyComponent(float value) const {
+    if(invEpsilon > 0.0f){
+      // clamped, a cell outside the int64 range (or NaN) would make the cast undefined
+      double cell = std::floor(static_cast<double>(value) * invEpsilon);
+      if(!(cell > CELL_MIN)){
+        cell = CELL_MIN;
+      }
+      return static_cast<uint64_t>(static_cast<int64_t>(std::min(cell, CELL_MAX)));
+    }
+    // -0.0f == 0.0f, so both must produce the same key
+    if(value == 0.0f){
+      value = 0.0f;
+    }
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+  }
+
+  Key makeKey(const Vertex& vertex) const {
+    return {
+      keyComponent(vertex.pos.x), keyComponent(vertex.pos.y), keyComponent(vertex.pos.z),
+      keyComponent(vertex.color.x), keyComponent(vertex.color.y), keyComponent(vertex.color.z),
+      keyComponent(vertex.texCoord.x), keyComponent(vertex.texCoord.y)
+    };
+  }
+
+  static uint64_t mix(uint64_t h){
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static uint64_t hashKey(const Key& key){
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    for(uint64_t word : key){
+      h = (h ^ word) * 0x100000001b3ull;
+      h = (h << 29) | (h >> 35);
+    }
+    return mix(h);
+  }
+
+  void grow(){
+    std::vector<Slot> oldSlots(slots.size() * 2, Slot{0, EMPTY});
+    oldSlots.swap(slots);
+    mask = slots.size() - 1;
+
+    for(const Slot& slot : oldSlots){
+      if(slot.index == EMPTY){
+        continue;
+      }
+      size_t i = slot.tag & mask;
+      while(slots[i].index != EMPTY){
+        i = (i + 1) & mask;
+      }
+      slots[i] = slot;
+    }
+  }
+};